@@ -9,8 +9,10 @@
 int main(int argc, char **argv)
 {
 	struct sockaddr_in6 ca;
-	int ret;
+	int ret, one = 1;
 	dhcp_server_t *server;
+	char addrbuf[INET6_ADDRSTRLEN];
+	struct stat lst, ost;
 
 	if (getuid()){
 		fprintf(stderr,"\n\tThis program must be run as root\n");
@@ -18,6 +20,11 @@ int main(int argc, char **argv)
 	}
 	logfp = stderr;
 	time(&start_time);
+	/* parse_args() cuts up some arguments with strtok() */
+	cmd_argc = argc;
+	cmd_argv = malloc(argc * sizeof(char *));
+	for (ret = 0; ret < argc; ret++)
+		cmd_argv[ret] = strdup(argv[ret]);
 	parse_args(argc, argv);
 
 
@@ -32,6 +39,11 @@ int main(int argc, char **argv)
 		}
 		setvbuf(logfp, NULL, _IONBF, 0);
 	}
+	/* --json - owns stdout; the text report goes to stderr */
+	if (json_file != NULL && !strcmp(json_file, "-") &&
+			fstat(fileno(logfp), &lst) == 0 && fstat(fileno(stdout), &ost) == 0 &&
+			lst.st_dev == ost.st_dev && lst.st_ino == ost.st_ino)
+		logfp = stderr;
         fprintf(logfp,"Begin: Version %s\n", version);
 
 	if (output_file != NULL){
@@ -61,6 +73,35 @@ int main(int argc, char **argv)
         if (ret < 0)
 		fprintf(stderr, "Warning:  setsockbuf(SO_SNDBUF) failed\n");
 
+#ifdef SO_BUSY_POLL
+	if (busy_poll){
+		if (setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &busy_poll, sizeof(busy_poll)) < 0)
+			fprintf(stderr, "Warning:  SO_BUSY_POLL failed, spinning without it\n");
+		else
+			setsockopt(sock, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one));
+	}
+#endif
+#ifdef linux
+	if (pin_cpu >= 0){
+		cpu_set_t	cpus;
+
+		CPU_ZERO(&cpus);
+		CPU_SET(pin_cpu, &cpus);
+		if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0){
+			perror("sched_setaffinity");
+			exit(1);
+		}
+	}
+#endif
+#ifdef SO_RXQ_OVFL
+	if (setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one)) < 0)
+		fprintf(stderr, "Warning:  SO_RXQ_OVFL failed, no socket drop count\n");
+#endif
+	if (use_gro && setsockopt(sock, SOL_UDP, UDP_GRO, &one, sizeof(one)) < 0){
+		fprintf(stderr, "Warning:  UDP_GRO not supported\n");
+		use_gro = 0;
+	}
+
 	memset(&ca, 0, sizeof(struct sockaddr_in6));
 	ca.sin6_family = AF_INET6;
 	ca.sin6_port = htons(DHCP6_LOCAL_PORT);
@@ -70,14 +111,45 @@ int main(int argc, char **argv)
 		perror("bind");
 		exit(1);
 	}
+	/* With --raw replies come off the ring and this socket is never
+	   read.  It stays bound so relay replies to the host don't draw
+	   port unreachables, with the smallest buffer the kernel allows */
+	if (raw_ifname != NULL){
+		ret = 0;
+		setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &ret, sizeof(ret));
+	}
+
+	if (raw_mode && raw_ifname == NULL){
+		fprintf(stderr,"--xdp needs --raw <ifname>\n");
+		exit(1);
+	}
+	if (raw_ifname != NULL){
+		for (server=servers; server != NULL; server=server->next)
+			if (!raw_have_gw && !IN6_IS_ADDR_MULTICAST(&server->sa.sin6_addr)){
+				inet_ntop(AF_INET6, &server->sa.sin6_addr, addrbuf, sizeof(addrbuf));
+				fprintf(stderr,"--raw: server %s is unicast, give its MAC as --raw %s,<MAC>\n",
+					addrbuf, raw_ifname);
+				exit(1);
+			}
+		if (raw_open(raw_ifname, raw_have_gw ? raw_gwmac : NULL,
+				DHCP6_LOCAL_PORT, raw_mode) < 0)
+			exit(1);
+		raw_ifmac(raw_mac);
+	}
 
 	for (server=servers; server != NULL; server=server->next){
 		server->list = malloc(max_sessions * sizeof(dhcp_session_t));
 		memset(server->list, '\0', max_sessions * sizeof(dhcp_session_t));
+		server->cwnd = 1;
 	}
 
+	tmpl_build();
+	profile_build();
+	txid_next = rand() & TXID_MASK;
+	local_drops(&drops_base);
+	gettimeofday(&window_start, NULL);
 	sender();
-	return(test_statistics());
+	return(test_statistics(1));
 }
 
 /*
@@ -90,26 +162,57 @@ void sender(void)
 	dhcp_server_t		*s;
 	lease_data_t		*leases = NULL;
 	lease_data_t		*lease;
-	uint32_t		ntransactions = 0;
-	int			complete = 0;
+	uint64_t		ntransactions = 0;
+	int			complete = 0, stopping = 0;
+	int			pollto, active;
+	struct timeval		slot;
 
-	if ( input_file != NULL &&
+	if (lifecycle){
+		lifecycle_sender();
+		return;
+	}
+	if (herd_window){
+		herd_sender();
+		return;
+	}
+	if (nmix){
+		mix_sender();
+		return;
+	}
+	if (nphases){
+		scenario_sender();
+		return;
+	}
+	if ( input_file != NULL && soak_duration == 0 &&
 			(number_requests=read_lease_data(&leases)) == 0 ){
 			exit(1);
 	}
 	lease = leases;
 	while  (!complete){
-		session = find_free_session(current_server);
-		
-		if (session == NULL){
-                        if (num_servers > 1)
-                                getmac(NULL);
+		pollto = 20;
+		session = NULL;
+		if (soak_duration && !stopping &&
+				time(NULL) - start_time >= soak_duration){
+			stopping = 1;
+			fprintf(logfp,"Soak: %u secs elapsed, draining\n", soak_duration);
 		}
-		else {
+		if (!stopping &&
+				(target_rate == 0 || rate_slot(ntransactions, &slot, &pollto))){
+			session = find_free_session(current_server);
+			if (session == NULL && num_servers > 1)
+				getmac(NULL);
+		}
+		if (session != NULL){
 			if (send_delay)
 				poll(NULL, 0, send_delay);
+			if (target_rate > 0){
+				session->intended_start = slot;
+				pollto = 0;
+			}
 
 			if (input_file != NULL){
+				if (soak_duration)
+					lease = soak_next_lease();
 				if (lease != NULL){
 					ntransactions++;
 					if (memcmp(&lease->sa, &in6addr_any, sizeof(struct in6_addr))){
@@ -124,1907 +227,5220 @@ void sender(void)
 					lease=lease->next;
 				}
 			}
-			else if (ntransactions < number_requests){
+			else if (soak_duration || ntransactions < number_requests){
 				ntransactions++;
 				fill_session(session, NULL);
 				send_packet6(DHCPV6_SOLICIT, session, current_server);
 			}
 		}
-		reader();
+		reader(pollto);
 		complete = process_sessions();
 		//fprintf(stderr,"Complete: %u ntrans %u\n", complete, ntransactions);
+		if (soak_duration){
+			for (active = 0, s=servers; s != NULL; s=s->next)
+				active += s->active;
+			complete = stopping && active == 0;
+		}
 		if ( current_server->next == NULL)
 			current_server = servers;
 		else
 			current_server = current_server->next;
 	}
 }
-void fill_session(dhcp_session_t *session, lease_data_t *lease)
+/*
+    --lifecycle: a fixed population of clients acquires leases, renews them
+    at T1, falls back to REBIND at T2 and re-solicits once a lease expires,
+    for as many seconds as asked.  Server timers may be divided by
+    --compress so a day of leases plays out in minutes.
+*/
+void lifecycle_sender(void)
 {
-	int i;
+	lease_data_t		*leases = NULL, *lease;
+	lease_data_t		*client;
+	dhcp_session_t		*session;
+	dhcp_server_t		*server, *current_server = servers;
+	uint32_t		i, now, phase = LC_ACQUIRE;
+	int			pollto, stopping = 0, active;
 
-	if (lease != NULL){
-		session->transaction_id = session->mac + 3;
-		session->num_ia = lease->num_ia;
-		for (i=0; i< lease->num_ia; i++){
-			session->ia[i].ipaddr = lease->ia[i].ipaddr;
-			session->ia[i].prefix_len = lease->ia[i].prefix_len;
-			session->ia[i].iaid = lease->ia[i].iaid;
+	if (input_file != NULL){
+		if ((nclients = read_lease_data(&leases)) == 0)
+			exit(1);
+		if (start_from == DHCPV6_REBIND)
+			phase = LC_REBIND;
+		else if (start_from != DHCPV6_SOLICIT)
+			phase = LC_RENEW;
+	}
+	else
+		nclients = number_requests;
+
+	clients = calloc(nclients, sizeof(lease_data_t));
+	lc_heap = malloc(nclients * sizeof(lc_event_t));
+	assert(clients != NULL && lc_heap != NULL);
+	for (i = 0, lease = leases; i < nclients; i++){
+		if (lease != NULL){
+			clients[i] = *lease;
+			clients[i].next = NULL;
+			clients[i].server = NULL;
+			for (server=servers; server != NULL; server=server->next)
+				if (!memcmp(&server->sa.sin6_addr, &lease->sa,
+						sizeof(struct in6_addr)))
+					clients[i].server = server;
+			lease = lease->next;
 		}
-		memcpy(session->serverid, lease->serverid, lease->serverid_len);
-		session->serverid_len = lease->serverid_len;
-		memcpy(session->mac,lease->mac,6);
-		if (lease->hostname != NULL)
-			strncpy(session->hostname, lease->hostname, 
-				sizeof(session->hostname));
-		else
-			*(session->hostname) = '\0';
-
 	}
-	else {
-		getmac(session->mac);
-		session->num_ia = num_per_mac;
-		for (i=0; i < num_per_mac; i++){
-			session->ia[i].iaid = ++ia_id * 1000 + i;
-			session->ia[i].ipaddr = in6addr_any;
-			session->ia[i].prefix_len = 0;
+	/* Leases from -f start out bound unless we begin by soliciting */
+	if (phase != LC_ACQUIRE)
+		lc_stats.bound = nclients;
+	gettimeofday(&lc_start_time, NULL);
+	for (i = 0; i < nclients; i++)
+		lc_schedule(i, phase, target_rate > 0 ? i * 1000.0 / target_rate : 0);
+
+	while (1){
+		now = lc_now();
+		if (!stopping && now >= lifecycle * 1000){
+			stopping = 1;
+			fprintf(logfp,"Lifecycle: %u secs elapsed, draining\n", lifecycle);
 		}
-		if (send_hostname) {
-			if (random_hostname)
-				snprintf(session->hostname, sizeof(session->hostname),
-					"h%u%u.%s", rand(), rand(),
-					update_domain ? update_domain : "");
-			else
-				snprintf(session->hostname,sizeof(session->hostname),
-					"h%02x%02x%02x%02x%02x%02x.%s",
-					session->mac[0], session->mac[1],
-					session->mac[2], session->mac[3], session->mac[4],
-				session->mac[5], update_domain ? update_domain : "");
+		while (!stopping && lc_heap_len > 0 && lc_heap[0].due <= now){
+			client = clients + lc_heap[0].client;
+			if (client->phase == LC_EXPIRE){
+				lc_pop();
+				lc_stats.expired++;
+				lc_stats.bound--;
+				if (max_renewals && client->renewals >= max_renewals){
+					client->num_ia = 0;
+					client->renewals = 0;
+				}
+				lc_schedule(client - clients, LC_ACQUIRE, now);
+				continue;
+			}
+			server = client->server ? client->server : current_server;
+			if ((session = find_free_session(server)) == NULL)
+				break;
+			lc_pop();
+			if (client->server == NULL){
+				client->server = server;
+				current_server = server->next ? server->next : servers;
+			}
+			lc_start(session, client, server);
 		}
-		else {
-			*(session->hostname) = '\0';
+		pollto = 20;
+		if (!stopping && lc_heap_len > 0 && lc_heap[0].due > now &&
+				lc_heap[0].due - now < pollto)
+			pollto = lc_heap[0].due - now;
+		reader(pollto);
+		process_sessions();
+
+		if (stopping){
+			for (active = 0, server=servers; server != NULL; server=server->next)
+				active += server->active;
+			if (active == 0)
+				break;
 		}
-		session->serverid[0] = 0xff;
-		session->serverid_len = 0;
 	}
-	return;
 }
-int test_statistics(void)
+void lc_schedule(uint32_t c, uint8_t phase, uint32_t due)
 {
-	dhcp_server_t	*iter;
-	double	elapsed;
-	int	retval = 0;
-	char	ipstr[INET6_ADDRSTRLEN];
+	uint32_t	i;
 
-	fprintf(logfp, "\nTest started:         %s\n",
-			ctime(&start_time));
-	for (iter=servers; iter != NULL; iter=iter->next){
-		inet_ntop(AF_INET6, &iter->sa.sin6_addr, ipstr, sizeof(ipstr));
-		fprintf(logfp,"Server %-s\n", ipstr);
-		if ( iter->stats.solicit_acks_received +
-			iter->stats.solicit_naks_received +
-			iter->stats.request_acks_received +
-			iter->stats.request_naks_received +
-			iter->stats.renew_acks_received +
-			iter->stats.renew_naks_received +
-			iter->stats.rebind_acks_received +
-			iter->stats.rebind_naks_received +
-			iter->stats.inform_acks_received +
-			iter->stats.inform_naks_received +
-			iter->stats.confirm_acks_received +
-			iter->stats.confirm_naks_received +
-			iter->stats.release_acks_received +
-			iter->stats.release_naks_received == 0){
-			fprintf(logfp,"\n\tNo replies received.\n");
-			retval = 1;
-			continue;
-		}
+	clients[c].phase = phase;
+	for (i = lc_heap_len++; i > 0 && lc_heap[(i - 1) / 2].due > due; i = (i - 1) / 2)
+		lc_heap[i] = lc_heap[(i - 1) / 2];
+	lc_heap[i].due = due;
+	lc_heap[i].client = c;
+}
+/* Remove the earliest event */
+void lc_pop(void)
+{
+	uint32_t	i = 0, child;
+	lc_event_t	ev;
+
+	ev = lc_heap[--lc_heap_len];
+	while ((child = 2 * i + 1) < lc_heap_len){
+		if (child + 1 < lc_heap_len &&
+				lc_heap[child + 1].due < lc_heap[child].due)
+			child++;
+		if (ev.due <= lc_heap[child].due)
+			break;
+		lc_heap[i] = lc_heap[child];
+		i = child;
+	}
+	lc_heap[i] = ev;
+}
+uint32_t lc_now(void)
+{
+	struct timeval	now;
 
-                if (iter->stats.failed + iter->stats.errors > 0 )
-			retval = 1;
-		fprintf(logfp,"Solicits sent:          %6u\n",
-				iter->stats.solicits_sent);
-		fprintf(logfp,"Solicit Acks Received:  %6u\n",
-				iter->stats.solicit_acks_received);
-		fprintf(logfp,"Solicit Naks Received:  %6u\n",
-				iter->stats.solicit_naks_received);
+	gettimeofday(&now, NULL);
+	return(DELTATV64(now, lc_start_time) / 1000);
+}
+/* The run time in ms at which a server timer of secs, started at ms, fires */
+uint32_t lc_after(uint32_t ms, uint32_t secs)
+{
+	double	t;
 
-		fprintf(logfp,"Requests sent:          %6u\n",
-					iter->stats.requests_sent);
-		fprintf(logfp,"Request Acks Received:  %6u\n",
-					iter->stats.request_acks_received);
-		fprintf(logfp,"Request Naks received:  %6u\n",
-					iter->stats.request_naks_received);
-		if (iter->stats.renews_sent){
-			fprintf(logfp,"Renew Acks Received:    %6u\n",
-					iter->stats.renew_acks_received);
-			fprintf(logfp,"Renew Naks received:    %6u\n",
-					iter->stats.renew_naks_received);
-		}
+	t = ms + secs * 1000.0 / time_compress;
+	return(t > 0xfffffff0U ? 0xfffffff0U : (uint32_t) t);
+}
+void lc_start(dhcp_session_t *session, lease_data_t *client, dhcp_server_t *server)
+{
+	int	i;
 
-		if (iter->stats.releases_sent){
-			fprintf(logfp,"Releases sent:          %6u\n",iter->stats.releases_sent);
-			fprintf(logfp,"Release Acks Received:  %6u\n",
-				iter->stats.release_acks_received);
-			fprintf(logfp,"Release Naks Received:  %6u\n",
-				iter->stats.release_naks_received);
+	if (client->num_ia == 0){
+		fill_session(session, NULL);
+		memcpy(client->mac, session->mac, 6);
+	}
+	else
+		fill_session(session, client);
+	session->client = client;
+
+	switch (client->phase){
+		case LC_ACQUIRE:
+			session->serverid[0] = 0xff;
+			session->serverid_len = 0;
+			for (i = 0; i < session->num_ia; i++){
+				session->ia[i].ipaddr = in6addr_any;
+				session->ia[i].prefix_len = 0;
+			}
+			send_packet6(DHCPV6_SOLICIT, session, server);
+		break;
+		case LC_RENEW:
+			/* RENEW gives up at T2, REBIND when the lease expires */
+			if (client->t2 > client->t1)
+				session->mrd = lc_after(0, client->t2 - client->t1);
+			send_packet6(DHCPV6_RENEW, session, server);
+		break;
+		case LC_REBIND:
+			/* REBIND goes to any server */
+			session->serverid[0] = 0xff;
+			session->serverid_len = 0;
+			if (client->valid > client->t2)
+				session->mrd = lc_after(0, client->valid - client->t2);
+			send_packet6(DHCPV6_REBIND, session, server);
+		break;
+		case LC_RELEASE:
+			send_packet6(DHCPV6_RELEASE, session, server);
+		break;
+		case LC_CONFIRM:
+			session->serverid[0] = 0xff;
+			session->serverid_len = 0;
+			send_packet6(DHCPV6_CONFIRM, session, server);
+		break;
+	}
+}
+/*
+    --herd: the whole -f population comes back from an outage at once.
+    Every client wakes at a random point in the window, waits the RFC 8415
+    initial delay for its message and then runs its exchange with its own
+    session, so the -q window does not throttle the storm.
+*/
+void herd_sender(void)
+{
+	lease_data_t		*leases = NULL, *lease;
+	lease_data_t		*client;
+	dhcp_session_t		*session;
+	dhcp_server_t		*server, *current_server = servers;
+	uint32_t		i, now, phase;
+	int			pollto, active;
+
+	if ((nclients = read_lease_data(&leases)) == 0)
+		exit(1);
+	if (herd_msg == DHCPV6_SOLICIT)
+		phase = LC_ACQUIRE;
+	else if (herd_msg == DHCPV6_REBIND)
+		phase = LC_REBIND;
+	else
+		phase = LC_CONFIRM;
+
+	if (max_sessions < nclients){
+		max_sessions = nclients;
+		for (server=servers; server != NULL; server=server->next){
+			free(server->list);
+			server->list = calloc(max_sessions, sizeof(dhcp_session_t));
+			assert(server->list != NULL);
 		}
-		if (iter->stats.declines_sent){
-			fprintf(logfp,"Declines sent:          %6u\n",iter->stats.declines_sent);
-			fprintf(logfp,"Decline Acks Received:  %6u\n",
-				iter->stats.decline_acks_received);
-			fprintf(logfp,"Decline Naks Received:  %6u\n",
-				iter->stats.decline_naks_received);
+	}
+	clients = calloc(nclients, sizeof(lease_data_t));
+	lc_heap = malloc(nclients * sizeof(lc_event_t));
+	assert(clients != NULL && lc_heap != NULL);
+	for (i = 0, lease = leases; i < nclients; i++, lease = lease->next){
+		clients[i] = *lease;
+		clients[i].next = NULL;
+		clients[i].server = NULL;
+		for (server=servers; server != NULL; server=server->next)
+			if (!memcmp(&server->sa.sin6_addr, &lease->sa,
+					sizeof(struct in6_addr)))
+				clients[i].server = server;
+		lc_schedule(i, phase, (uint32_t)(herd_window *
+			(rand() / (RAND_MAX + 1.0))) + herd_delay(herd_msg));
+	}
+	fprintf(logfp,"Herd: %u clients sending %s within %u ms\n", nclients,
+		typestrings[herd_msg - 1], herd_window);
+	gettimeofday(&lc_start_time, NULL);
+
+	while (1){
+		now = lc_now();
+		while (lc_heap_len > 0 && lc_heap[0].due <= now){
+			client = clients + lc_heap[0].client;
+			server = client->server ? client->server : current_server;
+			if ((session = find_free_session(server)) == NULL)
+				break;
+			lc_pop();
+			if (client->server == NULL){
+				client->server = server;
+				current_server = server->next ? server->next : servers;
+			}
+			lc_start(session, client, server);
 		}
-		if (iter->stats.informs_sent){
-			fprintf(logfp,"Information Requests sent:      %6u\n",
-					iter->stats.informs_sent);
-			fprintf(logfp,"Information Request Acks Received: %5u\n",
-				iter->stats.inform_acks_received);
-			fprintf(logfp,"Information Request Naks Received: %5u\n",
-				iter->stats.inform_naks_received);
+		pollto = 20;
+		if (lc_heap_len > 0 && lc_heap[0].due > now &&
+				lc_heap[0].due - now < pollto)
+			pollto = lc_heap[0].due - now;
+		reader(pollto);
+		process_sessions();
+
+		for (active = 0, server=servers; server != NULL; server=server->next)
+			active += server->active;
+		if (active == 0 && lc_heap_len == 0)
+			break;
+	}
+}
+/*
+    --mix: several flows share one event loop and one session window.
+    Flows with a rate start on their own schedule; the others split the
+    remaining starts by weight (paced by --rate, if given).  The run ends
+    after -n starts in total.
+*/
+void mix_sender(void)
+{
+	lease_data_t		*leases = NULL, *lease;
+	dhcp_session_t		*session;
+	dhcp_server_t		*current_server = servers;
+	mix_flow_t		*flow;
+	struct timeval		slot;
+	uint32_t		nleases = 0, share, wsum = 0, i;
+	double			rated = 0, pool, share_of[MAX_MIX], total = 0;
+	uint64_t		started = 0;
+	int			f, pollto, active, stopping = 0;
+	dhcp_server_t		*server;
+
+	if (input_file != NULL && (nleases = read_lease_data(&leases)) == 0)
+		exit(1);
+	/*
+	 * Slices go by starts/sec.  Weighted flows split --rate between
+	 * them; without --rate their pace is unknown, so together they
+	 * count as much as the rated flows together.
+	 */
+	for (f = 0; f < nmix; f++){
+		if (mix[f].type == DHCPV6_SOLICIT)
+			continue;
+		if (mix[f].rate > 0)
+			rated += mix[f].rate;
+		else
+			wsum += mix[f].weight;
+	}
+	pool = target_rate > 0 ? target_rate : rated > 0 ? rated : 1;
+	for (f = 0; f < nmix; f++){
+		share_of[f] = mix[f].type == DHCPV6_SOLICIT ? 0 :
+			mix[f].rate > 0 ? mix[f].rate : pool * mix[f].weight / wsum;
+		total += share_of[f];
+	}
+	for (f = 0, lease = leases; f < nmix; f++){
+		flow = mix + f;
+		if (flow->type == DHCPV6_SOLICIT)
+			continue;
+		if (nleases == 0 && flow->type != DHCPV6_INFORMATION_REQUEST){
+			fprintf(logfp,"--mix: %s needs leases from -f\n",
+				typestrings[flow->type - 1]);
+			exit(1);
 		}
-		if (iter->stats.rebinds_sent){
-			fprintf(logfp,"Rebinds sent:                   %6u\n",
-					iter->stats.rebinds_sent);
-			fprintf(logfp,"Rebind Acks Received:  %6u\n",
-				iter->stats.rebind_acks_received);
+		share = total > 0 ? nleases * share_of[f] / total : 0;
+		if (share == 0 && lease != NULL)
+			share = 1;
+		flow->first = flow->next = lease;
+		for (i = 0; i < share && lease != NULL; i++)
+			lease = lease->next;
+		flow->nleases = i;
+	}
+
+	while (1){
+		pollto = 20;
+		if (soak_duration && !stopping &&
+				time(NULL) - start_time >= soak_duration){
+			stopping = 1;
+			fprintf(logfp,"Soak: %u secs elapsed, draining\n", soak_duration);
 		}
-		if (iter->stats.confirms_sent){
-			fprintf(logfp,"Confirms sent:                  %6u\n",
-					iter->stats.confirms_sent);
-			fprintf(logfp,"Confirm Acks Received:            %6u\n",
-				iter->stats.confirm_acks_received);
+		while (!stopping && (soak_duration || started < number_requests) &&
+				(session = find_free_session(current_server)) != NULL){
+			if ((flow = mix_pick(&pollto, &slot)) == NULL){
+				session->state = UNALLOCATED;
+				current_server->active--;
+				break;
+			}
+			flow->started++;
+			started++;
+			session->flow = flow - mix + 1;
+			session->intended_start = slot;
+			mix_start(session, flow, current_server);
+			current_server = current_server->next ? current_server->next : servers;
 		}
+		/* Nothing left to start once every flow has spent its slice */
+		for (f = 0; f < nmix && mix_spent(mix + f); f++)
+			;
+		if (f == nmix && !stopping){
+			stopping = 1;
+			fprintf(logfp,"--mix: every flow has released its leases, draining\n");
+		}
+		reader(pollto);
+		process_sessions();
 
-		fprintf(logfp,"Advertise timeouts:     %6u\n",
-			iter->stats.solicit_ack_timeouts);
-		fprintf(logfp,"Request Timeouts:       %6u\n",
-			iter->stats.request_ack_timeouts);
-		fprintf(logfp,"Renew Timeouts:         %6u\n",
-			iter->stats.renew_ack_timeouts);
-		elapsed = DELTATV(iter->last_packet_received,
-					iter->first_packet_sent)/1000000.000;
-
-		fprintf(logfp,"Completed:              %6u\n",iter->stats.completed);
-		fprintf(logfp,"Failed:                 %6u\n",iter->stats.failed);
-		fprintf(logfp,"Errors:                 %6u\n",iter->stats.errors);
-		fprintf(logfp,"Elapsed time:         %15.2f secs\n", elapsed);
-		fprintf(logfp,"Advertise Latency (Min/Max/Avg): %.3f/%.3f/%.3f (ms)\n",
-		0.0010 * (double) iter->stats.advertise_latency_min,
-		0.0010 * (double)iter->stats.advertise_latency_max,
-		0.0010 * (double) iter->stats.advertise_latency_avg / (double)
-		(iter->stats.solicit_acks_received + iter->stats.solicit_naks_received ?
-		 	iter->stats.solicit_acks_received + iter->stats.solicit_naks_received : 1));
-		fprintf(logfp,"Reply Latency (Min/Max/Avg):     %.3f/%.3f/%.3f (ms)\n",
-		0.0010 * (double) iter->stats.reply_latency_min,
-		0.0010 * (double) iter->stats.reply_latency_max,
-		0.0010 * (double) iter->stats.reply_latency_avg / (double)
-		(iter->stats.request_acks_received ? iter->stats.request_acks_received : 1));
-		fprintf(logfp,"Advertise Acks/sec:            %6.2f\n",
-			(double)iter->stats.solicit_acks_received/elapsed);
-		fprintf(logfp,"Leases/sec:                    %6.2f\n",
-			(double)iter->stats.completed/elapsed);
-
-		fprintf(logfp, "-----------------------------------------\n");
+		for (active = 0, server=servers; server != NULL; server=server->next)
+			active += server->active;
+		if (active == 0 && (stopping || (!soak_duration && started >= number_requests)))
+			break;
 	}
-	fprintf(logfp,"Return value: %d\n", retval);
-	return(retval);
 }
-
-int send_packet6(uint8_t type, dhcp_session_t *session, dhcp_server_t *server)
+/*
+    Next flow due to start a session: a rated flow whose slot has come,
+    else the weighted flow picked by smooth weighted round robin.  Returns
+    NULL if nothing is due, with pollto shortened to the next slot.  slot
+    is set to the intended start when the pick is rate driven, else zeroed.
+*/
+mix_flow_t *mix_pick(int *pollto, struct timeval *slot)
 {
-	uint8_t			buffer[1024]; /* Fix to DHCP_MTU */
-	struct dhcpv6_packet	*packet;
-	struct timeval		timestamp;
-	int			offset=0, i=0, j=0;
-	int			dhcp_msg_len;
-
-	//fprintf(logfp,"Entering send_packet6");
+	static struct timeval	t0;
+	static uint64_t		weighted;
+	struct timeval		now;
+	mix_flow_t		*best = NULL;
+	int64_t			offset, wait;
+	int32_t			total = 0;
+	int			f;
 
-	packet = (struct dhcpv6_packet *) buffer;
-	if (use_relay){  // Add relay header 
-		buffer[0] = DHCPV6_RELAY_FORW; //msg type
-		buffer[1] = 1; // Relay MSG Hops
-		memcpy(buffer + 2, &srcaddr, sizeof(struct in6_addr));
-		memcpy(buffer + 18, &session->ia[0].ipaddr, sizeof(struct in6_addr));
-		*((uint16_t *) (buffer + 34)) = htons(D6O_RELAY_MSG);
-		packet = (struct dhcpv6_packet *) ( buffer + 38);
+	gettimeofday(&now, NULL);
+	if (t0.tv_sec == 0)
+		t0 = now;
+	slot->tv_sec = slot->tv_usec = 0;
+	for (f = 0; f < nmix; f++){
+		if (mix[f].rate <= 0 || mix_spent(mix + f))
+			continue;
+		offset = (int64_t)(mix[f].started * 1000000.0 / mix[f].rate);
+		wait = offset - DELTATV64(now, t0);
+		if (wait <= 0){
+			offset += t0.tv_usec;
+			slot->tv_sec = t0.tv_sec + offset / 1000000;
+			slot->tv_usec = offset % 1000000;
+			return(mix + f);
+		}
+		if (wait / 1000 < *pollto)
+			*pollto = wait / 1000;
 	}
+	if (target_rate > 0 && !rate_slot(weighted, slot, pollto))
+		return(NULL);
+	for (f = 0; f < nmix; f++){
+		if (mix[f].rate > 0 || mix_spent(mix + f))
+			continue;
+		mix[f].current += mix[f].weight;
+		total += mix[f].weight;
+		if (best == NULL || mix[f].current > best->current)
+			best = mix + f;
+	}
+	if (best != NULL){
+		best->current -= total;
+		weighted++;
+	}
+	return(best);
+}
+/* A RELEASE or DECLINE flow is done once each lease in its slice has gone */
+int mix_spent(mix_flow_t *flow)
+{
+	return((flow->type == DHCPV6_RELEASE || flow->type == DHCPV6_DECLINE) &&
+		flow->used >= flow->nleases);
+}
+void mix_start(dhcp_session_t *session, mix_flow_t *flow, dhcp_server_t *server)
+{
+	lease_data_t	*lease = NULL;
 
-		
-	packet->msg_type = type;
-	for (j = 0; j < 3; j++)
-		packet->transaction_id[j] = session->mac[j+3];
-
-	if (opt_seq){
-		offset += add_opt_seq(type, packet->options, session);
+	if (flow->nleases){
+		if (flow->used++ % flow->nleases == 0)
+			flow->next = flow->first;
+		lease = flow->next;
+		flow->next = lease->next;
 	}
-	else {
-		/* CLIENT_ID option */
-		*((uint16_t *) (packet->options + offset)) = htons(D6O_CLIENTID);
-		offset += 2;
-		*((uint16_t *) (packet->options + offset)) = htons(DUID_LLT_LEN);
-		offset += 2;
-		*((uint16_t *) (packet->options + offset)) = htons(1);
-		offset += 2;
-		*((uint16_t *) (packet->options + offset)) = htons(1);
-		offset += 2;
-		memset(packet->options + offset, 0x88, 4);
-		offset += 4;
-		memcpy(packet->options + offset, session->mac, 6);
-		offset += 6;
-	
-		/* request Status Code from server */
-		*((uint16_t *) (packet->options + offset)) = htons(D6O_STATUS_CODE);
-		offset += 2;
-		*((uint16_t *) (packet->options + offset)) = htons(2);
-		offset += 2;
-		*((uint16_t *) (packet->options + offset)) = htons(STATUS_Success);
-		offset += 2;
-	
-		if (type != DHCPV6_INFORMATION_REQUEST)
-			offset += fill_iafu_mess(session, packet->options + offset);
-	
-        	if (type == DHCPV6_SOLICIT && rapid_commit){
-                	*((uint16_t *) (packet->options + offset)) = htons(D6O_RAPID_COMMIT);
-                	offset += 2;
-                	*((uint16_t *) (packet->options + offset)) = 0;
-                	offset += 2;
-        	}
-	
-		if (session->serverid[0] != 0xff){
-			*((uint16_t *) (packet->options + offset)) = htons(D6O_SERVERID);
-			offset += 2;
-			*((uint16_t *) (packet->options + offset)) =
-						htons(session->serverid_len);
-			offset += 2;
-			memcpy(packet->options + offset, session->serverid,
-				session->serverid_len);
-			offset += session->serverid_len;
-		}
-		if (session->hostname[0] != '\0')
-			offset += pack_client_fqdn(packet->options + offset, session->hostname);
-
-		/*  Ask for all -I options */
-		if (nrequests){
-			*((uint16_t *) (packet->options + offset)) = htons(D6O_ORO);
-			offset += 2;
-			*((uint16_t *) (packet->options + offset)) = htons(nrequests * sizeof(uint16_t));
-			offset += 2;
-			memcpy(packet->options + offset, info_requests, nrequests * sizeof(uint16_t));
-			offset += nrequests * sizeof(uint16_t);
-		}
-
-		/* append any user defined options */
-		if (nextraoptions) {
-			for (i = 0; i < nextraoptions; i++) {
-				*((uint16_t *) (packet->options + offset)) = htons(extraoptions[i]->option_no);
-				offset += 2;
-				*((uint16_t *) (packet->options + offset)) = htons(extraoptions[i]->data_len);
-				offset += 2;
-				memcpy(packet->options + offset, extraoptions[i]->data, extraoptions[i]->data_len);
-				offset += extraoptions[i]->data_len;
-			}
-		}
-	}
-
-	gettimeofday(&timestamp, NULL);
-	if (session->session_start == 0)
-		session->session_start = timestamp.tv_sec;
-
-	/* Set the relayed message option length for relay agents */
-	dhcp_msg_len = offset + 4 ;
-	// printf("\nDHCP packet size: %u\n", dhcp_msg_len);
-	if (use_relay){
-		*((uint16_t *) (buffer + 36)) =  htons(dhcp_msg_len);
-		dhcp_msg_len += 38;
-	}
-	/* send the packet */
-	if (sendto(sock, buffer, dhcp_msg_len, 0,
-	   (struct sockaddr *)&server->sa, sizeof(struct sockaddr_in6)) < 0 ){
-		fprintf(logfp,"sendto failed:\n");
-		return(-1);
+	fill_session(session, lease);
+	if (flow->type == DHCPV6_REBIND || flow->type == DHCPV6_CONFIRM){
+		session->serverid[0] = 0xff;
+		session->serverid_len = 0;
 	}
+	send_packet6(flow->type, session, server);
+}
+/* --mix type[:weight|@rate],... */
+int mix_parse(char *spec)
+{
+	char		*cp, *arg;
+	mix_flow_t	*flow;
 
-	if (verbose)
-		print_packet(use_relay ? dhcp_msg_len - 38 : dhcp_msg_len, packet, "Sent: ");
-
-	/* Update statistics */
-	server->last_packet_sent.tv_sec = timestamp.tv_sec;
-	server->last_packet_sent.tv_usec = timestamp.tv_usec;
-	session->last_sent.tv_sec = timestamp.tv_sec;
-	session->last_sent.tv_usec = timestamp.tv_usec;
-	session->type_last_sent = type;
-	if (server->first_packet_sent.tv_sec == 0){
-		server->first_packet_sent.tv_sec = timestamp.tv_sec;
-		server->first_packet_sent.tv_usec = timestamp.tv_usec;
+	for (cp = strtok(spec, ","); cp != NULL; cp = strtok(NULL, ",")){
+		if (nmix == MAX_MIX){
+			fprintf(stderr,"--mix: at most %d flows\n", MAX_MIX);
+			return(-1);
+		}
+		flow = mix + nmix;
+		flow->weight = 1;
+		if ((arg = strpbrk(cp, ":@")) != NULL){
+			if (*arg == '@')
+				flow->rate = atof(arg + 1);
+			else
+				flow->weight = atol(arg + 1);
+			*arg = '\0';
+		}
+		if ((flow->type = msg_type_by_name(cp)) < 0 ||
+				(arg != NULL && flow->rate <= 0 && flow->weight == 0)){
+			fprintf(stderr,"--mix: bad flow %s\n", cp);
+			return(-1);
+		}
+		nmix++;
 	}
+	return(nmix ? 0 : -1);
+}
+int msg_type_by_name(const char *name)
+{
+	if (!strcasecmp(name,"solicit"))
+		return(DHCPV6_SOLICIT);
+	else if (!strcasecmp(name,"request"))
+		return(DHCPV6_REQUEST);
+	else if (!strcasecmp(name,"confirm"))
+		return(DHCPV6_CONFIRM);
+	else if (!strcasecmp(name,"renew"))
+		return(DHCPV6_RENEW);
+	else if (!strcasecmp(name,"rebind"))
+		return(DHCPV6_REBIND);
+	else if (!strcasecmp(name,"release"))
+		return(DHCPV6_RELEASE);
+	else if (!strcasecmp(name,"decline"))
+		return(DHCPV6_DECLINE);
+	else if (!strcasecmp(name,"inform"))
+		return(DHCPV6_INFORMATION_REQUEST);
+	return(-1);
+}
+/* Random initial delay before the first message of an exchange, ms */
+uint32_t herd_delay(int type)
+{
+	if (type == DHCPV6_SOLICIT)
+		return(SOL_MAX_DELAY * (rand() / (RAND_MAX + 1.0)));
+	if (type == DHCPV6_CONFIRM)
+		return(CNF_MAX_DELAY * (rand() / (RAND_MAX + 1.0)));
+	return(0);
+}
+/*
+    A herd client has recovered once it holds a confirmed, rebound or new
+    lease.  A server that answers CONFIRM or REBIND negatively sends the
+    client back to SOLICIT, as RFC 8415 18.2.10.1 prescribes.
+*/
+void herd_session_done(dhcp_server_t *server, dhcp_session_t *session, int ok)
+{
+	lease_data_t	*client = session->client;
+	uint32_t	now = lc_now();
 
-	if (type == DHCPV6_SOLICIT) {
-		server->stats.solicits_sent++;
-		if (rapid_commit)
-			session->state |= RAPID_SOLICIT_SENT;
-		else
-			session->state |= SOLICIT_SENT;
-
+	if (ok && !(session->state & (SOLICIT_NAK|REQUEST_NAK|CONFIRM_NAK|REBIND_NAK))){
+		hist_add(&herd_recover, 1000LL * now);
+		return;
 	}
-	else if (type == DHCPV6_REQUEST){
-		server->stats.requests_sent++;
-		session->state |= REQUEST_SENT;
+	if (session->state & (CONFIRM_NAK|REBIND_NAK)){
+		herd_fallback++;
+		lc_schedule(client - clients, LC_ACQUIRE,
+			now + herd_delay(DHCPV6_SOLICIT));
+		return;
 	}
-	else if (type == DHCPV6_RENEW){
-		server->stats.renews_sent++;
-		session->state |= RENEW_SENT;
+	herd_lost++;
+}
+/*
+    Record the outcome of a lifecycle exchange and schedule the client's
+    next one.  T1/T2 of 0 leave the choice to the client (RFC 8415 18.2.4),
+    for which we use 0.5 and 0.8 of the preferred lifetime.
+*/
+void lc_session_done(dhcp_server_t *server, dhcp_session_t *session, int ok)
+{
+	lease_data_t	*client = session->client;
+	uint32_t	now = lc_now();
+	uint32_t	t1 = 0, t2 = 0, pref = 0, valid = 0;
+	int		i, n;
+
+	switch (session->type_last_sent){
+		case DHCPV6_SOLICIT:
+		case DHCPV6_REQUEST:
+			if (!ok || (session->state & (SOLICIT_NAK|REQUEST_NAK))){
+				lc_stats.acquire_failed++;
+				lc_schedule(client - clients, LC_ACQUIRE, now + timeout / 1000);
+				return;
+			}
+			lc_stats.acquired++;
+			lc_stats.bound++;
+			client->renewals = 0;
+		break;
+		case DHCPV6_RENEW:
+			if (!ok){
+				lc_stats.renew_failed++;
+				n = lc_after(client->bound_ms, client->t2);
+				lc_schedule(client - clients, LC_REBIND, n > now ? n : now);
+				return;
+			}
+			lc_stats.renewed++;
+			client->renewals++;
+		break;
+		case DHCPV6_REBIND:
+			if (!ok){
+				lc_stats.rebind_failed++;
+				n = lc_after(client->bound_ms, client->valid);
+				lc_schedule(client - clients, LC_EXPIRE, n > now ? n : now);
+				return;
+			}
+			lc_stats.rebound++;
+			client->renewals++;
+		break;
+		case DHCPV6_RELEASE:
+			lc_stats.released++;
+			lc_stats.bound--;
+			client->num_ia = 0;
+			client->renewals = 0;
+			lc_schedule(client - clients, LC_ACQUIRE, now);
+			return;
+		default:
+			return;
 	}
-	else if (type == DHCPV6_REBIND){
-		server->stats.rebinds_sent++;
-		session->state |= REBIND_SENT;
+
+	/* (Re)bound: keep what the server handed out */
+	save_lease(client, session, server);
+	for (i = 0; i < client->num_ia; i++){
+		if (client->ia[i].t1 && (t1 == 0 || client->ia[i].t1 < t1))
+			t1 = client->ia[i].t1;
+		if (client->ia[i].t2 && (t2 == 0 || client->ia[i].t2 < t2))
+			t2 = client->ia[i].t2;
+		if (client->ia[i].preferred && (pref == 0 || client->ia[i].preferred < pref))
+			pref = client->ia[i].preferred;
+		if (client->ia[i].valid && (valid == 0 || client->ia[i].valid < valid))
+			valid = client->ia[i].valid;
 	}
-	else if (type == DHCPV6_INFORMATION_REQUEST){
-		server->stats.informs_sent++;
-		session->state |= INFORM_SENT;
+	if (pref == 0)
+		pref = valid ? valid : 3600;
+	if (valid == 0)
+		valid = pref;
+	client->t1 = t1 ? t1 : pref / 2;
+	client->t2 = t2 ? t2 : pref * 4 / 5;
+	client->valid = valid;
+	client->bound_ms = now;
+
+	if (max_renewals && client->renewals >= max_renewals){
+		if (release_at_end)
+			lc_schedule(client - clients, LC_RELEASE, lc_after(now, client->t1));
+		else
+			lc_schedule(client - clients, LC_EXPIRE, lc_after(now, client->valid));
 	}
-	else if (type == DHCPV6_RELEASE){
-		server->stats.releases_sent++;
-		session->state |= RELEASE_SENT;
+	else
+		lc_schedule(client - clients, LC_RENEW, lc_after(now, client->t1));
+}
+/* Copy the binding a session ended with into a lease record */
+void save_lease(lease_data_t *lease, dhcp_session_t *session, dhcp_server_t *server)
+{
+	int	i;
+
+	lease->num_ia = session->recv_ia ? session->recv_ia : session->num_ia;
+	for (i = 0; i < lease->num_ia; i++)
+		lease->ia[i] = session->ia[i];
+	memcpy(lease->mac, session->mac, 6);
+	if (session->serverid_len){
+		memcpy(lease->serverid, session->serverid, session->serverid_len);
+		lease->serverid_len = session->serverid_len;
 	}
-	else if (type == DHCPV6_DECLINE){
-		server->stats.declines_sent++;
-		session->state |= DECLINE_SENT;
+	if (lease->hostname == NULL && session->hostname[0])
+		lease->hostname = strdup(session->hostname);
+	lease->server = server;
+	lease->sa = server->sa.sin6_addr;
+}
+/*
+    --scenario: run the phases of a scenario file back to back.  Leases won
+    by any phase join an in-memory population that later phases can renew,
+    release and so on without a round trip through -o/-f.  Each phase gets
+    its own report; the final report covers the whole run.
+*/
+void scenario_sender(void)
+{
+	lease_data_t		*leases = NULL, *lease, **filepop = NULL, **pop;
+	dhcp_session_t		*session;
+	dhcp_server_t		*server, *current_server = servers;
+	dhcp_stats_t		*totals;
+	struct timeval		*first, *last, now, phase_start, slot;
+	phase_t			*ph;
+	uint32_t		nfile = 0, npop, cursor, started, i, count, busy;
+	int			p, pollto, active, stopping;
+
+	if (input_file != NULL){
+		if ((nfile = read_lease_data(&leases)) == 0)
+			exit(1);
+		filepop = malloc(nfile * sizeof(lease_data_t *));
+		assert(filepop != NULL);
+		for (i = 0, lease = leases; lease != NULL; lease = lease->next)
+			filepop[i++] = lease;
 	}
-	else if (type == DHCPV6_CONFIRM){
-		server->stats.confirms_sent++;
-		session->state |= CONFIRM_SENT;
+	totals = calloc(num_servers, sizeof(dhcp_stats_t));
+	first = calloc(num_servers, sizeof(struct timeval));
+	last = calloc(num_servers, sizeof(struct timeval));
+	assert(totals != NULL && first != NULL && last != NULL);
+
+	for (p = 0; p < nphases; p++){
+		ph = phases + p;
+		if (ph->wait)
+			for (gettimeofday(&phase_start, NULL), now = phase_start;
+					DELTATV64(now, phase_start) < ph->wait * 1000000LL;
+					gettimeofday(&now, NULL))
+				reader(20);
+		pop = ph->population == POP_FILE ? filepop : population;
+		npop = ph->population == POP_FILE ? nfile :
+			ph->population == POP_ACQUIRED ? npopulation : 0;
+		count = ph->count;
+		if (count == 0 && ph->duration == 0)
+			count = ph->population == POP_NEW ? number_requests : npop;
+		fprintf(logfp,"\nPhase %d: %s (%s", p + 1, ph->name,
+			typestrings[ph->type - 1]);
+		if (count)
+			fprintf(logfp,", %u sessions", count);
+		if (ph->duration)
+			fprintf(logfp,", %u secs", ph->duration);
+		if (ph->rate > 0)
+			fprintf(logfp,", %.0f/sec", ph->rate);
+		fprintf(logfp,")\n");
+
+		window_rebase();
+		for (server=servers; server != NULL; server=server->next)
+			stats_reset(server);
+		target_rate = ph->rate;
+		session_window = ph->concurrency;
+		started = cursor = stopping = 0;
+		gettimeofday(&phase_start, NULL);
+		while (1){
+			gettimeofday(&now, NULL);
+			if ((count && started >= count) || (ph->duration &&
+					DELTATV64(now, phase_start) >= ph->duration * 1000000LL))
+				stopping = 1;
+			pollto = 20;
+			while (!stopping){
+				if (target_rate > 0 && !rate_slot(started, &slot, &pollto))
+					break;
+				lease = NULL;
+				if (ph->population != POP_NEW){
+					/* next lease that is still bound and not
+					   already in an exchange */
+					for (busy = 0, i = 0; i < npop; i++){
+						lease = pop[(cursor + i) % npop];
+						if (lease->num_ia && !lease->busy)
+							break;
+						busy += lease->busy;
+					}
+					if (i == npop){
+						stopping = busy == 0;
+						lease = NULL;
+						break;
+					}
+					lease = pop[(cursor + i) % npop];
+					cursor += i + 1;
+				}
+				server = lease && lease->server ? lease->server : current_server;
+				if ((session = find_free_session(server)) == NULL){
+					if (lease != NULL)
+						cursor -= 1;
+					break;
+				}
+				started++;
+				if (target_rate > 0)
+					session->intended_start = slot;
+				fill_session(session, lease);
+				session->client = lease;
+				if (lease != NULL)
+					lease->busy = 1;
+				if (lease != NULL && ph->type == DHCPV6_SOLICIT){
+					for (i = 0; i < session->num_ia; i++){
+						session->ia[i].ipaddr = in6addr_any;
+						session->ia[i].prefix_len = 0;
+					}
+				}
+				if (ph->type == DHCPV6_SOLICIT || ph->type == DHCPV6_REBIND ||
+						ph->type == DHCPV6_CONFIRM){
+					session->serverid[0] = 0xff;
+					session->serverid_len = 0;
+				}
+				send_packet6(ph->type, session, server);
+				current_server = current_server->next ? current_server->next : servers;
+				if (count && started >= count)
+					stopping = 1;
+			}
+			reader(pollto);
+			process_sessions();
+			if (stopping){
+				for (active = 0, server=servers; server != NULL; server=server->next)
+					active += server->active;
+				if (active == 0)
+					break;
+			}
+		}
+		test_statistics(0);
+		for (i = 0, server=servers; server != NULL; server=server->next, i++){
+			stats_add(totals + i, &server->stats);
+			if (first[i].tv_sec == 0)
+				first[i] = server->first_packet_sent;
+			if (server->last_packet_received.tv_sec)
+				last[i] = server->last_packet_received;
+		}
 	}
-	else {
-		fprintf(logfp, "send_packet6: Unknown packet %u", type);
+	target_rate = 0;
+	for (i = 0, server=servers; server != NULL; server=server->next, i++){
+		server->stats = totals[i];
+		server->first_packet_sent = first[i];
+		server->last_packet_received = last[i];
 	}
-
-
-	//fprintf(logfp,"Leaving send_packet6");
-	return(0);
+	for (i = 0, count = 0; i < npopulation; i++)
+		if (population[i]->num_ia)
+			count++;
+	fprintf(logfp,"\nScenario totals (%d phases, %u leases held)\n", nphases,
+		count);
+	free(totals);
+	free(first);
+	free(last);
 }
-int fill_iafu_mess(dhcp_session_t *session, uint8_t *option)
+/* Grow or shrink the scenario population as exchanges complete */
+void scn_session_done(dhcp_server_t *server, dhcp_session_t *session, int ok)
 {
-	uint32_t	offset =0;
-	int		idx, send_ia;
-	uint8_t		*option_start;
-
-	/* 
-	 * We have the ugly prospect of requesting multiple prefixes for
-	 * IA_PD or multiple addresses for IA_NA.
-
-	 * The number of IA options to send is either num_ia, is this if our first packet
-	 * or recv_ia which is the number of IA options received from server.
-	*/
-	send_ia = (session->recv_ia > 0) ? session->recv_ia :  session->num_ia;
-	for (idx=0; idx < send_ia; idx++){
-	   option_start = option + offset;
-	   if (request_prefix || session->ia[idx].prefix_len > 0) {
-		/* IA_PD */
-		*((uint16_t *) (option + offset)) = htons(D6O_IA_PD);
-		offset += 4;
-		*((uint32_t *) (option + offset)) =
-				htonl(session->ia[idx].iaid);
-		offset += 4;
-		memset(option + offset, 0, 8); /* T1 = 0, T2 = 0 */
-		offset += 8;
+	lease_data_t	*lease = session->client;
 
-		/* IA_PD_options: IAPREFIX */
-		*((uint16_t *) (option + offset)) = htons(D6O_IAPREFIX);
-		offset += 2;
+	if (lease != NULL)
+		lease->busy = 0;
+	if (!ok || (session->state & (SOLICIT_NAK|REQUEST_NAK|RENEW_NAK|REBIND_NAK|CONFIRM_NAK)))
+		return;
+	switch (session->type_last_sent){
+		case DHCPV6_SOLICIT:
+		case DHCPV6_REQUEST:
+			if (lease == NULL){
+				if ((npopulation & (npopulation - 1)) == 0){
+					population = realloc(population, (npopulation ? 2 * npopulation : 64)
+							* sizeof(lease_data_t *));
+					assert(population != NULL);
+				}
+				lease = calloc(1, sizeof(lease_data_t));
+				assert(lease != NULL);
+				population[npopulation++] = lease;
+			}
+			/* fall through */
+		case DHCPV6_RENEW:
+		case DHCPV6_REBIND:
+			save_lease(lease, session, server);
+		break;
+		case DHCPV6_RELEASE:
+		case DHCPV6_DECLINE:
+			if (lease != NULL)
+				lease->num_ia = 0;
+		break;
+	}
+}
+/*
+    Scenario file: one phase per line, '#' starts a comment.
 
-		/* 16 bytes: IPv6 prefix + 8 bytes: lease times + 1 byte: prefix-length */
-		*((uint16_t *) (option + offset)) = htons(25);
-		offset += 2;
+	phase <name> flow=<solicit|renew|...> [count=<n>] [duration=<secs>]
+		[rate=<n>] [concurrency=<n>] [population=new|acquired|file]
+		[wait=<secs>]
 
-		/* we accept any lease times */
-		memset(option + offset, 0, 8);
-		offset += 8;
+    population defaults to new clients for solicit and to the leases
+    acquired so far for every other flow.
+*/
+int scenario_parse(const char *file)
+{
+	FILE		*fp;
+	char		buf[1024], *tokes[MAX_TOKENS], *val, *cp;
+	int		ntokes, i, lineno = 0;
+	phase_t		*ph;
 
-		/* prefix-length */
-		*(option + offset) = session->ia[idx].prefix_len;
-		offset += 1;
+	if ((fp = fopen(file, "r")) == NULL){
+		fprintf(stderr,"Could not open scenario file: %s\n", file);
+		return(-1);
+	}
+	while (fgets(buf, sizeof(buf), fp) != NULL){
+		lineno++;
+		if ((cp = strchr(buf, '#')) != NULL)
+			*cp = '\0';
+		for (cp = buf; *cp == '\t'; cp++)
+			*cp = ' ';
+		if ((ntokes = get_tokens(buf, tokes, MAX_TOKENS)) == 0 || *tokes[0] == '\0')
+			continue;
+		if (strcasecmp(tokes[0], "phase") || ntokes < 3){
+			fprintf(stderr,"%s:%d: expected: phase <name> flow=<type> ...\n",
+				file, lineno);
+			goto bad;
+		}
+		if (nphases == MAX_PHASES){
+			fprintf(stderr,"%s:%d: at most %d phases\n", file, lineno, MAX_PHASES);
+			goto bad;
+		}
+		ph = phases + nphases;
+		memset(ph, 0, sizeof(phase_t));
+		snprintf(ph->name, sizeof(ph->name), "%s", tokes[1]);
+		for (i = 2; i < ntokes; i++){
+			if ((val = strchr(tokes[i], '=')) == NULL)
+				goto badkey;
+			*val++ = '\0';
+			if (!strcasecmp(tokes[i], "flow")){
+				if ((ph->type = msg_type_by_name(val)) < 0)
+					goto badkey;
+			}
+			else if (!strcasecmp(tokes[i], "count"))
+				ph->count = strcasecmp(val, "all") ? atol(val) : 0;
+			else if (!strcasecmp(tokes[i], "duration"))
+				ph->duration = atol(val);
+			else if (!strcasecmp(tokes[i], "rate"))
+				ph->rate = atof(val);
+			else if (!strcasecmp(tokes[i], "concurrency"))
+				ph->concurrency = atol(val);
+			else if (!strcasecmp(tokes[i], "wait"))
+				ph->wait = atol(val);
+			else if (!strcasecmp(tokes[i], "population")){
+				if (!strcasecmp(val, "new"))
+					ph->population = POP_NEW;
+				else if (!strcasecmp(val, "acquired"))
+					ph->population = POP_ACQUIRED;
+				else if (!strcasecmp(val, "file"))
+					ph->population = POP_FILE;
+				else
+					goto badkey;
+			}
+			else
+				goto badkey;
+		}
+		if (ph->type == 0){
+			fprintf(stderr,"%s:%d: phase %s has no flow=\n", file, lineno, ph->name);
+			goto bad;
+		}
+		if (ph->population == 0)
+			ph->population = ph->type == DHCPV6_SOLICIT ? POP_NEW : POP_ACQUIRED;
+		nphases++;
+	}
+	fclose(fp);
+	return(nphases ? 0 : -1);
+badkey:
+	fprintf(stderr,"%s:%d: bad setting: %s\n", file, lineno, tokes[i]);
+bad:
+	fclose(fp);
+	return(-1);
+}
+/*
+    --duration: clients are reused round robin from a population of -n, so
+    a soak grows neither our state nor the server's lease table.  Client c
+    gets the c'th MAC after -a, or a fixed scramble of c.
+*/
+uint32_t soak_client(uint8_t *mac)
+{
+	static uint32_t	next;
+	static uint64_t	seed;
+	uint32_t	c = next;
+	uint64_t	x;
+	int		i;
 
-		/* IP prefix */
-		memcpy(option + offset, &session->ia[idx].ipaddr, sizeof(struct in6_addr));
-		offset += sizeof(struct in6_addr);
+	next = (next + 1) % number_requests;
+	if (use_sequential_mac){
+		for (x = 0, i = 0; i < 6; i++)
+			x = x << 8 | firstmac[i];
+		x += c;
 	}
 	else {
-		/* IA_NA */
-		*((uint16_t *) (option + offset)) = htons(D6O_IA_NA);
-		offset += 4;
-		*((uint32_t *) (option + offset)) = 
-				htonl(session->ia[idx].iaid);
-		offset += 4;
-
-		memset(option + offset, 0, 8); /* T1 = 0, T2 = 0 */
-		offset += 8;
-
-		/* IA_NA_options: IAADDR */
-		*((uint16_t *) (option + offset)) = htons(D6O_IAADDR);
-		offset += 2;
-
-		/* IADDR option-len: 16 bytes: IPv6 + 8 bytes: lease times */
-		*((uint16_t *) (option + offset)) = htons(24);
-		offset += 2;
-
-		/* IP address */
-		memcpy(option + offset, &session->ia[idx].ipaddr, sizeof(struct in6_addr));
-		offset += sizeof(struct in6_addr);
-
-		/* we accept any lease times */
-		memset(option + offset, 0x80, 8);
-		offset += 8;
-	   }
-	   *((uint16_t *) (option_start + 2)) = 
-			htons(((option + offset) - option_start) - 4 );
+		if (seed == 0)
+			seed = (uint64_t) rand() << 32 | rand();
+		x = seed + (c + 1) * 0x9e3779b97f4a7c15ULL;
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+		x ^= x >> 31;
 	}
-	return(offset);
-
+	for (i = 5; i >= 0; i--, x >>= 8)
+		mac[i] = x;
+	return(c);
 }
-int  process_sessions(void)
+/*
+    --duration with -f: the file is read a line at a time and rewound at
+    EOF instead of being held in memory.  It must hold at least a window
+    of leases for every server, so no lease is in two sessions at once.
+*/
+lease_data_t *soak_next_lease(void)
 {
-	dhcp_session_t *session;
-	dhcp_server_t *server;
-	uint32_t sent=0, completed=0, failed=0;
-	struct timeval	now;
-	int		i,j;
+	static FILE		*fp;
+	static lease_data_t	lease;
+	static int		lineno;
+	static uint32_t		nread, rewound;
+	char			buf[1024];
+	int			eof = 0;
+
+	if (fp == NULL && (fp = fopen(input_file, "r")) == NULL){
+		fprintf(logfp,"Could not open input file: %s\n",input_file);
+		exit(1);
+	}
+	free(lease.hostname);
+	lease.hostname = NULL;
+	while (1){
+		if (fgets(buf, sizeof(buf), fp) == NULL){
+			if (eof++){
+				fprintf(logfp,"No usable leases in %s\n",input_file);
+				exit(1);
+			}
+			if (!rewound++ && nread < max_sessions * num_servers){
+				fprintf(logfp,"--duration: %s has %u leases, need at least %u (-q x servers)\n",
+					input_file, nread, max_sessions * num_servers);
+				exit(1);
+			}
+			rewind(fp);
+			lineno = 0;
+			continue;
+		}
+		if (parse_lease_line(buf, ++lineno, &lease)){
+			if (!rewound)
+				nread++;
+			return(&lease);
+		}
+	}
+}
+/*
+    With --rate, session n is meant to start at n/rate seconds into the run,
+    whether or not a free session slot exists by then.  Returns 1 once that
+    time has come, else shortens the reader poll to wake up for it.
+*/
+int rate_slot(uint64_t n, struct timeval *slot, int *pollto)
+{
+	static struct timeval	t0;
+	struct timeval		now;
+	int64_t			offset, wait;
 
 	gettimeofday(&now, NULL);
-	for (server=servers; server != NULL; server=server->next){
-	for (i = 0,j=0; j< server->active && i < max_sessions; i++){
-		session = server->list + i;
-		if (session->state == UNALLOCATED)
-			continue;
-		j++;
-		switch (session->state){
-			case SESSION_ALLOCATED:
-			break;
-			case PACKET_ERROR:
-				server->stats.errors++;
-				server->stats.failed++;
-				memset(session, '\0', sizeof(dhcp_session_t));
-				server->active--;
-			break;
-			case SESSION_ALLOCATED|SOLICIT_SENT:
-			case SESSION_ALLOCATED|RAPID_SOLICIT_SENT:
-				if ( DELTATV(now, session->last_sent) > timeout ){
-					server->stats.solicit_ack_timeouts++;
-					if (retransmit > session->timeouts || send_until_answered){
-						session->timeouts++;
-						send_packet6(DHCPV6_SOLICIT, session, server);
-					}
-					else {
-						server->stats.failed++;
-						memset(session, '\0', sizeof(dhcp_session_t));
-						server->active--;
-					}
-				}
-			break;
-			case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK:
-				if (dhcp_ping == 1){
-					server->stats.completed++;
-					memset(session, '\0', sizeof(dhcp_session_t));
-					server->active--;
-
-					continue;
-				}
-				session->timeouts = 0;
-				send_packet6(DHCPV6_REQUEST, session, server);
-			break;
-			case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_NAK:
-			case SESSION_ALLOCATED|RAPID_SOLICIT_SENT|SOLICIT_NAK:
-				server->stats.errors++;
-				server->stats.failed++;
-				memset(session, '\0', sizeof(dhcp_session_t));
-				server->active--;
-			break;
-			case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK|REQUEST_SENT:
-			case SESSION_ALLOCATED|REQUEST_SENT:
-				if ( DELTATV(now, session->last_sent) > timeout ){
-					server->stats.request_ack_timeouts++;
-					if (retransmit > session->timeouts || send_until_answered){
-						session->timeouts++;
-						send_packet6(DHCPV6_REQUEST, session, server);
-					}
-					else {
-						session->timeouts++;
-						server->stats.failed++;
-						memset(session, '\0', sizeof(dhcp_session_t));
-						server->active--;
-					}
-				}
-			break;
-			case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK|REQUEST_SENT|REQUEST_ACK:
-			case SESSION_ALLOCATED|RAPID_SOLICIT_SENT|SOLICIT_ACK:
-			case SESSION_ALLOCATED|REQUEST_SENT|REQUEST_ACK:
-			case SESSION_ALLOCATED|REQUEST_SENT|REQUEST_NAK:
-				if (send_release){
-					send_packet6(DHCPV6_RELEASE, session, server);
-				}
-				else if (send_decline){
-					send_packet6(DHCPV6_DECLINE, session, server);
-				}
-				else {
-					server->stats.completed++;
-					if (outfp)
-						print_lease(outfp, session, &server->sa.sin6_addr);
-					memset(session, '\0', sizeof(dhcp_session_t));
-					server->active--;
-				}
-			break;
-			case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK|REQUEST_SENT|REQUEST_NAK:
-				server->stats.failed++;
-				memset(session, '\0', sizeof(dhcp_session_t));
-				server->active--;
-			break;
-			case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK|REQUEST_SENT|REQUEST_ACK|DECLINE_SENT:
-				if ( DELTATV(now, session->last_sent) > timeout ){
-					server->stats.decline_ack_timeouts++;
-					if (retransmit > session->timeouts || send_until_answered){
-						session->timeouts++;
-						send_packet6(DHCPV6_DECLINE, session, server);
-					}
-					else {
-						server->stats.failed++;
-						memset(session, '\0', sizeof(dhcp_session_t));
-						server->active--;
-					}
-				}
-			break;
-			case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK|REQUEST_SENT|REQUEST_ACK|RELEASE_SENT:
-			case SESSION_ALLOCATED|RAPID_SOLICIT_SENT|SOLICIT_ACK|RELEASE_SENT:
-			case SESSION_ALLOCATED|RELEASE_SENT:
-				if ( DELTATV(now, session->last_sent) > timeout ){
-					server->stats.release_ack_timeouts++;
-					if (retransmit > session->timeouts || send_until_answered){
-						session->timeouts++;
-						send_packet6(DHCPV6_RELEASE, session, server);
-					}
-					else {
-						server->stats.failed++;
-						memset(session, '\0', sizeof(dhcp_session_t));
-						server->active--;
-					}
-				}
-			break;
-			case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK|REQUEST_SENT|REQUEST_ACK|DECLINE_SENT|DECLINE_ACK:
-			case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK|REQUEST_SENT|REQUEST_ACK|RELEASE_SENT|RELEASE_ACK:
-			case SESSION_ALLOCATED|RAPID_SOLICIT_SENT|SOLICIT_ACK|RELEASE_SENT|RELEASE_ACK:
-			case SESSION_ALLOCATED|RELEASE_SENT|RELEASE_ACK:
-				server->stats.completed++;
-				memset(session, '\0', sizeof(dhcp_session_t));
-				server->active--;
-			break;
-			case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK|REQUEST_SENT|REQUEST_ACK|RELEASE_SENT|RELEASE_NAK:
-			case SESSION_ALLOCATED|RAPID_SOLICIT_SENT|SOLICIT_ACK|RELEASE_SENT|RELEASE_NAK:
-			case SESSION_ALLOCATED|RELEASE_SENT|RELEASE_NAK:
-				server->stats.failed++;
-				memset(session, '\0', sizeof(dhcp_session_t));
-				server->active--;
-			break;
-			case SESSION_ALLOCATED|RENEW_SENT:
-				if ( DELTATV(now, session->last_sent) > timeout ){
-					server->stats.renew_ack_timeouts++;
-					if (retransmit > session->timeouts || send_until_answered){
-						session->timeouts++;
-						send_packet6(DHCPV6_RENEW, session, server);
-					}
-					else {
-						server->stats.failed++;
-						memset(session, '\0', sizeof(dhcp_session_t));
-						server->active--;
-					}
-				}
+	if (t0.tv_sec == 0 || n == 0)
+		t0 = now;
+	offset = t0.tv_usec + (int64_t)(n * 1000000.0 / target_rate);
+	slot->tv_sec = t0.tv_sec + offset / 1000000;
+	slot->tv_usec = offset % 1000000;
+	wait = DELTATV64((*slot), now);
+	if (wait > 0){
+		if (wait / 1000 < *pollto)
+			*pollto = wait / 1000;
+		return(0);
+	}
+	return(1);
+}
+void fill_session(dhcp_session_t *session, lease_data_t *lease)
+{
+	uint32_t	c = 0;
+	int		i;
 
-			break;
-			case SESSION_ALLOCATED|RENEW_SENT|RENEW_ACK:
-			case SESSION_ALLOCATED|RENEW_SENT|RENEW_NAK:
-				if (session->state & RENEW_ACK)
-					server->stats.completed++;
-				else
-					server->stats.failed++;
-				memset(session, '\0', sizeof(dhcp_session_t));
-				server->active--;
-			break;
-			case SESSION_ALLOCATED|INFORM_SENT:
-				if ( DELTATV(now, session->last_sent) > timeout ){
-					server->stats.inform_ack_timeouts++;
-					if (retransmit > session->timeouts || send_until_answered){
-						session->timeouts++;
-						send_packet6(DHCPV6_INFORMATION_REQUEST, session, server);
-					}
-					else {
-						server->stats.failed++;
-						memset(session, '\0', sizeof(dhcp_session_t));
-						server->active--;
-					}
-				}
-			break;
-			case SESSION_ALLOCATED|INFORM_SENT|INFORM_ACK:
-			case SESSION_ALLOCATED|INFORM_SENT|INFORM_NAK:
-				if (session->state & INFORM_ACK)
-					server->stats.completed++;
-				else
-					server->stats.failed++;
-				memset(session, '\0', sizeof(dhcp_session_t));
-				server->active--;
-			break;
-			case SESSION_ALLOCATED|CONFIRM_SENT:
-				if ( DELTATV(now, session->last_sent) > timeout ){
-					server->stats.confirm_ack_timeouts++;
-					if (retransmit > session->timeouts || send_until_answered){
-						session->timeouts++;
-						send_packet6(DHCPV6_CONFIRM, session, server);
-					}
-					else {
-						server->stats.failed++;
-						memset(session, '\0', sizeof(dhcp_session_t));
-						server->active--;
-					}
-				}
-			break;
-			case SESSION_ALLOCATED|CONFIRM_SENT|CONFIRM_ACK:
-			case SESSION_ALLOCATED|CONFIRM_SENT|CONFIRM_NAK:
-				if (session->state & CONFIRM_ACK)
-					server->stats.completed++;
-				else
-					server->stats.failed++;
-				memset(session, '\0', sizeof(dhcp_session_t));
-				server->active--;
-			break;
-			default:
-				server->stats.errors++;
-				server->stats.failed++;
-				fprintf(logfp,"PS: Undefined session state %u\n", session->state);
-				decode_state(session->state);
-				fprintf(logfp,"\tLast Sent: %u.%u Type: %u\n"
-					"\tLast Received: %u.%u Type: %u\n",
-					(uint32_t)session->last_sent.tv_sec,
-					(uint32_t)session->last_sent.tv_usec,
-					(uint32_t)session->type_last_sent,
-					(uint32_t)session->last_received.tv_sec,
-					(uint32_t)session->last_received.tv_usec,
-					(uint32_t)session->type_last_received);
-					memset(session, '\0', sizeof(dhcp_session_t));
-					server->active--;
+	if (lease != NULL){
+		session->num_ia = lease->num_ia;
+		for (i=0; i< lease->num_ia; i++){
+			session->ia[i].ipaddr = lease->ia[i].ipaddr;
+			session->ia[i].prefix_len = lease->ia[i].prefix_len;
+			session->ia[i].iaid = lease->ia[i].iaid;
 		}
-
-	}
-		if ( input_file != NULL){
-			sent += server->stats.requests_sent +
-				 server->stats.renews_sent +
-				 server->stats.declines_sent +
-				 server->stats.informs_sent +
-				 server->stats.rebinds_sent +
-				 server->stats.confirms_sent;
-			if (start_from == DHCPV6_RELEASE)
-				sent += server->stats.releases_sent;
+		memcpy(session->serverid, lease->serverid, lease->serverid_len);
+		session->serverid_len = lease->serverid_len;
+		memcpy(session->mac,lease->mac,6);
+		if (lease->hostname != NULL){
+			strncpy(session->hostname, lease->hostname, 
+				sizeof(session->hostname) - 1);
+			session->hostname[sizeof(session->hostname) - 1] = '\0';
 		}
 		else
-			sent += server->stats.solicits_sent;
+			*(session->hostname) = '\0';
 
-		completed += server->stats.completed;
-		failed    += server->stats.failed;
 	}
-	//fprintf(stderr, "Sent %u Completed %u Failed %u Requests: %u\n",
-		//sent, completed, failed, number_requests);
-	if ( sent >= number_requests){
-		if (send_until_answered && completed < number_requests){
-			return(0);
+	else {
+		if (soak_duration)
+			c = soak_client(session->mac);
+		else
+			getmac(session->mac);
+		session->num_ia = num_per_mac;
+		for (i=0; i < num_per_mac; i++){
+			session->ia[i].iaid = (soak_duration ? c + 1 : ++ia_id) * 1000 + i;
+			session->ia[i].ipaddr = in6addr_any;
+			session->ia[i].prefix_len = 0;
 		}
-		else if ( completed + failed >= number_requests){/* We are done */
-			return(1);
+		if (send_hostname) {
+			if (random_hostname)
+				snprintf(session->hostname, sizeof(session->hostname),
+					"h%u%u.%s", rand(), rand(),
+					update_domain ? update_domain : "");
+			else
+				snprintf(session->hostname,sizeof(session->hostname),
+					"h%02x%02x%02x%02x%02x%02x.%s",
+					session->mac[0], session->mac[1],
+					session->mac[2], session->mac[3], session->mac[4],
+				session->mac[5], update_domain ? update_domain : "");
+		}
+		else {
+			*(session->hostname) = '\0';
 		}
+		session->serverid[0] = 0xff;
+		session->serverid_len = 0;
 	}
-	return(0);
+	session->seq = ++session_seq;
+	session->fqdn_len = session->hostname[0] ?
+		pack_client_fqdn(session->fqdn, session->hostname) : 0;
+	return;
 }
-
-int process_packet(void *p, struct timeval *timestamp, uint32_t length)
+int test_statistics(int final)
 {
-	int		found=0;
-	dhcp_server_t	*server;
-	dhcp_session_t	*session=NULL;
-	dhcp_stats_t	*stats=NULL;
-	struct dhcpv6_packet *packet = (struct dhcpv6_packet *) p;
-	uint8_t 	*options = packet->options;
-	uint32_t	offset = 0;
-	uint32_t	dt;
-	uint16_t	otype, olen;
-	int		is_ack=1;
-	int		i;
+	dhcp_server_t	*iter;
+	double	elapsed;
+	int	retval = 0;
+	char	ipstr[INET6_ADDRSTRLEN];
+	uint64_t	retrans, txsent;
+	int	i;
 
-	// XXX Bad assumption that relay message is first option
-	if (use_relay == 1 && *((char *)p) == DHCPV6_RELAY_REPL){
-		length -= 38; //XXX  Assumes RELAY_REPLY is the only option!
-		packet = (struct dhcpv6_packet *) ((char *)p + 38);// Skip relay hdr
-		options = packet->options;
-	}
+	fprintf(logfp, "\nTest started:         %s\n",
+			ctime(&start_time));
+	for (iter=servers; iter != NULL; iter=iter->next){
+		inet_ntop(AF_INET6, &iter->sa.sin6_addr, ipstr, sizeof(ipstr));
+		fprintf(logfp,"Server %-s\n", ipstr);
+		if ( iter->stats.solicit_acks_received +
+			iter->stats.solicit_naks_received +
+			iter->stats.request_acks_received +
+			iter->stats.request_naks_received +
+			iter->stats.renew_acks_received +
+			iter->stats.renew_naks_received +
+			iter->stats.rebind_acks_received +
+			iter->stats.rebind_naks_received +
+			iter->stats.inform_acks_received +
+			iter->stats.inform_naks_received +
+			iter->stats.confirm_acks_received +
+			iter->stats.confirm_naks_received +
+			iter->stats.release_acks_received +
+			iter->stats.release_naks_received == 0){
+			fprintf(logfp,"\n\tNo replies received.\n");
+			retval = 1;
+			continue;
+		}
 
-	for (server=servers; server != NULL; server=server->next){
-		for (i=0; i < max_sessions; i++){
-			session = server->list + i;
-			if (!memcmp(session->mac + 3, packet->transaction_id, 3)){
-				found=1;
-				break;
-			}
+                if (iter->stats.failed + iter->stats.errors > 0 )
+			retval = 1;
+		fprintf(logfp,"Solicits sent:          %6" PRIu64 "\n",
+				iter->stats.solicits_sent);
+		fprintf(logfp,"Solicit Acks Received:  %6" PRIu64 "\n",
+				iter->stats.solicit_acks_received);
+		fprintf(logfp,"Solicit Naks Received:  %6" PRIu64 "\n",
+				iter->stats.solicit_naks_received);
+
+		fprintf(logfp,"Requests sent:          %6" PRIu64 "\n",
+					iter->stats.requests_sent);
+		fprintf(logfp,"Request Acks Received:  %6" PRIu64 "\n",
+					iter->stats.request_acks_received);
+		fprintf(logfp,"Request Naks received:  %6" PRIu64 "\n",
+					iter->stats.request_naks_received);
+		if (iter->stats.renews_sent){
+			fprintf(logfp,"Renew Acks Received:    %6" PRIu64 "\n",
+					iter->stats.renew_acks_received);
+			fprintf(logfp,"Renew Naks received:    %6" PRIu64 "\n",
+					iter->stats.renew_naks_received);
 		}
-		if (found == 1)
-			break;
-	}
-	// XXX  Set session->recv_ia to zero for now.  Hopefully these are returned in every reply
-	session->recv_ia = 0;
 
-	while ( offset < length - 4){
-		otype =  ntohs(*((uint16_t *)(options + offset)));
-		olen =  ntohs(*((uint16_t *)(options + offset + 2)));
-		if (otype == 0){
-			fprintf(logfp,"Error: Option is zero!\n");
-			break;
+		if (iter->stats.releases_sent){
+			fprintf(logfp,"Releases sent:          %6" PRIu64 "\n",iter->stats.releases_sent);
+			fprintf(logfp,"Release Acks Received:  %6" PRIu64 "\n",
+				iter->stats.release_acks_received);
+			fprintf(logfp,"Release Naks Received:  %6" PRIu64 "\n",
+				iter->stats.release_naks_received);
 		}
-		//printf("process_packet: Option %u found\n", otype);
-		if (otype == D6O_SERVERID){
-			session->serverid_len =
-				(olen < MAX_DUID_LEN) ? olen : MAX_DUID_LEN;
-			memcpy(session->serverid, options + offset +4,
-					session->serverid_len);
+		if (iter->stats.declines_sent){
+			fprintf(logfp,"Declines sent:          %6" PRIu64 "\n",iter->stats.declines_sent);
+			fprintf(logfp,"Decline Acks Received:  %6" PRIu64 "\n",
+				iter->stats.decline_acks_received);
+			fprintf(logfp,"Decline Naks Received:  %6" PRIu64 "\n",
+				iter->stats.decline_naks_received);
 		}
-		else if (otype == D6O_IA_NA || otype == D6O_IA_TA || otype == D6O_IA_PD){
-			unsigned char *suboptions = options + offset + 16;
-			int ia_offset = 0;
-			while (ia_offset + 12 < olen){
-				uint8_t sub_otype =  ntohs(*((uint16_t *)(suboptions + ia_offset)));
-				uint8_t sub_olen =   ntohs(*((uint16_t *)(suboptions + ia_offset + 2)));
-				if ( sub_otype == D6O_IAADDR){
-					memcpy(&session->ia[session->recv_ia].ipaddr, 
-						suboptions + ia_offset + 4, sizeof(struct in6_addr));
-					session->ia[session->recv_ia].prefix_len = 0;
-				}
-				else if (sub_otype == D6O_IAPREFIX){
-					session->ia[session->recv_ia].prefix_len =
-								*(suboptions + ia_offset + 12);
-					memcpy(&session->ia[session->recv_ia].ipaddr,
-						suboptions + ia_offset + 13, sizeof(struct in6_addr));
-				}
-				else if (sub_otype == D6O_STATUS_CODE){
-                        		if (ntohs(*((uint16_t *) (suboptions + ia_offset + 4))) != STATUS_Success)
-                                		is_ack=0;
-				}
-				ia_offset += (sub_olen + 4);
-			}
-			session->recv_ia++;
+		if (iter->stats.informs_sent){
+			fprintf(logfp,"Information Requests sent:      %6" PRIu64 "\n",
+					iter->stats.informs_sent);
+			fprintf(logfp,"Information Request Acks Received: %5" PRIu64 "\n",
+				iter->stats.inform_acks_received);
+			fprintf(logfp,"Information Request Naks Received: %5" PRIu64 "\n",
+				iter->stats.inform_naks_received);
 		}
-		else if (otype == D6O_STATUS_CODE){
-                        if (ntohs(*((uint16_t *) (options + offset + 4))) != STATUS_Success)
-                                is_ack=0;
-			//fprintf(logfp,"Status Option: %u", ntohs(*((uint16_t *) (options + offset + 4))));
+		if (iter->stats.rebinds_sent){
+			fprintf(logfp,"Rebinds sent:                   %6" PRIu64 "\n",
+					iter->stats.rebinds_sent);
+			fprintf(logfp,"Rebind Acks Received:  %6" PRIu64 "\n",
+				iter->stats.rebind_acks_received);
+		}
+		if (iter->stats.confirms_sent){
+			fprintf(logfp,"Confirms sent:                  %6" PRIu64 "\n",
+					iter->stats.confirms_sent);
+			fprintf(logfp,"Confirm Acks Received:            %6" PRIu64 "\n",
+				iter->stats.confirm_acks_received);
 		}
 
-			
+		fprintf(logfp,"Advertise timeouts:     %6" PRIu64 "\n",
+			iter->stats.solicit_ack_timeouts);
+		fprintf(logfp,"Request Timeouts:       %6" PRIu64 "\n",
+			iter->stats.request_ack_timeouts);
+		fprintf(logfp,"Renew Timeouts:         %6" PRIu64 "\n",
+			iter->stats.renew_ack_timeouts);
+		elapsed = DELTATV(iter->last_packet_received,
+					iter->first_packet_sent)/1000000.000;
 
-		offset += (4 + olen);
-	}
-		
-	if ( server == NULL || session == NULL)
-		return(-1);
+		fprintf(logfp,"Completed:              %6" PRIu64 "\n",iter->stats.completed);
+		fprintf(logfp,"Failed:                 %6" PRIu64 "\n",iter->stats.failed);
+		fprintf(logfp,"Errors:                 %6" PRIu64 "\n",iter->stats.errors);
+		if (adaptive)
+			fprintf(logfp,"Adaptive window:        %8.1f (%" PRIu64 " cuts)\n",
+				iter->cwnd, iter->aimd_cuts);
+		fprintf(logfp,"Elapsed time:         %15.2f secs\n", elapsed);
+		fprintf(logfp,"Advertise Latency (Min/Max/Avg): %.3f/%.3f/%.3f (ms)\n",
+		0.0010 * (double) iter->stats.advertise_latency_min,
+		0.0010 * (double)iter->stats.advertise_latency_max,
+		0.0010 * (double) iter->stats.advertise_latency_avg / (double)
+		(iter->stats.solicit_acks_received + iter->stats.solicit_naks_received ?
+		 	iter->stats.solicit_acks_received + iter->stats.solicit_naks_received : 1));
+		fprintf(logfp,"Reply Latency (Min/Max/Avg):     %.3f/%.3f/%.3f (ms)\n",
+		0.0010 * (double) iter->stats.reply_latency_min,
+		0.0010 * (double) iter->stats.reply_latency_max,
+		0.0010 * (double) iter->stats.reply_latency_avg / (double)
+		(iter->stats.request_acks_received ? iter->stats.request_acks_received : 1));
+		hist_print(logfp, "Advertise", &iter->stats.advertise_hist,
+			target_rate > 0 ? &iter->stats.advertise_hist_co : NULL);
+		hist_print(logfp, "Reply", &iter->stats.reply_hist,
+			target_rate > 0 ? &iter->stats.reply_hist_co : NULL);
+		hist_print(logfp, "Lease acquisition", &iter->stats.lease_hist,
+			target_rate > 0 ? &iter->stats.lease_hist_co : NULL);
+		hist_print(logfp, "Release", &iter->stats.release_hist, NULL);
+		status_report(&iter->stats);
+		fprintf(logfp,"Advertise Acks/sec:            %6.2f\n",
+			(double)iter->stats.solicit_acks_received/elapsed);
+		fprintf(logfp,"Leases/sec:                    %6.2f\n",
+			(double)iter->stats.completed/elapsed);
 
-	server->last_packet_received.tv_sec = timestamp->tv_sec;
-	server->last_packet_received.tv_usec = timestamp->tv_usec;
-	session->last_received.tv_sec = timestamp->tv_sec;
-	session->last_received.tv_usec = timestamp->tv_usec;
-	session->type_last_received = packet->msg_type;
-	stats = &server->stats;
+		fprintf(logfp, "-----------------------------------------\n");
+	}
+	if (nmix){
+		int	f;
+
+		fprintf(logfp,"%-20s %8s %9s %8s %8s %9s %9s\n", "Mix flow", "Started",
+			"Completed", "Failed", "Retrans", "p50 (ms)", "p99 (ms)");
+		for (f = 0; f < nmix; f++)
+			fprintf(logfp,"%-20s %8" PRIu64 " %9" PRIu64 " %8" PRIu64 " %8" PRIu64 " %9.3f %9.3f\n",
+				typestrings[mix[f].type - 1], mix[f].started,
+				mix[f].completed, mix[f].failed, mix[f].retransmits,
+				0.001 * hist_percentile(&mix[f].latency, 50.0),
+				0.001 * hist_percentile(&mix[f].latency, 99.0));
+		fprintf(logfp, "-----------------------------------------\n");
+	}
+	if (herd_window){
+		static const double	pct[] = { 50.0, 90.0, 99.0, 100.0 };
+		uint64_t		rank;
+		int			i;
+
+		fprintf(logfp,"Herd clients:           %6u (%s within %u ms)\n",
+			nclients, typestrings[herd_msg - 1], herd_window);
+		fprintf(logfp,"Recovered:              %6u\n",
+			(uint32_t) herd_recover.count);
+		fprintf(logfp,"Fell back to SOLICIT:   %6" PRIu64 "\n", herd_fallback);
+		fprintf(logfp,"Never recovered:        %6" PRIu64 "\n", herd_lost);
+		fprintf(logfp,"Time to recover (secs):\n");
+		for (i = 0; i < sizeof(pct)/sizeof(pct[0]); i++){
+			rank = (uint64_t)(pct[i] / 100.0 * nclients + 0.999999);
+			if (rank > herd_recover.count)
+				fprintf(logfp,"    %3g%% of clients      never\n", pct[i]);
+			else
+				fprintf(logfp,"    %3g%% of clients %10.3f\n", pct[i],
+					0.000001 * hist_at(&herd_recover, rank));
+		}
+		fprintf(logfp, "-----------------------------------------\n");
+	}
+	if (lifecycle){
+		fprintf(logfp,"Lifecycle clients:      %6u\n", nclients);
+		fprintf(logfp,"Acquired:               %6" PRIu64 " (failed %" PRIu64 ")\n",
+			lc_stats.acquired, lc_stats.acquire_failed);
+		fprintf(logfp,"Renewed:                %6" PRIu64 " (failed %" PRIu64 ")\n",
+			lc_stats.renewed, lc_stats.renew_failed);
+		fprintf(logfp,"Rebound:                %6" PRIu64 " (failed %" PRIu64 ")\n",
+			lc_stats.rebound, lc_stats.rebind_failed);
+		fprintf(logfp,"Released:               %6" PRIu64 "\n", lc_stats.released);
+		fprintf(logfp,"Expired:                %6" PRIu64 "\n", lc_stats.expired);
+		fprintf(logfp,"Bound at end:           %6" PRIu64 "\n", lc_stats.bound);
+		fprintf(logfp,"Renews+Rebinds/sec:            %6.2f\n",
+			(lc_stats.renewed + lc_stats.rebound) / (double) lifecycle);
+		fprintf(logfp, "-----------------------------------------\n");
+	}
+	for (i = 1, retrans = 0; i <= DHCPV6_INFORMATION_REQUEST; i++)
+		retrans += xmit_stats[i].transmissions - xmit_stats[i].exchanges;
+	if (rfc_retrans || retrans){
+		fprintf(logfp,"%-20s %9s %9s %9s %8s %8s\n", "Retransmission",
+			"Exchanges", "Sent", "Inflation", "Retried", "Gave up");
+		for (i = 1; i <= DHCPV6_INFORMATION_REQUEST; i++){
+			if (xmit_stats[i].exchanges == 0)
+				continue;
+			fprintf(logfp,"%-20s %9" PRIu64 " %9" PRIu64 " %9.3f %7.2f%% %8" PRIu64 "\n",
+				typestrings[i - 1], xmit_stats[i].exchanges,
+				xmit_stats[i].transmissions,
+				(double) xmit_stats[i].transmissions / xmit_stats[i].exchanges,
+				100.0 * xmit_stats[i].retried / xmit_stats[i].exchanges,
+				xmit_stats[i].gave_up);
+		}
+		fprintf(logfp, "-----------------------------------------\n");
+	}
+	if (tx_sched){
+		for (i = 0, txsent = 0; i < TX_CLASSES; i++)
+			txsent += tx_class[i].sent;
+		elapsed = time(NULL) - start_time;
+		if (elapsed < 1)
+			elapsed = 1;
+		fprintf(logfp,"%-20s %9s %8s %9s %9s\n", "Transmit class",
+			"Sent", "Share", "Sent/sec", "Budget");
+		for (i = 0; i < TX_CLASSES; i++){
+			fprintf(logfp,"%-20s %9" PRIu64 " %7.2f%% %9.1f ",
+				tx_class[i].name, tx_class[i].sent,
+				txsent ? 100.0 * tx_class[i].sent / txsent : 0,
+				tx_class[i].sent / elapsed);
+			if (tx_class[i].budget > 0)
+				fprintf(logfp,"%9.1f\n", tx_class[i].budget);
+			else
+				fprintf(logfp,"%9s\n", "-");
+		}
+		fprintf(logfp, "-----------------------------------------\n");
+	}
+	noise_print(logfp);
+	if (gso_calls){
+		fprintf(logfp,"GSO sends:              %6" PRIu64 " datagrams in %" PRIu64
+			" calls (%.1f per call)\n", gso_datagrams, gso_calls,
+			(double) gso_datagrams / gso_calls);
+		fprintf(logfp, "-----------------------------------------\n");
+	}
+	if (gro_reads){
+		fprintf(logfp,"GRO receives:           %6" PRIu64 " datagrams in %" PRIu64
+			" reads (%.1f per read)\n", gro_datagrams, gro_reads,
+			(double) gro_datagrams / gro_reads);
+		fprintf(logfp, "-----------------------------------------\n");
+	}
+	if (raw_ifname != NULL){
+		raw_report(logfp);
+		fprintf(logfp, "-----------------------------------------\n");
+	}
+	if (replies_malformed){
+		fprintf(logfp,"Malformed replies:      %6" PRIu64 "\n", replies_malformed);
+		fprintf(logfp, "-----------------------------------------\n");
+	}
+	late_report();
+	if (dims)
+		dim_report();
+	drops_report();
+	if (nwindows)
+		window_report();
+	/* SLOs and JSON cover the whole run, not each scenario phase */
+	if (final && slo_set)
+		retval |= slo_check();
+	fprintf(logfp,"Return value: %d\n", retval);
+	if (final && json_file != NULL)
+		json_report(retval);
+	return(retval);
+}
 
-	switch (packet->msg_type){
-		case DHCPV6_ADVERTISE:
-			if (is_ack) {
-				session->state |= SOLICIT_ACK;
-				stats->solicit_acks_received++;
-			}
-			else {
-				session->state |= SOLICIT_NAK;
-				stats->solicit_naks_received++;
-			}
+int send_packet6(uint8_t type, dhcp_session_t *session, dhcp_server_t *server)
+{
+	uint8_t			buffer[MAX_PACKET]; /* Fix to DHCP_MTU */
+	struct dhcpv6_packet	*packet;
+	struct timeval		timestamp;
+	int			offset=0, j=0;
+	int			dhcp_msg_len;
+	int64_t			elapsed;
+	int			tx, ret;
+	struct in6_addr		ll;
+	struct timeval		sent;
 
-			dt = DELTATV((*timestamp), session->last_sent);
-			stats->advertise_latency_avg += dt;
-			if ( dt < stats->advertise_latency_min )
-				stats->advertise_latency_min = dt;
-			if ( dt > stats->advertise_latency_max )
-				stats->advertise_latency_max = dt;
+	//fprintf(logfp,"Entering send_packet6");
 
-		break;
-		case DHCPV6_REPLY:
-			switch (session->state) {
-				case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK|REQUEST_SENT:
-				case SESSION_ALLOCATED|REQUEST_SENT:
-					if (is_ack){
-						session->state |= REQUEST_ACK;
-						stats->request_acks_received++;
-					}
-					else {
-						session->state |= REQUEST_NAK;
-						stats->request_naks_received++;
-					}
-				break;
-				case SESSION_ALLOCATED|RAPID_SOLICIT_SENT:
-					if (is_ack){
-						session->state |= SOLICIT_ACK;
-						stats->request_acks_received++;
-					}
-					else {
-						session->state |= SOLICIT_NAK;
-						stats->request_naks_received++;
-					}
-				break;
-				case SESSION_ALLOCATED|RENEW_SENT:
-					if (is_ack){
-						session->state |= RENEW_ACK;
-						stats->renew_acks_received++;
-					}
-					else {
-						session->state |= RENEW_NAK;
-						stats->renew_naks_received++;
-					}
-				break;
-				case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK|REQUEST_SENT|REQUEST_ACK|INFORM_SENT:
-				case SESSION_ALLOCATED|INFORM_SENT:
-					if (is_ack){
-						session->state |= INFORM_ACK;
-						stats->inform_acks_received++;
-					}
-					else {
-						session->state |= INFORM_NAK;
-						stats->inform_naks_received++;
-					}
-				break;
-				case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK|REQUEST_SENT|REQUEST_ACK|DECLINE_SENT:
-				case SESSION_ALLOCATED|DECLINE_SENT:
-					if (is_ack){
-						session->state |= DECLINE_ACK;
-						stats->decline_acks_received++;
-					}
-					else {
-						session->state |= DECLINE_NAK;
-						stats->decline_naks_received++;
-					}
-				break;
-				case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK|REQUEST_SENT|REQUEST_ACK|RELEASE_SENT:
-				case SESSION_ALLOCATED|RAPID_SOLICIT_SENT|SOLICIT_ACK|RELEASE_SENT:
-				case SESSION_ALLOCATED|RELEASE_SENT:
-					if (is_ack){
-						session->state |= RELEASE_ACK;
-						stats->release_acks_received++;
-					}
-					else {
-						session->state |= RELEASE_NAK;
-						stats->release_naks_received++;
-					}
-				break;
-				case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK|REQUEST_SENT|REQUEST_ACK|REBIND_SENT:
-				case SESSION_ALLOCATED|REBIND_SENT:
-					if (is_ack){
-						session->state |= REBIND_ACK;
-						stats->rebind_acks_received++;
-					}
-					else {
-						session->state |= REBIND_NAK;
-						stats->rebind_naks_received++;
-					}
-				break;
-				case SESSION_ALLOCATED|CONFIRM_SENT:
-					if (is_ack){
-						session->state |= CONFIRM_ACK;
-						stats->confirm_acks_received++;
-					}
-					else {
-						session->state |= CONFIRM_NAK;
-						stats->confirm_naks_received++;
-					}
-				break;
-				default:
-					fprintf(logfp, "PP: Unknown session state: %d\n", session->state);
-					decode_state(session->state);
-				break;
-			}
+	gettimeofday(&timestamp, NULL);
+	if (session->session_start == 0)
+		session->session_start = timestamp.tv_sec;
 
-			dt = DELTATV((*timestamp), session->last_sent);
-			stats->reply_latency_avg += dt;
-			if ( dt < stats->reply_latency_min )
-				stats->reply_latency_min = dt;
-			if ( dt > stats->reply_latency_max )
-				stats->reply_latency_max = dt;
+	/* A new exchange (not a retransmit) starts its corrected latency
+	   clock at the time it was meant to go out */
+	if (type != session->type_last_sent){
+		if (session->intended_start.tv_sec){
+			session->xchg_intended = session->intended_start;
+			session->intended_start.tv_sec = 0;
+			session->intended_start.tv_usec = 0;
+		}
+		else
+			session->xchg_intended = timestamp;
+		session->xchg_start = timestamp;
+		session->xchg_tx = 0;
+		if ((type == DHCPV6_SOLICIT || type == DHCPV6_REQUEST) &&
+				session->acquire_start.tv_sec == 0){
+			session->acquire_start = timestamp;
+			session->acquire_intended = session->xchg_intended;
+		}
+		else if (type == DHCPV6_RELEASE)
+			session->release_start = timestamp;
+		xmit_stats[type].exchanges++;
+		/* By message, not by whether the session is fresh: lifecycle
+		   and herd clients open with RENEW, REBIND or CONFIRM */
+		if (type == DHCPV6_SOLICIT || type == DHCPV6_INFORMATION_REQUEST ||
+				type == DHCPV6_CONFIRM)
+			tx = TX_NEW;
+		else if (type == DHCPV6_RELEASE)
+			tx = TX_RELEASE;
+		else
+			tx = TX_FOLLOWUP;
+	}
+	else {
+		if (session->xchg_tx == 1)
+			xmit_stats[type].retried++;
+		tx = TX_RETRANS;
+	}
+	tx_class[tx].sent++;
+	if (tx_class[tx].budget > 0)
+		tx_class[tx].credit--;
+	session->xchg_tx++;
+	xmit_stats[type].transmissions++;
+	elapsed = DELTATV64(timestamp, session->xchg_start) / 10000;
+	session->elapsed = elapsed > 0xffff ? 0xffff : elapsed;
+	if (rfc_retrans)
+		rt_next(session, type, &timestamp);
 
-			break;
-		default:
-			fprintf(logfp,"Unknown DHCP type: %d\n", packet->msg_type);
-			session->state = PACKET_ERROR;
-			return(-1);
+	packet = (struct dhcpv6_packet *) buffer;
+	if (use_relay){  // Add relay header 
+		buffer[0] = DHCPV6_RELAY_FORW; //msg type
+		buffer[1] = 1; // Relay MSG Hops
+		memcpy(buffer + 2, &srcaddr, sizeof(struct in6_addr));
+		memcpy(buffer + 18, &session->ia[0].ipaddr, sizeof(struct in6_addr));
+		*((uint16_t *) (buffer + 34)) = htons(D6O_RELAY_MSG);
+		packet = (struct dhcpv6_packet *) ( buffer + 38);
 	}
 
-	
-	/* remember last packet for next possible reuse */
-	//memcpy(session->last_packet, packet, length);
-	//session->last_packet_len = length;
+		
+	if (session->txid == 0)
+		txid_alloc(server, session);
+	packet->msg_type = type;
+	for (j = 0; j < 3; j++)
+		packet->transaction_id[j] = session->txid >> (16 - 8 * j);
 
-	if (verbose)
-		print_packet(length, packet, "Recv: ");
+	if (profiles[type].len)
+		offset += profile_run(profiles + type, packet->options, session);
+	else
+		offset += tmpl_fill(type, (uint8_t *) packet, session) - 4;
 
-	return(0);
-}
+	/* Set the relayed message option length for relay agents */
+	dhcp_msg_len = offset + 4 ;
+	// printf("\nDHCP packet size: %u\n", dhcp_msg_len);
+	if (use_relay){
+		*((uint16_t *) (buffer + 36)) =  htons(dhcp_msg_len);
+		dhcp_msg_len += 38;
+	}
+	/* send the packet */
+	if (raw_ifname != NULL){
+		if (use_relay)
+			ret = raw_send(raw_mac, &srcaddr, DHCP6_LOCAL_PORT,
+				&server->sa.sin6_addr, DHCP6_SERVER_PORT, buffer, dhcp_msg_len);
+		else {
+			raw_client_add(session->mac);
+			raw_linklocal(session->mac, &ll);
+			ret = raw_send(session->mac, &ll, DHCP6_LOCAL_PORT,
+				&server->sa.sin6_addr, DHCP6_SERVER_PORT, buffer, dhcp_msg_len);
+		}
+		if (ret < 0){
+			fprintf(logfp,"raw send failed\n");
+			return(-1);
+		}
+	}
+	else if (use_gso)
+		gso_add(server, session, buffer, dhcp_msg_len);
+	else if (sendto(sock, buffer, dhcp_msg_len, 0,
+	   (struct sockaddr *)&server->sa, sizeof(struct sockaddr_in6)) < 0 ){
+		fprintf(logfp,"sendto failed:\n");
+		return(-1);
+	}
+	/* --gso times the batch send in gso_flush() instead */
+	if (!use_gso){
+		gettimeofday(&sent, NULL);
+		hist_add(&noise_tx, DELTATV64(sent, timestamp));
+	}
 
-void parse_args(int argc, char **argv)
-{
-	char		ch;
-	int		i;
-	uint64_t	val;
-	int		temp[6];
-	char		*tokes[32];
+	if (verbose)
+		print_packet(use_relay ? dhcp_msg_len - 38 : dhcp_msg_len, packet, "Sent: ");
 
-	if ( argc < 3)
+	/* Update statistics */
+	server->last_packet_sent.tv_sec = timestamp.tv_sec;
+	server->last_packet_sent.tv_usec = timestamp.tv_usec;
+	session->prev_sent = session->last_sent;
+	session->last_sent.tv_sec = timestamp.tv_sec;
+	session->last_sent.tv_usec = timestamp.tv_usec;
+	session->type_last_sent = type;
+	if (server->first_packet_sent.tv_sec == 0){
+		server->first_packet_sent.tv_sec = timestamp.tv_sec;
+		server->first_packet_sent.tv_usec = timestamp.tv_usec;
+	}
+
+	if (type == DHCPV6_SOLICIT) {
+		server->stats.solicits_sent++;
+		if (rapid_commit)
+			session->state |= RAPID_SOLICIT_SENT;
+		else
+			session->state |= SOLICIT_SENT;
+
+	}
+	else if (type == DHCPV6_REQUEST){
+		server->stats.requests_sent++;
+		session->state |= REQUEST_SENT;
+	}
+	else if (type == DHCPV6_RENEW){
+		server->stats.renews_sent++;
+		session->state |= RENEW_SENT;
+	}
+	else if (type == DHCPV6_REBIND){
+		server->stats.rebinds_sent++;
+		session->state |= REBIND_SENT;
+	}
+	else if (type == DHCPV6_INFORMATION_REQUEST){
+		server->stats.informs_sent++;
+		session->state |= INFORM_SENT;
+	}
+	else if (type == DHCPV6_RELEASE){
+		server->stats.releases_sent++;
+		session->state |= RELEASE_SENT;
+	}
+	else if (type == DHCPV6_DECLINE){
+		server->stats.declines_sent++;
+		session->state |= DECLINE_SENT;
+	}
+	else if (type == DHCPV6_CONFIRM){
+		server->stats.confirms_sent++;
+		session->state |= CONFIRM_SENT;
+	}
+	else {
+		fprintf(logfp, "send_packet6: Unknown packet %u", type);
+	}
+
+
+	//fprintf(logfp,"Leaving send_packet6");
+	return(0);
+}
+int fill_iafu_mess(dhcp_session_t *session, uint8_t *option)
+{
+	uint32_t	offset =0;
+	int		idx, send_ia;
+	uint8_t		*option_start;
+
+	/* 
+	 * We have the ugly prospect of requesting multiple prefixes for
+	 * IA_PD or multiple addresses for IA_NA.
+
+	 * The number of IA options to send is either num_ia, is this if our first packet
+	 * or recv_ia which is the number of IA options received from server.
+	*/
+	send_ia = (session->recv_ia > 0) ? session->recv_ia :  session->num_ia;
+	for (idx=0; idx < send_ia; idx++){
+	   option_start = option + offset;
+	   if (request_prefix || session->ia[idx].prefix_len > 0) {
+		/* IA_PD */
+		*((uint16_t *) (option + offset)) = htons(D6O_IA_PD);
+		offset += 4;
+		*((uint32_t *) (option + offset)) =
+				htonl(session->ia[idx].iaid);
+		offset += 4;
+		memset(option + offset, 0, 8); /* T1 = 0, T2 = 0 */
+		offset += 8;
+
+		/* IA_PD_options: IAPREFIX */
+		*((uint16_t *) (option + offset)) = htons(D6O_IAPREFIX);
+		offset += 2;
+
+		/* 16 bytes: IPv6 prefix + 8 bytes: lease times + 1 byte: prefix-length */
+		*((uint16_t *) (option + offset)) = htons(25);
+		offset += 2;
+
+		/* we accept any lease times */
+		memset(option + offset, 0, 8);
+		offset += 8;
+
+		/* prefix-length */
+		*(option + offset) = session->ia[idx].prefix_len;
+		offset += 1;
+
+		/* IP prefix */
+		memcpy(option + offset, &session->ia[idx].ipaddr, sizeof(struct in6_addr));
+		offset += sizeof(struct in6_addr);
+	}
+	else {
+		/* IA_NA */
+		*((uint16_t *) (option + offset)) = htons(D6O_IA_NA);
+		offset += 4;
+		*((uint32_t *) (option + offset)) = 
+				htonl(session->ia[idx].iaid);
+		offset += 4;
+
+		memset(option + offset, 0, 8); /* T1 = 0, T2 = 0 */
+		offset += 8;
+
+		/* IA_NA_options: IAADDR */
+		*((uint16_t *) (option + offset)) = htons(D6O_IAADDR);
+		offset += 2;
+
+		/* IADDR option-len: 16 bytes: IPv6 + 8 bytes: lease times */
+		*((uint16_t *) (option + offset)) = htons(24);
+		offset += 2;
+
+		/* IP address */
+		memcpy(option + offset, &session->ia[idx].ipaddr, sizeof(struct in6_addr));
+		offset += sizeof(struct in6_addr);
+
+		/* we accept any lease times */
+		memset(option + offset, 0x80, 8);
+		offset += 8;
+	   }
+	   *((uint16_t *) (option_start + 2)) = 
+			htons(((option + offset) - option_start) - 4 );
+	}
+	return(offset);
+
+}
+static uint32_t txid_hash(uint32_t txid)
+{
+	return((txid * 0x9e3779b1U) >> 8 & (txid_size - 1));
+}
+txid_slot_t *txid_find(uint32_t txid)
+{
+	uint32_t	i;
+
+	if (txid_size == 0)
+		return(NULL);
+	for (i = txid_hash(txid); txid_live[i].txid; i = (i + 1) & (txid_size - 1))
+		if (txid_live[i].txid == txid)
+			return(txid_live + i);
+	return(NULL);
+}
+/* Rebuild the table, bigger if it is getting full, without the dead */
+static void txid_rehash(void)
+{
+	txid_slot_t	*old = txid_live;
+	uint32_t	i, j, n = txid_size;
+
+	txid_size = txid_size ? txid_size : 1024;
+	while (txid_used * 4 >= txid_size)
+		txid_size *= 2;
+	txid_live = calloc(txid_size, sizeof(txid_slot_t));
+	if (txid_live == NULL){
+		perror("txid table");
+		exit(1);
+	}
+	for (i = 0; i < n; i++){
+		if (old[i].txid == 0 || old[i].txid == TXID_DEAD)
+			continue;
+		for (j = txid_hash(old[i].txid); txid_live[j].txid; j = (j + 1) & (txid_size - 1))
+			;
+		txid_live[j] = old[i];
+	}
+	txid_dead = 0;
+	free(old);
+}
+/* Give the session a txid no outstanding exchange is using */
+void txid_alloc(dhcp_server_t *server, dhcp_session_t *session)
+{
+	uint32_t	i;
+
+	if ((txid_used + txid_dead + 1) * 2 > txid_size)
+		txid_rehash();
+	do
+		txid_next = (txid_next + 1) & TXID_MASK;
+	while (txid_next == 0 || txid_find(txid_next) != NULL);
+	for (i = txid_hash(txid_next); txid_live[i].txid && txid_live[i].txid != TXID_DEAD;
+			i = (i + 1) & (txid_size - 1))
+		;
+	if (txid_live[i].txid == TXID_DEAD)
+		txid_dead--;
+	txid_live[i].txid = txid_next;
+	txid_live[i].session = session;
+	txid_live[i].server = server;
+	txid_used++;
+	session->txid = txid_next;
+}
+/*
+    The session's exchange is over: answered by a reply stamped at when,
+    or abandoned now.  Later replies to its txid are stale.
+*/
+void txid_retire(dhcp_session_t *session, int answered, struct timeval *when)
+{
+	txid_slot_t	*slot;
+	txid_retired_t	*r;
+
+	if (session->txid == 0 || (slot = txid_find(session->txid)) == NULL)
+		return;
+	slot->txid = TXID_DEAD;
+	txid_used--;
+	txid_dead++;
+	r = txid_retired + session->txid % TXID_RETIRED;
+	r->txid = session->txid;
+	r->type = session->type_last_sent;
+	r->answered = answered;
+	r->sent = session->last_sent;
+	if (when != NULL)
+		r->when = *when;
+	else
+		gettimeofday(&r->when, NULL);
+	session->txid = 0;
+}
+/*
+    Count the reply's status codes against the message it answers, so
+    that pool exhaustion (NoAddrsAvail, NoPrefixAvail) and lost bindings
+    (NoBinding) show up apart.
+*/
+void status_count(dhcp_stats_t *stats, int type, reply_t *r)
+{
+	int	i, s;
+
+	if (type > DHCPV6_INFORMATION_REQUEST)
+		return;
+	s = r->status < STATUS_KINDS - 1 ? r->status : STATUS_KINDS - 1;
+	stats->status[type][STATUS_TOP][s]++;
+	window_status[s]++;
+	for (i = 0; i < r->nia; i++){
+		s = r->ia[i].status < STATUS_KINDS - 1 ? r->ia[i].status : STATUS_KINDS - 1;
+		stats->status[type][STATUS_IA][s]++;
+		window_status[s]++;
+	}
+}
+void status_report(dhcp_stats_t *stats)
+{
+	int	t, s, header = 0;
+
+	for (t = 1; t <= DHCPV6_INFORMATION_REQUEST; t++)
+		for (s = 0; s < STATUS_KINDS; s++){
+			if (stats->status[t][STATUS_TOP][s] + stats->status[t][STATUS_IA][s] == 0)
+				continue;
+			if (!header++)
+				fprintf(logfp,"%-20s %-14s %9s %9s\n", "Status codes",
+					"", "Top level", "Per IA");
+			fprintf(logfp,"    %-16s %-14s %9" PRIu64 " %9" PRIu64 "\n",
+				typestrings[t - 1], statusstrings[s],
+				stats->status[t][STATUS_TOP][s], stats->status[t][STATUS_IA][s]);
+		}
+}
+/*
+    --breakdown row for the session's current exchange.  Dimensions not
+    asked for stay 0 in the key: server number in bits 0-7, message type
+    8-11, IA count 12-16, IA_PD 17, relayed 18, FQDN 19, flow 20-23.
+*/
+dim_row_t *dim_row(dhcp_server_t *server, dhcp_session_t *session)
+{
+	dhcp_server_t	*s;
+	uint32_t	key = 0, i;
+
+	if (dims & DIM_SERVER){
+		for (s = servers, i = 0; s != server; s = s->next)
+			i++;
+		key |= i & 0xff;
+	}
+	if (dims & DIM_MSG)
+		key |= (session->type_last_sent & 0xf) << 8;
+	if (dims & DIM_IA)
+		key |= (session->num_ia & 0x1f) << 12;
+	if ((dims & DIM_IATYPE) && (request_prefix || session->ia[0].prefix_len))
+		key |= 1 << 17;
+	if ((dims & DIM_RELAY) && use_relay)
+		key |= 1 << 18;
+	if ((dims & DIM_FQDN) && session->fqdn_len)
+		key |= 1 << 19;
+	if (dims & DIM_FLOW)
+		key |= (session->flow & 0xf) << 20;
+
+	for (i = 0; i < ndim_rows; i++)
+		if (dim_rows[i].key == key)
+			return(dim_rows + i);
+	if (ndim_rows == MAX_DIM_KEYS)
+		return(dim_rows + MAX_DIM_KEYS);
+	dim_rows[ndim_rows].key = key;
+	return(dim_rows + ndim_rows++);
+}
+void dim_label(dim_row_t *row, char *label, size_t size)
+{
+	dhcp_server_t	*s;
+	char		ipstr[INET6_ADDRSTRLEN];
+	uint32_t	n;
+	int		i, len = 0;
+
+	label[0] = '\0';
+	if (row == dim_rows + MAX_DIM_KEYS){
+		snprintf(label, size, "other");
+		return;
+	}
+	if (dims & DIM_SERVER){
+		for (s = servers, n = row->key & 0xff; n && s->next; n--)
+			s = s->next;
+		inet_ntop(AF_INET6, &s->sa.sin6_addr, ipstr, sizeof(ipstr));
+		len += snprintf(label + len, size - len, "%s ", ipstr);
+	}
+	if ((dims & DIM_MSG) && (row->key >> 8 & 0xf))
+		len += snprintf(label + len, size - len, "%s ",
+			typestrings[(row->key >> 8 & 0xf) - 1]);
+	if (dims & DIM_IA)
+		len += snprintf(label + len, size - len, "ia=%u ", row->key >> 12 & 0x1f);
+	if (dims & DIM_IATYPE)
+		len += snprintf(label + len, size - len, "%s ",
+			row->key & 1 << 17 ? "IA_PD" : "IA_NA");
+	if (dims & DIM_RELAY)
+		len += snprintf(label + len, size - len, "%s ",
+			row->key & 1 << 18 ? "relayed" : "direct");
+	if (dims & DIM_FQDN)
+		len += snprintf(label + len, size - len, "%s ",
+			row->key & 1 << 19 ? "fqdn" : "no-fqdn");
+	if ((dims & DIM_FLOW) && (n = row->key >> 20 & 0xf) == 0)
+		len += snprintf(label + len, size - len, "flow=none ");
+	else if (dims & DIM_FLOW){
+		/* a type given twice in --mix is told apart by its position */
+		for (i = 0; i < nmix; i++)
+			if (i != n - 1 && mix[i].type == mix[n - 1].type)
+				break;
+		len += snprintf(label + len, size - len, i < nmix ? "flow=%s#%u " : "flow=%s ",
+			typestrings[mix[n - 1].type - 1], n);
+	}
+	if (len > 0)
+		label[len - 1] = '\0';
+}
+void dim_report(void)
+{
+	dim_row_t	*row;
+	char		label[128];
+	uint32_t	i;
+
+	fprintf(logfp,"%-40s %8s %6s %9s %9s %9s %8s %8s\n", "Breakdown",
+		"Replies", "NAK%", "p50 ms", "p99 ms", "max ms", "Done", "Failed");
+	for (i = 0; i <= ndim_rows; i++){
+		row = dim_rows + (i < ndim_rows ? i : MAX_DIM_KEYS);
+		if (i == ndim_rows && row->replies + row->completed + row->failed == 0)
+			break;
+		dim_label(row, label, sizeof(label));
+		fprintf(logfp,"%-40s %8" PRIu64 " %6.2f %9.3f %9.3f %9.3f %8" PRIu64 " %8" PRIu64 "\n",
+			label, row->replies, row->replies ? 100.0 * row->naks / row->replies : 0,
+			0.001 * hist_percentile(&row->latency, 50),
+			0.001 * hist_percentile(&row->latency, 99),
+			0.001 * row->latency.max, row->completed, row->failed);
+	}
+	fprintf(logfp, "-----------------------------------------\n");
+}
+/*
+    --json: the final report as one JSON object.  Latencies are usecs;
+    histograms carry their non-empty buckets as [lowest usec, count].
+*/
+void json_str(FILE *fp, const char *s)
+{
+	fputc('"', fp);
+	for (; s != NULL && *s; s++){
+		if (*s == '"' || *s == '\\')
+			fprintf(fp, "\\%c", *s);
+		else if ((unsigned char) *s < 0x20)
+			fprintf(fp, "\\u%04x", *s);
+		else
+			fputc(*s, fp);
+	}
+	fputc('"', fp);
+}
+void json_hist(FILE *fp, const char *name, lat_hist_t *h)
+{
+	static const double	pct[] = { 50.0, 90.0, 99.0, 99.9, 99.99 };
+	uint32_t		i, n = 0;
+
+	fprintf(fp, "\"%s\": {\"count\": %" PRIu64 ", \"min\": %" PRIu64
+		", \"max\": %" PRIu64 ", \"mean\": %.1f", name, h->count, h->min,
+		h->max, h->count ? (double) h->sum / h->count : 0.0);
+	for (i = 0; i < sizeof(pct)/sizeof(pct[0]); i++)
+		fprintf(fp, ", \"p%g\": %" PRIu64, pct[i], hist_percentile(h, pct[i]));
+	fprintf(fp, ", \"buckets\": [");
+	for (i = 0; i < HIST_BUCKETS; i++)
+		if (h->bucket[i])
+			fprintf(fp, "%s[%" PRIu64 ", %" PRIu64 "]", n++ ? ", " : "",
+				hist_lo(i), h->bucket[i]);
+	fprintf(fp, "]}");
+}
+void json_report(int retval)
+{
+	FILE		*fp;
+	dhcp_server_t	*server;
+	dhcp_stats_t	*st;
+	window_t	*w;
+	drops_t		d;
+	dim_row_t	*row;
+	char		ipstr[INET6_ADDRSTRLEN], label[128], when[32];
+	time_t		end = time(NULL);
+	uint64_t	*a, i, first;
+	int		t, s, n;
+
+	if (!strcmp(json_file, "-"))
+		fp = stdout;
+	else if ((fp = fopen(json_file, "w")) == NULL){
+		fprintf(logfp, "Open %s failed\n", json_file);
+		return;
+	}
+	fprintf(fp, "{\n\"version\": ");
+	json_str(fp, version);
+	fprintf(fp, ",\n\"command\": [");
+	for (n = 0; n < cmd_argc; n++){
+		fprintf(fp, n ? ", " : "");
+		json_str(fp, cmd_argv[n]);
+	}
+	fprintf(fp, "],\n\"config\": {\"servers\": %u, \"sessions\": %u, "
+		"\"requests\": %u, \"timeout_us\": %u, \"retransmit\": %d, "
+		"\"rate\": %g, \"relay\": %s, \"prefix\": %s, \"rapid_commit\": %s, "
+		"\"per_mac\": %u, \"lifecycle\": %u, \"soak\": %u, \"interval\": %u, "
+		"\"adaptive\": %u, \"rfc_retrans\": %s, \"raw\": ",
+		num_servers, max_sessions, number_requests, timeout, retransmit,
+		target_rate, use_relay ? "true" : "false",
+		request_prefix ? "true" : "false", rapid_commit ? "true" : "false",
+		num_per_mac, lifecycle, soak_duration, stat_interval, adaptive,
+		rfc_retrans ? "true" : "false");
+	if (raw_ifname != NULL)
+		json_str(fp, raw_ifname);
+	else
+		fprintf(fp, "null");
+	fprintf(fp, ", \"xdp\": %d, \"gso\": %s, \"gro\": %s, \"busy_poll\": %d},\n",
+		raw_mode, use_gso ? "true" : "false", use_gro ? "true" : "false",
+		busy_poll);
+	strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%SZ", gmtime(&start_time));
+	fprintf(fp, "\"start\": \"%s\", \"start_epoch\": %ld, ", when, (long) start_time);
+	strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%SZ", gmtime(&end));
+	fprintf(fp, "\"end\": \"%s\", \"end_epoch\": %ld, \"return\": %d,\n",
+		when, (long) end, retval);
+
+	fprintf(fp, "\"servers\": [");
+	for (server = servers; server != NULL; server = server->next){
+		st = &server->stats;
+		inet_ntop(AF_INET6, &server->sa.sin6_addr, ipstr, sizeof(ipstr));
+		fprintf(fp, "%s\n {\"address\": \"%s\", \"window\": %.1f, \"counters\": {",
+			server == servers ? "" : ",", ipstr, server->cwnd);
+		for (a = &st->solicits_sent, n = 0; a <= &st->completed; a++, n++)
+			fprintf(fp, "%s\"%s\": %" PRIu64, n ? ", " : "", statnames[n], *a);
+		fprintf(fp, "},\n  \"latency\": {");
+		json_hist(fp, "advertise", &st->advertise_hist);
+		fprintf(fp, ",\n   ");
+		json_hist(fp, "advertise_corrected", &st->advertise_hist_co);
+		fprintf(fp, ",\n   ");
+		json_hist(fp, "reply", &st->reply_hist);
+		fprintf(fp, ",\n   ");
+		json_hist(fp, "reply_corrected", &st->reply_hist_co);
+		fprintf(fp, ",\n   ");
+		json_hist(fp, "lease", &st->lease_hist);
+		fprintf(fp, ",\n   ");
+		json_hist(fp, "lease_corrected", &st->lease_hist_co);
+		fprintf(fp, ",\n   ");
+		json_hist(fp, "release", &st->release_hist);
+		fprintf(fp, "},\n  \"status\": {");
+		for (t = 1, n = 0; t <= DHCPV6_INFORMATION_REQUEST; t++){
+			for (s = 0, i = 0; s < STATUS_KINDS; s++)
+				i += st->status[t][STATUS_TOP][s] + st->status[t][STATUS_IA][s];
+			if (i == 0)
+				continue;
+			fprintf(fp, "%s\"%s\": {", n++ ? ", " : "", typestrings[t - 1]);
+			for (s = 0; s < STATUS_KINDS; s++)
+				fprintf(fp, "%s\"%s\": [%" PRIu64 ", %" PRIu64 "]", s ? ", " : "",
+					statusstrings[s], st->status[t][STATUS_TOP][s],
+					st->status[t][STATUS_IA][s]);
+			fprintf(fp, "}");
+		}
+		fprintf(fp, "}}");
+	}
+	fprintf(fp, "],\n\"retransmission\": {");
+	for (t = 1, n = 0; t <= DHCPV6_INFORMATION_REQUEST; t++){
+		if (xmit_stats[t].exchanges == 0)
+			continue;
+		fprintf(fp, "%s\"%s\": {\"exchanges\": %" PRIu64 ", \"sent\": %" PRIu64
+			", \"retried\": %" PRIu64 ", \"gave_up\": %" PRIu64 "}",
+			n++ ? ", " : "", typestrings[t - 1], xmit_stats[t].exchanges,
+			xmit_stats[t].transmissions, xmit_stats[t].retried,
+			xmit_stats[t].gave_up);
+	}
+	fprintf(fp, "},\n\"tx_classes\": {");
+	for (n = 0; n < TX_CLASSES; n++)
+		fprintf(fp, "%s\"%s\": {\"sent\": %" PRIu64 ", \"budget\": %g}",
+			n ? ", " : "", tx_class[n].name, tx_class[n].sent, tx_class[n].budget);
+	fprintf(fp, "},\n");
+	if (lifecycle)
+		fprintf(fp, "\"lifecycle\": {\"acquired\": %" PRIu64 ", \"acquire_failed\": %"
+			PRIu64 ", \"renewed\": %" PRIu64 ", \"renew_failed\": %" PRIu64
+			", \"rebound\": %" PRIu64 ", \"rebind_failed\": %" PRIu64
+			", \"released\": %" PRIu64 ", \"expired\": %" PRIu64
+			", \"bound\": %" PRIu64 "},\n", lc_stats.acquired,
+			lc_stats.acquire_failed, lc_stats.renewed, lc_stats.renew_failed,
+			lc_stats.rebound, lc_stats.rebind_failed, lc_stats.released,
+			lc_stats.expired, lc_stats.bound);
+	if (nmix){
+		fprintf(fp, "\"mix\": [");
+		for (n = 0; n < nmix; n++){
+			fprintf(fp, "%s\n {\"type\": \"%s\", \"weight\": %u, \"started\": %"
+				PRIu64 ", \"completed\": %" PRIu64 ", \"failed\": %" PRIu64
+				", \"retransmits\": %" PRIu64 ", ", n ? "," : "",
+				typestrings[mix[n].type - 1], mix[n].weight, mix[n].started,
+				mix[n].completed, mix[n].failed, mix[n].retransmits);
+			json_hist(fp, "latency", &mix[n].latency);
+			fprintf(fp, "}");
+		}
+		fprintf(fp, "],\n");
+	}
+	fprintf(fp, "\"replies\": {\"malformed\": %" PRIu64 ", \"duplicate\": %" PRIu64
+		", \"late\": %" PRIu64 ", \"unmatched\": %" PRIu64
+		", \"after_retransmit\": %" PRIu64 ", \"before_retransmit\": %" PRIu64 ",\n  ",
+		replies_malformed, replies_duplicate, replies_late, replies_unmatched,
+		replies_retransmitted, replies_crossed);
+	json_hist(fp, "late_by", &late_by);
+	fprintf(fp, ",\n  ");
+	json_hist(fp, "late_latency", &late_latency);
+	local_drops(&d);
+	for (server = servers, i = 0; server != NULL; server = server->next)
+		i += stats_timeouts(&server->stats);
+	fprintf(fp, "},\n\"drops\": {\"receive\": %" PRIu64 ", \"udp6_rcvbuf_errors\": %"
+		PRIu64 ", \"udp6_sndbuf_errors\": %" PRIu64 ", \"timeouts\": %" PRIu64
+		", \"generator\": %" PRIu64 "},\n", d.rxq - drops_base.rxq,
+		d.rcvbuf - drops_base.rcvbuf, d.sndbuf - drops_base.sndbuf, i,
+		drops_lost(&d) < i ? drops_lost(&d) : i);
+	fprintf(fp, "\"noise\": {");
+	json_hist(fp, gso_calls ? "send_batch" : "send", &noise_tx);
+	fprintf(fp, ",\n  ");
+	json_hist(fp, "receive", &noise_rx);
+	fprintf(fp, ",\n  ");
+	json_hist(fp, "spin", &noise_gap);
+	fprintf(fp, "},\n\"offload\": {\"gso_calls\": %" PRIu64 ", \"gso_datagrams\": %"
+		PRIu64 ", \"gro_reads\": %" PRIu64 ", \"gro_datagrams\": %" PRIu64 "},\n",
+		gso_calls, gso_datagrams, gro_reads, gro_datagrams);
+	if (raw_ifname != NULL)
+		fprintf(fp, "\"raw\": {\"tx_frames\": %" PRIu64 ", \"tx_stalls\": %" PRIu64
+			", \"rx_frames\": %" PRIu64 ", \"rx_drops\": %" PRIu64
+			", \"ns_received\": %" PRIu64 ", \"ns_multicast\": %" PRIu64
+			", \"ns_unknown\": %" PRIu64 ", \"na_sent\": %" PRIu64
+			", \"nd_other\": %" PRIu64 ", \"nd_clients\": %" PRIu64 "},\n",
+			raw_stats.tx_frames, raw_stats.tx_stalls, raw_stats.rx_frames,
+			raw_stats.rx_drops, raw_stats.ns_received, raw_stats.ns_multicast,
+			raw_stats.ns_unknown, raw_stats.na_sent, raw_stats.nd_other,
+			raw_stats.nd_clients);
+	fprintf(fp, "\"breakdown\": [");
+	for (i = 0, n = 0; i <= ndim_rows && dims; i++){
+		row = dim_rows + (i < ndim_rows ? i : MAX_DIM_KEYS);
+		if (i == ndim_rows && row->replies + row->completed + row->failed == 0)
+			break;
+		dim_label(row, label, sizeof(label));
+		fprintf(fp, "%s\n {\"key\": ", n++ ? "," : "");
+		json_str(fp, label);
+		fprintf(fp, ", \"replies\": %" PRIu64 ", \"naks\": %" PRIu64 ", \"completed\": %"
+			PRIu64 ", \"failed\": %" PRIu64 ", ", row->replies, row->naks,
+			row->completed, row->failed);
+		json_hist(fp, "latency", &row->latency);
+		fprintf(fp, "}");
+	}
+	fprintf(fp, "],\n\"slo\": [");
+	for (t = 0, n = 0; t < SLO_CHECKS; t++)
+		if (slo[t].set)
+			fprintf(fp, "%s{\"check\": \"%s\", \"limit\": %g, \"actual\": %g, "
+				"\"breached\": %s}", n++ ? ", " : "", slo[t].name, slo[t].limit,
+				slo[t].actual, slo[t].breached ? "true" : "false");
+	fprintf(fp, "],\n\"intervals\": [");
+	first = nwindows > MAX_WINDOWS ? nwindows - MAX_WINDOWS : 0;
+	for (i = first; i < nwindows; i++){
+		w = windows + i % MAX_WINDOWS;
+		fprintf(fp, "%s\n {\"end\": %u, \"usecs\": %" PRIu64 ", \"sent\": %" PRIu64
+			", \"completed\": %" PRIu64 ", \"failed\": %" PRIu64 ", \"timeouts\": %"
+			PRIu64 ", \"drops\": %" PRIu64 ", \"advertise_p99\": %" PRIu64
+			", \"reply_p50\": %" PRIu64 ", \"reply_p99\": %" PRIu64
+			", \"window\": %.1f, \"status\": {", i > first ? "," : "", w->end,
+			w->usecs, w->sent, w->completed, w->failed, w->timeouts, w->drops,
+			w->advertise_p99, w->reply_p50, w->reply_p99, w->cwnd);
+		for (s = 0; s < STATUS_KINDS; s++)
+			fprintf(fp, "%s\"%s\": %" PRIu64, s ? ", " : "", statusstrings[s],
+				w->status[s]);
+		fprintf(fp, "}}");
+	}
+	fprintf(fp, "]\n}\n");
+	if (fp != stdout)
+		fclose(fp);
+}
+int slo_parse(char *spec)
+{
+	char	*cp, *arg;
+	int	i;
+
+	for (cp = strtok(spec, ","); cp != NULL; cp = strtok(NULL, ",")){
+		if ((arg = strchr(cp, ':')) == NULL)
+			goto bad;
+		*arg++ = '\0';
+		for (i = 0; i < SLO_STATUS; i++)
+			if (!strcasecmp(cp, slo[i].name))
+				break;
+		if (i == SLO_STATUS){
+			for (i = STATUS_UnspecFail; i < STATUS_KINDS; i++)
+				if (!strcasecmp(cp, statusstrings[i]))
+					break;
+			if (i == STATUS_KINDS)
+				goto bad;
+			slo[SLO_STATUS + i].name = statusstrings[i];
+			slo[SLO_STATUS + i].bit = slo[SLO_NAK].bit;
+			i += SLO_STATUS;
+		}
+		slo[i].limit = atof(arg);
+		slo[i].set = 1;
+	}
+	slo_set = 1;
+	return(0);
+bad:
+	fprintf(stderr,"--slo: bad check %s\n", cp);
+	return(-1);
+}
+/* Check the --slo limits, report each and return the breached bits */
+int slo_check(void)
+{
+	dhcp_server_t	*server;
+	dhcp_stats_t	*st;
+	lat_hist_t	*adv, *reply;
+	drops_t		d;
+	uint64_t	sent = 0, timeouts = 0, codes = 0, kind[STATUS_KINDS];
+	double		elapsed;
+	char		limit[32];
+	int		i, t, s, breached = 0;
+
+	adv = calloc(2, sizeof(lat_hist_t));
+	assert(adv != NULL);
+	reply = adv + 1;
+	memset(kind, 0, sizeof(kind));
+	slo[SLO_RATE].actual = 0;
+	for (server = servers; server != NULL; server = server->next){
+		st = &server->stats;
+		elapsed = DELTATV64(server->last_packet_received,
+			server->first_packet_sent) / 1000000.0;
+		if (elapsed > 0)
+			slo[SLO_RATE].actual += st->completed / elapsed;
+		hist_merge(adv, &st->advertise_hist);
+		hist_merge(reply, &st->reply_hist);
+		sent += st->solicits_sent + st->requests_sent + st->releases_sent +
+			st->declines_sent + st->informs_sent + st->confirms_sent +
+			st->renews_sent + st->rebinds_sent;
+		timeouts += stats_timeouts(st);
+		for (t = 1; t <= DHCPV6_INFORMATION_REQUEST; t++)
+			for (s = 0; s < STATUS_KINDS; s++){
+				kind[s] += st->status[t][STATUS_TOP][s] + st->status[t][STATUS_IA][s];
+				codes += st->status[t][STATUS_TOP][s] + st->status[t][STATUS_IA][s];
+			}
+	}
+	slo[SLO_ADV_P99].actual = 0.001 * hist_percentile(adv, 99);
+	slo[SLO_REPLY_P99].actual = 0.001 * hist_percentile(reply, 99);
+	slo[SLO_TIMEOUTS].actual = sent ? 100.0 * timeouts / sent : 0;
+	slo[SLO_NAK].actual = codes ? 100.0 * (codes - kind[STATUS_Success]) / codes : 0;
+	for (s = 0; s < STATUS_KINDS; s++)
+		slo[SLO_STATUS + s].actual = codes ? 100.0 * kind[s] / codes : 0;
+	local_drops(&d);
+	slo[SLO_DROPS].actual = drops_lost(&d);
+	free(adv);
+
+	fprintf(logfp,"%-20s %12s %12s\n", "SLO", "Limit", "Actual");
+	for (i = 0; i < SLO_CHECKS; i++){
+		if (!slo[i].set)
+			continue;
+		slo[i].breached = i == SLO_RATE ? slo[i].actual < slo[i].limit :
+			slo[i].actual > slo[i].limit;
+		if (slo[i].breached)
+			breached |= slo[i].bit;
+		snprintf(limit, sizeof(limit), "%s %g", i == SLO_RATE ? ">=" : "<=",
+			slo[i].limit);
+		fprintf(logfp,"%-20s %12s %12.3f %s\n", slo[i].name, limit,
+			slo[i].actual, slo[i].breached ? "BREACHED" : "ok");
+	}
+	fprintf(logfp, "-----------------------------------------\n");
+	return(breached);
+}
+/* A lease was granted: time the whole acquisition, retransmits and all */
+void lease_sample(dhcp_stats_t *stats, dhcp_session_t *session, struct timeval *ts)
+{
+	hist_add(&stats->lease_hist, DELTATV64((*ts), session->acquire_start));
+	hist_add(&stats->lease_hist_co, DELTATV64((*ts), session->acquire_intended));
+}
+/*
+    Replies that did not answer an outstanding exchange, and exchanges
+    answered only after a retransmit.  Late replies say how much server
+    latency the timeouts are hiding.
+*/
+void late_report(void)
+{
+	static const double	pct[] = { 50.0, 90.0, 99.0 };
+	int			i;
+
+	if (replies_duplicate + replies_late + replies_unmatched +
+			replies_retransmitted == 0)
+		return;
+	fprintf(logfp,"Duplicate replies:      %6" PRIu64 " (exchange already answered)\n",
+		replies_duplicate);
+	fprintf(logfp,"Late replies:           %6" PRIu64 " (exchange given up)\n",
+		replies_late);
+	fprintf(logfp,"Unmatched replies:      %6" PRIu64 "\n", replies_unmatched);
+	fprintf(logfp,"Answered after retrans: %6" PRIu64 " (%" PRIu64
+		" stamped before the retransmit)\n", replies_retransmitted,
+		replies_crossed);
+	if (late_by.count){
+		fprintf(logfp,"Late replies (ms):         late by    since last send\n");
+		for (i = 0; i < sizeof(pct)/sizeof(pct[0]); i++)
+			fprintf(logfp,"    p%-6g %20.3f %18.3f\n", pct[i],
+				0.001 * hist_percentile(&late_by, pct[i]),
+				0.001 * hist_percentile(&late_latency, pct[i]));
+		fprintf(logfp,"    %-7s %20.3f %18.3f\n", "max",
+			0.001 * late_by.max, 0.001 * late_latency.max);
+	}
+	fprintf(logfp, "-----------------------------------------\n");
+}
+/* Retire a session; ok says whether its flow completed */
+void session_done(dhcp_server_t *server, dhcp_session_t *session, int ok)
+{
+	if (ok)
+		server->stats.completed++;
+	else
+		server->stats.failed++;
+	if (session->flow){
+		if (ok)
+			mix[session->flow - 1].completed++;
+		else
+			mix[session->flow - 1].failed++;
+		mix[session->flow - 1].retransmits += session->timeouts;
+	}
+	if (dims){
+		if (ok)
+			dim_row(server, session)->completed++;
+		else
+			dim_row(server, session)->failed++;
+	}
+	if (nphases)
+		scn_session_done(server, session, ok);
+	else if (session->client != NULL){
+		if (herd_window)
+			herd_session_done(server, session, ok);
+		else
+			lc_session_done(server, session, ok);
+	}
+	if (raw_ifname != NULL)
+		raw_client_del(session->mac);
+	txid_retire(session, 0, NULL);
+	memset(session, '\0', sizeof(dhcp_session_t));
+	server->active--;
+}
+int  process_sessions(void)
+{
+	dhcp_session_t *session;
+	dhcp_server_t *server;
+	uint64_t sent=0, completed=0, failed=0;
+	struct timeval	now;
+	int		i,j;
+
+	gettimeofday(&now, NULL);
+	interval_check(&now);
+	for (server=servers; server != NULL; server=server->next){
+	for (i = 0,j=0; j< server->active && i < max_sessions; i++){
+		session = server->list + i;
+		if (session->state == UNALLOCATED)
+			continue;
+		j++;
+		switch (session->state){
+			case SESSION_ALLOCATED:
+			break;
+			case PACKET_ERROR:
+				server->stats.errors++;
+				session_done(server, session, 0);
+			break;
+			case SESSION_ALLOCATED|SOLICIT_SENT:
+			case SESSION_ALLOCATED|RAPID_SOLICIT_SENT:
+				if (retrans_due(session, &now)){
+					server->stats.solicit_ack_timeouts++;
+					aimd_loss(server, session);
+					if (retrans_more(session, &now)){
+						session->timeouts++;
+						send_packet6(DHCPV6_SOLICIT, session, server);
+					}
+					else {
+						session_done(server, session, 0);
+					}
+				}
+			break;
+			case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK:
+				if (dhcp_ping == 1){
+					session_done(server, session, 1);
+
+					continue;
+				}
+				if (!tx_ready(TX_FOLLOWUP))
+					break;
+				session->timeouts = 0;
+				send_packet6(DHCPV6_REQUEST, session, server);
+			break;
+			case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_NAK:
+			case SESSION_ALLOCATED|RAPID_SOLICIT_SENT|SOLICIT_NAK:
+				session_done(server, session, 0);
+			break;
+			case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK|REQUEST_SENT:
+			case SESSION_ALLOCATED|REQUEST_SENT:
+				if (retrans_due(session, &now)){
+					server->stats.request_ack_timeouts++;
+					aimd_loss(server, session);
+					if (retrans_more(session, &now)){
+						session->timeouts++;
+						send_packet6(DHCPV6_REQUEST, session, server);
+					}
+					else {
+						session->timeouts++;
+						session_done(server, session, 0);
+					}
+				}
+			break;
+			case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK|REQUEST_SENT|REQUEST_ACK:
+			case SESSION_ALLOCATED|RAPID_SOLICIT_SENT|SOLICIT_ACK:
+			case SESSION_ALLOCATED|REQUEST_SENT|REQUEST_ACK:
+			case SESSION_ALLOCATED|REQUEST_SENT|REQUEST_NAK:
+				if (send_release){
+					if (tx_ready(TX_RELEASE))
+						send_packet6(DHCPV6_RELEASE, session, server);
+				}
+				else if (send_decline){
+					if (tx_ready(TX_FOLLOWUP))
+						send_packet6(DHCPV6_DECLINE, session, server);
+				}
+				else {
+					if (outfp)
+						print_lease(outfp, session, &server->sa.sin6_addr);
+					session_done(server, session, 1);
+				}
+			break;
+			case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK|REQUEST_SENT|REQUEST_NAK:
+				session_done(server, session, 0);
+			break;
+			case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK|REQUEST_SENT|REQUEST_ACK|DECLINE_SENT:
+			case SESSION_ALLOCATED|DECLINE_SENT:
+				if (retrans_due(session, &now)){
+					server->stats.decline_ack_timeouts++;
+					aimd_loss(server, session);
+					if (retrans_more(session, &now)){
+						session->timeouts++;
+						send_packet6(DHCPV6_DECLINE, session, server);
+					}
+					else {
+						session_done(server, session, 0);
+					}
+				}
+			break;
+			case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK|REQUEST_SENT|REQUEST_ACK|RELEASE_SENT:
+			case SESSION_ALLOCATED|RAPID_SOLICIT_SENT|SOLICIT_ACK|RELEASE_SENT:
+			case SESSION_ALLOCATED|RELEASE_SENT:
+				if (retrans_due(session, &now)){
+					server->stats.release_ack_timeouts++;
+					aimd_loss(server, session);
+					if (retrans_more(session, &now)){
+						session->timeouts++;
+						send_packet6(DHCPV6_RELEASE, session, server);
+					}
+					else {
+						session_done(server, session, 0);
+					}
+				}
+			break;
+			case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK|REQUEST_SENT|REQUEST_ACK|DECLINE_SENT|DECLINE_ACK:
+			case SESSION_ALLOCATED|DECLINE_SENT|DECLINE_ACK:
+			case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK|REQUEST_SENT|REQUEST_ACK|RELEASE_SENT|RELEASE_ACK:
+			case SESSION_ALLOCATED|RAPID_SOLICIT_SENT|SOLICIT_ACK|RELEASE_SENT|RELEASE_ACK:
+			case SESSION_ALLOCATED|RELEASE_SENT|RELEASE_ACK:
+				session_done(server, session, 1);
+			break;
+			case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK|REQUEST_SENT|REQUEST_ACK|RELEASE_SENT|RELEASE_NAK:
+			case SESSION_ALLOCATED|RAPID_SOLICIT_SENT|SOLICIT_ACK|RELEASE_SENT|RELEASE_NAK:
+			case SESSION_ALLOCATED|RELEASE_SENT|RELEASE_NAK:
+			case SESSION_ALLOCATED|DECLINE_SENT|DECLINE_NAK:
+				session_done(server, session, 0);
+			break;
+			case SESSION_ALLOCATED|RENEW_SENT:
+				if (retrans_due(session, &now)){
+					server->stats.renew_ack_timeouts++;
+					aimd_loss(server, session);
+					if (retrans_more(session, &now)){
+						session->timeouts++;
+						send_packet6(DHCPV6_RENEW, session, server);
+					}
+					else {
+						session_done(server, session, 0);
+					}
+				}
+
+			break;
+			case SESSION_ALLOCATED|RENEW_SENT|RENEW_ACK:
+			case SESSION_ALLOCATED|RENEW_SENT|RENEW_NAK:
+				session_done(server, session, (session->state & RENEW_ACK) != 0);
+			break;
+			case SESSION_ALLOCATED|REBIND_SENT:
+				if (retrans_due(session, &now)){
+					server->stats.rebind_ack_timeouts++;
+					aimd_loss(server, session);
+					if (retrans_more(session, &now)){
+						session->timeouts++;
+						send_packet6(DHCPV6_REBIND, session, server);
+					}
+					else {
+						session_done(server, session, 0);
+					}
+				}
+			break;
+			case SESSION_ALLOCATED|REBIND_SENT|REBIND_ACK:
+			case SESSION_ALLOCATED|REBIND_SENT|REBIND_NAK:
+				session_done(server, session, (session->state & REBIND_ACK) != 0);
+			break;
+			case SESSION_ALLOCATED|INFORM_SENT:
+				if (retrans_due(session, &now)){
+					server->stats.inform_ack_timeouts++;
+					aimd_loss(server, session);
+					if (retrans_more(session, &now)){
+						session->timeouts++;
+						send_packet6(DHCPV6_INFORMATION_REQUEST, session, server);
+					}
+					else {
+						session_done(server, session, 0);
+					}
+				}
+			break;
+			case SESSION_ALLOCATED|INFORM_SENT|INFORM_ACK:
+			case SESSION_ALLOCATED|INFORM_SENT|INFORM_NAK:
+				session_done(server, session, (session->state & INFORM_ACK) != 0);
+			break;
+			case SESSION_ALLOCATED|CONFIRM_SENT:
+				if (retrans_due(session, &now)){
+					server->stats.confirm_ack_timeouts++;
+					aimd_loss(server, session);
+					if (retrans_more(session, &now)){
+						session->timeouts++;
+						send_packet6(DHCPV6_CONFIRM, session, server);
+					}
+					else {
+						session_done(server, session, 0);
+					}
+				}
+			break;
+			case SESSION_ALLOCATED|CONFIRM_SENT|CONFIRM_ACK:
+			case SESSION_ALLOCATED|CONFIRM_SENT|CONFIRM_NAK:
+				session_done(server, session, (session->state & CONFIRM_ACK) != 0);
+			break;
+			default:
+				server->stats.errors++;
+				fprintf(logfp,"PS: Undefined session state %u\n", session->state);
+				decode_state(session->state);
+				fprintf(logfp,"\tLast Sent: %u.%u Type: %u\n"
+					"\tLast Received: %u.%u Type: %u\n",
+					(uint32_t)session->last_sent.tv_sec,
+					(uint32_t)session->last_sent.tv_usec,
+					(uint32_t)session->type_last_sent,
+					(uint32_t)session->last_received.tv_sec,
+					(uint32_t)session->last_received.tv_usec,
+					(uint32_t)session->type_last_received);
+				session_done(server, session, 0);
+		}
+
+	}
+		if ( input_file != NULL){
+			sent += server->stats.requests_sent +
+				 server->stats.renews_sent +
+				 server->stats.declines_sent +
+				 server->stats.informs_sent +
+				 server->stats.rebinds_sent +
+				 server->stats.confirms_sent;
+			if (start_from == DHCPV6_RELEASE)
+				sent += server->stats.releases_sent;
+		}
+		else
+			sent += server->stats.solicits_sent;
+
+		completed += server->stats.completed;
+		failed    += server->stats.failed;
+	}
+	//fprintf(stderr, "Sent %u Completed %u Failed %u Requests: %u\n",
+		//sent, completed, failed, number_requests);
+	if ( sent >= number_requests){
+		if (send_until_answered && completed < number_requests){
+			return(0);
+		}
+		else if ( completed + failed >= number_requests){/* We are done */
+			return(1);
+		}
+	}
+	return(0);
+}
+
+/*
+    Next option in buf[0..len) from *off: 1 with code/olen/val set,
+    0 at the end, -1 if the option runs past the buffer.
+*/
+int opt_next(const uint8_t *buf, uint32_t len, uint32_t *off,
+		uint16_t *code, uint16_t *olen, const uint8_t **val)
+{
+	if (*off == len)
+		return(0);
+	if (*off + 4 > len)
+		return(-1);
+	*code = ntohs(*((uint16_t *) (buf + *off)));
+	*olen = ntohs(*((uint16_t *) (buf + *off + 2)));
+	if (*off + 4 + *olen > len)
+		return(-1);
+	*val = buf + *off + 4;
+	*off += 4 + *olen;
+	return(1);
+}
+/* Body of IA option val: IAID, T1/T2 except for IA_TA, then sub-options */
+int ia_decode(reply_ia_t *ia, uint16_t code, const uint8_t *val, uint16_t olen)
+{
+	uint32_t	off, hdr = code == D6O_IA_TA ? 4 : 12;
+	uint16_t	sub, slen;
+	const uint8_t	*sval;
+	int		rc;
+
+	if (olen < hdr)
+		return(-1);
+	memset(ia, 0, sizeof(*ia));
+	ia->type = code;
+	ia->iaid = ntohl(*((uint32_t *) val));
+	if (code != D6O_IA_TA){
+		ia->t1 = ntohl(*((uint32_t *) (val + 4)));
+		ia->t2 = ntohl(*((uint32_t *) (val + 8)));
+	}
+	off = hdr;
+	while ((rc = opt_next(val, olen, &off, &sub, &slen, &sval)) > 0){
+		if (sub == D6O_STATUS_CODE){
+			if (slen < 2)
+				return(-1);
+			ia->status = ntohs(*((uint16_t *) sval));
+		}
+		else if (sub == D6O_IAADDR && ia->addr == NULL){
+			if (slen < 24)
+				return(-1);
+			ia->addr = sval;
+			ia->preferred = ntohl(*((uint32_t *) (sval + 16)));
+			ia->valid = ntohl(*((uint32_t *) (sval + 20)));
+		}
+		else if (sub == D6O_IAPREFIX && ia->addr == NULL){
+			if (slen < 25)
+				return(-1);
+			ia->preferred = ntohl(*((uint32_t *) sval));
+			ia->valid = ntohl(*((uint32_t *) (sval + 4)));
+			ia->prefix_len = sval[8];
+			ia->addr = sval + 9;
+		}
+	}
+	return(rc);
+}
+/*
+    One pass over a received datagram: strip RELAY-REPL layers, then
+    collect status, DUIDs and IAs of the message inside.  r points into
+    buf, nothing is copied.  -1 if anything is truncated or malformed.
+*/
+int decode_reply(const uint8_t *buf, uint32_t len, reply_t *r)
+{
+	const uint8_t	*val, *inner;
+	uint32_t	off;
+	uint16_t	code, olen;
+	int		rc;
+
+	r->relays = 0;
+	while (len >= 34 && buf[0] == DHCPV6_RELAY_REPL){
+		if (++r->relays > MAX_RELAYS)
+			return(-1);
+		inner = NULL;
+		off = 34;
+		while ((rc = opt_next(buf, len, &off, &code, &olen, &val)) > 0)
+			if (code == D6O_RELAY_MSG)
+				inner = val;
+		if (rc < 0 || inner == NULL)
+			return(-1);
+		buf = inner;
+		len = olen;
+	}
+	if (len < 4)
+		return(-1);
+	r->msg = buf;
+	r->len = len;
+	r->type = buf[0];
+	r->status = STATUS_Success;
+	r->serverid = r->clientid = NULL;
+	r->serverid_len = r->clientid_len = 0;
+	r->nia = 0;
+	off = 4;
+	while ((rc = opt_next(buf, len, &off, &code, &olen, &val)) > 0){
+		switch (code){
+		   case D6O_SERVERID:
+			r->serverid = val;
+			r->serverid_len = olen;
+			break;
+		   case D6O_CLIENTID:
+			r->clientid = val;
+			r->clientid_len = olen;
+			break;
+		   case D6O_STATUS_CODE:
+			if (olen < 2)
+				return(-1);
+			r->status = ntohs(*((uint16_t *) val));
+			break;
+		   case D6O_IA_NA:
+		   case D6O_IA_TA:
+		   case D6O_IA_PD:
+			if (r->nia == MAX_IA)
+				break;
+			if (ia_decode(r->ia + r->nia++, code, val, olen) < 0)
+				return(-1);
+			break;
+		}
+	}
+	return(rc);
+}
+int process_packet(void *p, struct timeval *timestamp, uint32_t length)
+{
+	dhcp_server_t	*server;
+	dhcp_session_t	*session=NULL;
+	dhcp_stats_t	*stats=NULL;
+	struct dhcpv6_packet *packet;
+	reply_t		r;
+	ia_data_t	*ia;
+	uint32_t	dt;
+	int		is_ack=1;
+	int		i;
+	struct timeval	now;
+	txid_slot_t	*slot;
+	txid_retired_t	*old;
+	dim_row_t	*row;
+	uint32_t	txid;
+
+	gettimeofday(&now, NULL);
+	hist_add(&noise_rx, DELTATV64(now, (*timestamp)));
+	if (decode_reply(p, length, &r) < 0){
+		replies_malformed++;
+		if (verbose)
+			fprintf(logfp,"Malformed reply, %u bytes\n", length);
+		return(-1);
+	}
+	packet = (struct dhcpv6_packet *) r.msg;
+	length = r.len;
+
+	txid = packet->transaction_id[0] << 16 |
+		packet->transaction_id[1] << 8 | packet->transaction_id[2];
+	if ((slot = txid_find(txid)) == NULL){
+		old = txid_retired + txid % TXID_RETIRED;
+		if (old->txid != txid)
+			replies_unmatched++;
+		else if (old->answered)
+			replies_duplicate++;
+		else {
+			replies_late++;
+			hist_add(&late_by, DELTATV64((*timestamp), old->when));
+			hist_add(&late_latency, DELTATV64((*timestamp), old->sent));
+		}
+		return(-1);
+	}
+	session = slot->session;
+	server = slot->server;
+	txid_retire(session, 1, timestamp);
+
+	/*
+	 * After a retransmit we can't tell which send this answers, unless
+	 * it was stamped before the retransmit went out.
+	 */
+	if (session->xchg_tx > 1)
+		replies_retransmitted++;
+	if (DELTATV64((*timestamp), session->last_sent) < 0){
+		replies_crossed++;
+		dt = DELTATV64((*timestamp), session->prev_sent) < 0 ? 0 :
+			DELTATV((*timestamp), session->prev_sent);
+	}
+	else
+		dt = DELTATV((*timestamp), session->last_sent);
+
+	if (r.serverid != NULL){
+		session->serverid_len =
+			(r.serverid_len < MAX_DUID_LEN) ? r.serverid_len : MAX_DUID_LEN;
+		memcpy(session->serverid, r.serverid, session->serverid_len);
+	}
+	status_count(&server->stats, session->type_last_sent, &r);
+	if (r.status != STATUS_Success)
+		is_ack=0;
+	session->recv_ia = r.nia;
+	for (i=0; i < r.nia; i++){
+		ia = session->ia + i;
+		if (r.ia[i].status != STATUS_Success)
+			is_ack=0;
+		ia->t1 = r.ia[i].t1;
+		ia->t2 = r.ia[i].t2;
+		if (r.ia[i].addr == NULL)
+			continue;
+		memcpy(&ia->ipaddr, r.ia[i].addr, sizeof(struct in6_addr));
+		ia->prefix_len = r.ia[i].prefix_len;
+		ia->preferred = r.ia[i].preferred;
+		ia->valid = r.ia[i].valid;
+	}
+	if (dims){
+		row = dim_row(server, session);
+		row->replies++;
+		row->naks += !is_ack;
+		hist_add(&row->latency, dt);
+	}
+
+	server->last_packet_received.tv_sec = timestamp->tv_sec;
+	server->last_packet_received.tv_usec = timestamp->tv_usec;
+	session->last_received.tv_sec = timestamp->tv_sec;
+	session->last_received.tv_usec = timestamp->tv_usec;
+	session->type_last_received = packet->msg_type;
+	stats = &server->stats;
+
+	switch (packet->msg_type){
+		case DHCPV6_ADVERTISE:
+			if (is_ack) {
+				session->state |= SOLICIT_ACK;
+				stats->solicit_acks_received++;
+			}
+			else {
+				session->state |= SOLICIT_NAK;
+				stats->solicit_naks_received++;
+			}
+
+			stats->advertise_latency_avg += dt;
+			if ( dt < stats->advertise_latency_min )
+				stats->advertise_latency_min = dt;
+			if ( dt > stats->advertise_latency_max )
+				stats->advertise_latency_max = dt;
+			hist_add(&stats->advertise_hist, dt);
+			hist_add(&window_advertise, dt);
+			aimd_sample(server, session, dt);
+			if (session->flow)
+				hist_add(&mix[session->flow - 1].latency, dt);
+			hist_add(&stats->advertise_hist_co,
+				DELTATV64((*timestamp), session->xchg_intended));
+
+		break;
+		case DHCPV6_REPLY:
+			switch (session->state) {
+				case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK|REQUEST_SENT:
+				case SESSION_ALLOCATED|REQUEST_SENT:
+					if (is_ack){
+						session->state |= REQUEST_ACK;
+						stats->request_acks_received++;
+						lease_sample(stats, session, timestamp);
+					}
+					else {
+						session->state |= REQUEST_NAK;
+						stats->request_naks_received++;
+					}
+				break;
+				case SESSION_ALLOCATED|RAPID_SOLICIT_SENT:
+					if (is_ack){
+						session->state |= SOLICIT_ACK;
+						stats->request_acks_received++;
+						lease_sample(stats, session, timestamp);
+					}
+					else {
+						session->state |= SOLICIT_NAK;
+						stats->request_naks_received++;
+					}
+				break;
+				case SESSION_ALLOCATED|RENEW_SENT:
+					if (is_ack){
+						session->state |= RENEW_ACK;
+						stats->renew_acks_received++;
+					}
+					else {
+						session->state |= RENEW_NAK;
+						stats->renew_naks_received++;
+					}
+				break;
+				case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK|REQUEST_SENT|REQUEST_ACK|INFORM_SENT:
+				case SESSION_ALLOCATED|INFORM_SENT:
+					if (is_ack){
+						session->state |= INFORM_ACK;
+						stats->inform_acks_received++;
+					}
+					else {
+						session->state |= INFORM_NAK;
+						stats->inform_naks_received++;
+					}
+				break;
+				case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK|REQUEST_SENT|REQUEST_ACK|DECLINE_SENT:
+				case SESSION_ALLOCATED|DECLINE_SENT:
+					if (is_ack){
+						session->state |= DECLINE_ACK;
+						stats->decline_acks_received++;
+					}
+					else {
+						session->state |= DECLINE_NAK;
+						stats->decline_naks_received++;
+					}
+				break;
+				case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK|REQUEST_SENT|REQUEST_ACK|RELEASE_SENT:
+				case SESSION_ALLOCATED|RAPID_SOLICIT_SENT|SOLICIT_ACK|RELEASE_SENT:
+				case SESSION_ALLOCATED|RELEASE_SENT:
+					if (is_ack){
+						session->state |= RELEASE_ACK;
+						stats->release_acks_received++;
+					}
+					else {
+						session->state |= RELEASE_NAK;
+						stats->release_naks_received++;
+					}
+					hist_add(&stats->release_hist,
+						DELTATV64((*timestamp), session->release_start));
+				break;
+				case SESSION_ALLOCATED|SOLICIT_SENT|SOLICIT_ACK|REQUEST_SENT|REQUEST_ACK|REBIND_SENT:
+				case SESSION_ALLOCATED|REBIND_SENT:
+					if (is_ack){
+						session->state |= REBIND_ACK;
+						stats->rebind_acks_received++;
+					}
+					else {
+						session->state |= REBIND_NAK;
+						stats->rebind_naks_received++;
+					}
+				break;
+				case SESSION_ALLOCATED|CONFIRM_SENT:
+					if (is_ack){
+						session->state |= CONFIRM_ACK;
+						stats->confirm_acks_received++;
+					}
+					else {
+						session->state |= CONFIRM_NAK;
+						stats->confirm_naks_received++;
+					}
+				break;
+				default:
+					fprintf(logfp, "PP: Unknown session state: %d\n", session->state);
+					decode_state(session->state);
+				break;
+			}
+
+			stats->reply_latency_avg += dt;
+			if ( dt < stats->reply_latency_min )
+				stats->reply_latency_min = dt;
+			if ( dt > stats->reply_latency_max )
+				stats->reply_latency_max = dt;
+			hist_add(&stats->reply_hist, dt);
+			hist_add(&window_reply, dt);
+			aimd_sample(server, session, dt);
+			if (session->flow)
+				hist_add(&mix[session->flow - 1].latency, dt);
+			hist_add(&stats->reply_hist_co,
+				DELTATV64((*timestamp), session->xchg_intended));
+
+			break;
+		default:
+			fprintf(logfp,"Unknown DHCP type: %d\n", packet->msg_type);
+			session->state = PACKET_ERROR;
+			return(-1);
+	}
+
+	
+	/* Any follow-up message is meant to go out as soon as this arrived */
+	session->intended_start = *timestamp;
+
+	/* remember last packet for next possible reuse */
+	//memcpy(session->last_packet, packet, length);
+	//session->last_packet_len = length;
+
+	if (verbose)
+		print_packet(length, packet, "Recv: ");
+
+	return(0);
+}
+
+static struct option long_options[] = {
+	{"rate",	required_argument,	NULL,	OPT_RATE},
+	{"lifecycle",	required_argument,	NULL,	OPT_LIFECYCLE},
+	{"compress",	required_argument,	NULL,	OPT_COMPRESS},
+	{"renewals",	required_argument,	NULL,	OPT_RENEWALS},
+	{"lease-end",	required_argument,	NULL,	OPT_LEASE_END},
+	{"herd",	required_argument,	NULL,	OPT_HERD},
+	{"herd-msg",	required_argument,	NULL,	OPT_HERD_MSG},
+	{"mix",		required_argument,	NULL,	OPT_MIX},
+	{"scenario",	required_argument,	NULL,	OPT_SCENARIO},
+	{"duration",	required_argument,	NULL,	OPT_DURATION},
+	{"interval",	required_argument,	NULL,	OPT_INTERVAL},
+	{"adaptive",	required_argument,	NULL,	OPT_ADAPTIVE},
+	{"rfc-retrans",	no_argument,		NULL,	OPT_RFC_RETRANS},
+	{"retrans",	required_argument,	NULL,	OPT_RETRANS},
+	{"tx-budget",	required_argument,	NULL,	OPT_TX_BUDGET},
+	{"tx-weight",	required_argument,	NULL,	OPT_TX_WEIGHT},
+	{"tx-rate",	required_argument,	NULL,	OPT_TX_RATE},
+	{"profile",	required_argument,	NULL,	OPT_PROFILE},
+	{"raw",		required_argument,	NULL,	OPT_RAW},
+	{"xdp",		required_argument,	NULL,	OPT_XDP},
+	{"gso",		no_argument,		NULL,	OPT_GSO},
+	{"gro",		no_argument,		NULL,	OPT_GRO},
+	{"breakdown",	required_argument,	NULL,	OPT_BREAKDOWN},
+	{"json",	required_argument,	NULL,	OPT_JSON},
+	{"slo",		required_argument,	NULL,	OPT_SLO},
+	{"busy-poll",	required_argument,	NULL,	OPT_BUSY_POLL},
+	{"cpu",		required_argument,	NULL,	OPT_CPU},
+	{NULL,		0,			NULL,	0}
+};
+
+void parse_args(int argc, char **argv)
+{
+	int		ch;
+	int		i;
+	uint64_t	val;
+	int		temp[6];
+	char		*tokes[32], *cp;
+
+	if ( argc < 3)
+		usage();
+
+	while ((ch = getopt_long(argc, argv, "a:Ac:ed:D:f:h:H:i:I:l:mn:No:O:pPq:rR:s:S:t:u:vz",
+					long_options, NULL)) != -1){
+		switch (ch) {
+           	case 'a':
+                	if (strchr(optarg, ':') == NULL) {
+                			val = atoll(optarg);
+                  			for (i = 0; i < 6; i++)
+                  				firstmac[5 - i] = (val & (0x00ffULL << i * 8)) >> i * 8;
+                  		}
+                		else {
+                			if (sscanf(optarg, "%2x:%2x:%2x:%2x:%2x:%2x",
+                			temp, temp + 1, temp + 2, temp + 3, temp + 4, temp + 5) < 6) {
+                 			fprintf(stderr, "\nBad MAC Address in -a option: %s\n", optarg);
+                 			usage();
+                 		}
+                  		for (i = 0; i < 6; i++)
+                  			firstmac[i] = (char) temp[i];
+                  	}
+                  	use_sequential_mac = 1;
+                  	break;
+		case 'A':
+			fprintf(stderr,"Will simulate relay agent\n");
+			use_relay = 1;
+			break;
+		case 'c':
+                        if ( inet_pton(AF_INET6, optarg, &srcaddr) == 0 ){
+                                fprintf(stderr,"Invalid source IPV6 address %s\n",
+                                        optarg);
+                                exit(1);
+                        }
+                        break;
+                case 'd':
+			send_delay = atol(optarg);
+			break;
+                case 'D':
+			update_domain = strdup(optarg);
+			fprintf(stderr,"Using %s for DDNS updates\n", update_domain);
+			break;
+		case 'e':
+			send_decline = 1;
+			break;
+		case 'f':
+			input_file = strdup(optarg);
+			break;
+		case 'h':
+			if (*optarg == 'N' || *optarg == 'n')
+				server_should_ddns = 0;
+			send_hostname = 1;
+			break;
+		case 'H':
+			if (*optarg == 'N' || *optarg == 'n')
+				server_should_ddns = 0;
+			random_hostname = 1;
+			send_hostname = 1;
+			break;
+		case 'i':
+			if (add_servers(optarg) < 0)
+				exit(1);
+			break;
+		case 'I':
+		        nrequests = get_tokens(optarg, tokes, MAX_TOKENS);
+			info_requests = malloc(nrequests * sizeof(uint16_t));
+			assert(info_requests);
+			for (i=0; i < nrequests; i++)
+				info_requests[i] = htons(atoi(tokes[i]));
+			break;
+		case 'l':
+			logfile = strdup(optarg);
+			break;
+		case 'm':
+                	use_sequential_mac = 1;
+                	break;
+		case 'n':
+			number_requests = atol(optarg);
+			break;
+		case 'N':
+			send_until_answered = 1;
+			break;
+		case 'o':
+			output_file = strdup(optarg);
+			break;
+		case 'O':
+			{
+				int option;
+				char *s;
+
+				option = strtol(optarg, &s, 0);
+				if (option == 0xff || s[0] != ':' || s[1] == '\0')
+					usage();
+
+				if (addoption(option, s + 1) < 0)
+					usage();
+			}
+			break;
+		case 'p':
+			dhcp_ping = 1;
+			break;
+		case 'P':
+			request_prefix = 1;
+			break;
+		case 'q':
+			max_sessions = atol(optarg);
+			break;
+		case 'r':
+			send_release = 1;
+			break;
+		case 'R':
+			retransmit = atol(optarg);
+			break;
+		case 's':
+			if ((start_from = msg_type_by_name(optarg)) < 0){
+				fprintf(stderr,"Unknown start_from: %s\n", optarg);
+				usage();
+			}
+			break;
+		case 'S':
+			if (parse_opt_seq(optarg) < 0)
+				usage();
+			opt_seq=1;
+			break;
+		case 't':
+			timeout = 1000*atol(optarg);
+			break;
+		case 'u':
+			num_per_mac = atol(optarg);
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+/*
+		case 'w':
+			renew_lease =1;
+			start_from = DHCPV6_RENEW;
+			break;
+*/
+		case 'z':
+			rapid_commit=1;
+			break;
+		case OPT_RATE:
+			target_rate = atof(optarg);
+			if (target_rate <= 0){
+				fprintf(stderr,"Invalid --rate: %s\n", optarg);
+				usage();
+			}
+			break;
+		case OPT_LIFECYCLE:
+			lifecycle = atol(optarg);
+			break;
+		case OPT_COMPRESS:
+			time_compress = atof(optarg);
+			if (time_compress <= 0){
+				fprintf(stderr,"Invalid --compress: %s\n", optarg);
+				usage();
+			}
+			break;
+		case OPT_RENEWALS:
+			max_renewals = atol(optarg);
+			break;
+		case OPT_LEASE_END:
+			if (!strcasecmp(optarg,"release"))
+				release_at_end = 1;
+			else if (!strcasecmp(optarg,"expire"))
+				release_at_end = 0;
+			else {
+				fprintf(stderr,"Unknown --lease-end: %s\n", optarg);
+				usage();
+			}
+			break;
+		case OPT_HERD:
+			herd_window = atol(optarg);
+			if (herd_window == 0)
+				herd_window = 1;
+			break;
+		case OPT_HERD_MSG:
+			if (!strcasecmp(optarg,"confirm"))
+				herd_msg = DHCPV6_CONFIRM;
+			else if (!strcasecmp(optarg,"rebind"))
+				herd_msg = DHCPV6_REBIND;
+			else if (!strcasecmp(optarg,"solicit"))
+				herd_msg = DHCPV6_SOLICIT;
+			else {
+				fprintf(stderr,"Unknown --herd-msg: %s\n", optarg);
+				usage();
+			}
+			break;
+		case OPT_MIX:
+			if (mix_parse(optarg) < 0)
+				usage();
+			break;
+		case OPT_SCENARIO:
+			if (scenario_parse(optarg) < 0)
+				exit(1);
+			break;
+		case OPT_DURATION:
+			soak_duration = atol(optarg);
+			break;
+		case OPT_INTERVAL:
+			stat_interval = atol(optarg);
+			break;
+		case OPT_ADAPTIVE:
+			adaptive = atol(optarg);
+			break;
+		case OPT_RFC_RETRANS:
+			rfc_retrans = 1;
+			break;
+		case OPT_RETRANS:
+			if (retrans_parse(optarg) < 0)
+				usage();
+			rfc_retrans = 1;
+			break;
+		case OPT_TX_BUDGET:
+		case OPT_TX_WEIGHT:
+			if (tx_parse(optarg, ch == OPT_TX_WEIGHT) < 0)
+				usage();
+			break;
+		case OPT_TX_RATE:
+			tx_rate = atof(optarg);
+			break;
+		case OPT_PROFILE:
+			profile_file = optarg;
+			break;
+		case OPT_RAW:
+			raw_ifname = strtok(optarg, ",");
+			if ((cp = strtok(NULL, ",")) == NULL)
+				break;
+			if (sscanf(cp, "%2x:%2x:%2x:%2x:%2x:%2x", temp, temp + 1,
+					temp + 2, temp + 3, temp + 4, temp + 5) < 6){
+				fprintf(stderr,"Bad MAC address in --raw: %s\n", cp);
+				usage();
+			}
+			for (i = 0; i < 6; i++)
+				raw_gwmac[i] = temp[i];
+			raw_have_gw = 1;
+			break;
+		case OPT_GSO:
+			use_gso = 1;
+			break;
+		case OPT_GRO:
+			use_gro = 1;
+			break;
+		case OPT_BUSY_POLL:
+			busy_poll = atoi(optarg);
+			if (busy_poll <= 0){
+				fprintf(stderr,"--busy-poll needs usecs > 0\n");
+				usage();
+			}
+			break;
+		case OPT_CPU:
+			pin_cpu = atoi(optarg);
+			break;
+		case OPT_JSON:
+			json_file = optarg;
+			break;
+		case OPT_SLO:
+			if (slo_parse(optarg) < 0)
+				usage();
+			break;
+		case OPT_BREAKDOWN:
+			for (cp = strtok(optarg, ","); cp != NULL; cp = strtok(NULL, ",")){
+				if (!strcmp(cp, "server"))
+					dims |= DIM_SERVER;
+				else if (!strcmp(cp, "msg"))
+					dims |= DIM_MSG;
+				else if (!strcmp(cp, "ia"))
+					dims |= DIM_IA;
+				else if (!strcmp(cp, "iatype"))
+					dims |= DIM_IATYPE;
+				else if (!strcmp(cp, "relay"))
+					dims |= DIM_RELAY;
+				else if (!strcmp(cp, "fqdn"))
+					dims |= DIM_FQDN;
+				else if (!strcmp(cp, "flow"))
+					dims |= DIM_FLOW;
+				else {
+					fprintf(stderr,"--breakdown: unknown dimension %s\n", cp);
+					usage();
+				}
+			}
+			break;
+		case OPT_XDP:
+			if (!strcmp(optarg, "skb"))
+				raw_mode = RAW_XDP_SKB;
+			else if (!strcmp(optarg, "copy"))
+				raw_mode = RAW_XDP_COPY;
+			else if (!strcmp(optarg, "zc"))
+				raw_mode = RAW_XDP_ZC;
+			else {
+				fprintf(stderr,"--xdp: skb, copy or zc\n");
+				usage();
+			}
+			break;
+		case '?':
+		default:
+                     usage();
+		}
+	}
+/*
+	if (send_info_request && (renew_lease || send_decline || send_release)) {
+		fprintf(stderr, "Information-Request doesn't grab IP address\n");
+		usage();
+	}
+*/
+	if (lifecycle && (send_release || send_decline || dhcp_ping)){
+		fprintf(stderr, "--lifecycle decides when to release; -r, -e and -p don't apply\n");
+		usage();
+	}
+	if (herd_window && (input_file == NULL || lifecycle || send_release ||
+			send_decline || dhcp_ping)){
+		fprintf(stderr, "--herd needs a -f lease population and no -r, -e, -p or --lifecycle\n");
+		usage();
+	}
+	if (nphases && (nmix || lifecycle || herd_window || send_release ||
+			send_decline || dhcp_ping)){
+		fprintf(stderr, "--scenario phases set the flows; drop -r, -e, -p, --mix, --lifecycle and --herd\n");
+		usage();
+	}
+	for (i = 0; i < nphases; i++)
+		if (phases[i].concurrency > max_sessions)
+			max_sessions = phases[i].concurrency;
+	if (nmix && (lifecycle || herd_window)){
+		fprintf(stderr, "--mix can't be combined with --lifecycle or --herd\n");
 		usage();
+	}
+	if (soak_duration && (lifecycle || herd_window || nphases)){
+		fprintf(stderr, "--duration runs the -s flow or --mix; --lifecycle, --herd and --scenario keep their own clocks\n");
+		usage();
+	}
+	if (soak_duration && stat_interval == 0)
+		stat_interval = 60;
+	if (adaptive && stat_interval == 0)
+		stat_interval = 5;
+	if (tx_sched)
+		tx_setup();
+	/* require server IP address and lease file */
+	if (servers == NULL){
+		fprintf(stderr, "No servers defined. Using FF05::1:3\n");
+		add_servers("ff05::1:3");
+		//usage();
+	}
+	/* A soak population must cover every server's window, or a client
+	   could be in two sessions at once */
+	if (soak_duration && number_requests < max_sessions * num_servers)
+		number_requests = max_sessions * num_servers;
+}
+
+int add_servers(const char *s)
+{
+	const char *p1 = s;
+	dhcp_server_t *sp = NULL;
+
+	char buffer[INET6_ADDRSTRLEN];
+	int len;
+
+	assert(s != NULL);
+	while (*p1 != '\0'){
+		while (*p1 != ',' && *p1 != '\0')
+			p1++;
+		len = p1 - s;
+		if (len == 0 || len + 1 > sizeof(buffer))
+			return(-1);
+		strncpy(buffer, s, len);
+		s = p1+1;
+		buffer[len]='\0';
+
+		if ( *p1 != '\0')
+			p1++;
+
+		sp = malloc(sizeof(dhcp_server_t));
+		assert(sp);
+		memset(sp,'\0', sizeof(dhcp_server_t));
+		stats_reset(sp);
+		sp->sa.sin6_port = htons(DHCP6_SERVER_PORT);
+		sp->sa.sin6_family = AF_INET6;
+		if (inet_pton(AF_INET6, buffer, &sp->sa.sin6_addr) == 0){
+			fprintf(stderr,"Invalid address %s\n", buffer);
+			return(-1);
+		}
+		sp->next = servers;
+		servers = sp;
+		num_servers++;
+	}
+	return(0);
+}
+
+void print_packet(uint32_t packet_len, struct dhcpv6_packet *p, const char *prefix)
+{
+	const uint8_t	*val, *sval;
+	uint32_t	off = 0, soff, i;
+	uint16_t	code, olen, sub, slen;
+	int		rc;
+
+	if (packet_len < 4)
+		return;
+	fprintf(logfp, "%sPacket Type %d (%s), len = %d, ", prefix, p->msg_type,
+		p->msg_type >= 1 && p->msg_type <= sizeof(typestrings) / sizeof(typestrings[0]) ?
+		typestrings[p->msg_type-1] : "?", packet_len);
+	fprintf(logfp, "txn: [%d %d %d]\n", p->transaction_id[0], p->transaction_id[1], p->transaction_id[2]);
+
+	while ((rc = opt_next(p->options, packet_len - 4, &off, &code, &olen, &val)) > 0){
+		fprintf(logfp, "   Option %d (%s), len = %d [", code, option_name(code), olen);
+		for (i = 0; i < olen; i++)
+			fprintf(logfp, " %d", val[i]);
+		fprintf(logfp, " ]\n");
+
+		/* expand IA_NA/IA_TA/IA_PD options */
+		if (code != D6O_IA_NA && code != D6O_IA_TA && code != D6O_IA_PD)
+			continue;
+		soff = code == D6O_IA_TA ? 4 : 12;
+		if (soff > olen)
+			continue;
+		while (opt_next(val, olen, &soff, &sub, &slen, &sval) > 0){
+			fprintf(logfp, "      Option %d (%s), len = %d [", sub, option_name(sub), slen);
+			for (i = 0; i < slen; i++)
+				fprintf(logfp, " %d", sval[i]);
+			fprintf(logfp, " ]\n");
+		}
+	}
+	if (rc < 0)
+		fprintf(logfp, "   Truncated at %u\n", off);
+	fprintf(logfp, "\n");
+}
+/* Name of option code, for printing */
+const char *option_name(uint16_t code)
+{
+	if (code == 0 || code > sizeof(optionstrings) / sizeof(optionstrings[0]))
+		return("?");
+	return(optionstrings[code - 1]);
+}
+
+#define MAX_CLIENTID_LEN 100
+uint32_t read_lease_data(lease_data_t **leases)
+{
+	char		buf[1024];
+	uint32_t	read_count = 0;
+	int		lineno = 0;
+	lease_data_t	*lease = *leases;
+	lease_data_t	next;
+	FILE		*fpin;
+
+        fpin = fopen(input_file, "r");
+	if (fpin == NULL){
+		fprintf(logfp,"Could not open input file: %s\n",input_file);
+		return(0);
+	}
+	while ( fgets(buf, sizeof(buf), fpin) != NULL){
+		lineno++;
+		if (!parse_lease_line(buf, lineno, &next))
+			continue;
+           	if (*leases == NULL) {
+                  	*leases = calloc(1, sizeof(lease_data_t));
+                  	lease = *leases;
+           	}
+           	else {
+                  	lease->next = calloc(1, sizeof(lease_data_t));
+                  	lease = lease->next;
+           	}
+           	assert(lease != NULL);
+
+		*lease = next;
+	    	read_count++;
+	}
+	fclose(fpin);
+	return(read_count);
+}
+/* One line of a -f lease file into lease; 0 if it is unusable */
+int parse_lease_line(char *buf, int lineno, lease_data_t *lease)
+{
+	int		ret, i;
+	int		ntokes;
+	char		*tokes[MAX_TOKENS];
+	char		*cp;
+	int		temp[6];
+	uint8_t		mac[6], prefix_len;
+	uint32_t	iaid=0;
+	struct in6_addr	ipaddr;
+	uint8_t		a,b;
+
+	if ((ntokes = get_tokens(buf, tokes, MAX_TOKENS)) < 3){
+		fprintf(logfp, "Too few tokens: %d, line %d\n", ntokes,lineno);
+		return(0);
+	}
+
+	ret = sscanf(tokes[0], "%2x:%2x:%2x:%2x:%2x:%2x", temp,
+			 temp + 1, temp + 2, temp + 3, temp + 4, temp + 5);
+	if (ret < 6) {
+		fprintf(logfp, "Line %d, MAC format error: %s\n", lineno, tokes[0]);
+		return(0);
+	}
+	for (i = 0; i < 6; i++)
+		mac[i] = (char) temp[i];
+
+	ret = sscanf(tokes[1], "%u", &iaid);
+	if (ret < 1) {
+		fprintf(logfp, "Line %d, IAID format error: %s\n", lineno, tokes[1]);
+		return(0);
+	}
+
+	prefix_len=0;
+	if ((cp=strchr(tokes[2], '/')) != NULL){
+		prefix_len = atoi(cp+1);
+		*cp ='\0';
+	}
+
+	if (inet_pton(AF_INET6, tokes[2], &ipaddr) <= 0) {
+		if (*tokes[2] == '-')
+			ipaddr = in6addr_any;
+		else {
+			fprintf(logfp, "Line %d, format error: %s\n", lineno, tokes[2]);
+			return(0);
+		}
+	}
+
+	memset(lease, 0, sizeof(lease_data_t));
+	lease->ia[0].ipaddr = ipaddr;
+	lease->ia[0].prefix_len = prefix_len;
+	lease->ia[0].iaid = iaid;
+	lease->num_ia = 1;
+	memcpy(lease->mac, mac, 6);
+	lease->next = NULL;
+
+	if (ntokes > 3){
+		lease->serverid_len = strlen(tokes[3]);
+		if ( lease->serverid_len % 2){
+			fprintf(stderr, "\tInvalid Server DUID: %s\n",
+						tokes[3]);
+			exit(1);
+		}
+		lease->serverid_len /= 2;
+		for (i=0; i < lease->serverid_len; i++){
+			a = *(tokes[3] + 2*i);
+			b = *(tokes[3] + 2*i +1);
+			if ( a >= '0' && a <= '9')
+				a = a - '0';
+			else 
+				a = 10 + a - 'a';
+
+			if ( b >= '0' && b <= '9')
+				b = b - '0';
+			else 
+				b = 10 + b - 'a';
+			lease->serverid[i] = a * 16 + b;
+		}
+	}
+	else
+		lease->serverid[0] = 0xff;
+
+	if (ntokes > 4 && *tokes[4] != '-')
+		lease->hostname = strdup(tokes[4]);
+	else
+		lease->hostname = NULL;
+
+	if (ntokes > 5 && *tokes[5] != '-')
+		inet_pton(AF_INET6, tokes[5], &lease->sa);
+	else
+		lease->sa = in6addr_any;
+
+	/* Possibly Multiple IAIDs in this entry */
+	if (ntokes < 6)
+		return(1);
+	for (i=6; i < ntokes - 3; i += 3){
+		if (strncasecmp(tokes[i], "IA:", 3) == 0){
+			lease->ia[lease->num_ia].iaid = atol(tokes[i+1]);
+			lease->ia[lease->num_ia].prefix_len=0;
+			if ((cp=strchr(tokes[i+2], '/')) != NULL){
+				lease->ia[lease->num_ia].prefix_len = atoi(cp+1);
+				*cp ='\0';
+			}
+			if (inet_pton(AF_INET6, tokes[i+2], &lease->ia[lease->num_ia].ipaddr) <= 0) 
+				fprintf(logfp, "Line %d, format error: %s\n", lineno, tokes[i+2]);
+			else 
+				lease->num_ia++;
+		}
+		else 
+			fprintf(logfp, "Line %d, format error: %s\n", lineno, tokes[i]);
+
+	}
+	return(1);
+}
+struct in6_addr get_local_addr(void)
+{
+
+	int		lsock;
+	struct		sockaddr_in6 ca;
+	socklen_t	calen = sizeof(ca);
+	char		ip6str[272];
+
+
+	if ((lsock=socket(AF_INET6, SOCK_DGRAM, 0)) < 0 ){
+		perror("socket:");
+		exit(1);
+	}
+	if (servers == NULL){
+		fprintf(logfp,"get_local_addr: servers list is NULL\n");
+		exit(1);
+	}
+	if ( connect(lsock, (const  struct sockaddr *) &servers->sa,
+						sizeof(servers->sa)) < 0 ){
+		perror("get_local_addr: Connect");
+		return(in6addr_any);
+	}
+	getsockname(lsock, (struct sockaddr *) &ca, &calen);
+	close(lsock);
+	fprintf(stderr, "get_local_addr: Using source address: %s\n", inet_ntop(AF_INET6, &ca.sin6_addr,
+				ip6str, sizeof(ip6str)));
+	return(ca.sin6_addr);
+}
+
+
+dhcp_session_t *find_free_session( dhcp_server_t *s)
+{
+	int		i;
+	dhcp_session_t	*list = s->list;
+	if ( s->active >= max_sessions ||
+			(session_window && s->active >= session_window) ||
+			(adaptive && s->active >= (uint32_t) s->cwnd) ||
+			!tx_ready(TX_NEW))
+		return(NULL);
+	for (i=0; i < max_sessions; i++){
+		if  (list[i].state == UNALLOCATED){
+			list[i].state = SESSION_ALLOCATED;
+			s->active++;
+			return(list+i);
+		}
+	}
+	return(NULL);
+}
+
+/*
+    --gso: consecutive datagrams of one size to one server are sent as
+    one UDP_SEGMENT super-datagram.  reader() holds the batch open while
+    the sender keeps adding to it, and flushes it before blocking.
+*/
+void gso_add(dhcp_server_t *server, dhcp_session_t *session, uint8_t *buf, int len)
+{
+	if (gso_n && (server != gso_server || len != gso_seg ||
+			gso_n == GSO_MAX_SEGS || gso_len + len > sizeof(gso_buf)))
+		gso_flush();
+	memcpy(gso_buf + gso_len, buf, len);
+	gso_len += len;
+	gso_seg = len;
+	gso_server = server;
+	gso_txids[gso_n] = session->txid;
+	gso_sessions[gso_n++] = session;
+	gso_fresh = 1;
+}
+void gso_flush(void)
+{
+	struct msghdr	msg;
+	struct iovec	iov = { gso_buf, gso_len };
+	struct cmsghdr	*cm;
+	struct timeval	now, sent;
+	char		cbuf[CMSG_SPACE(sizeof(uint16_t))];
+	uint32_t	i;
+
+	if (gso_n == 0)
+		return;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_name = &gso_server->sa;
+	msg.msg_namelen = sizeof(struct sockaddr_in6);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	if (gso_n > 1){
+		msg.msg_control = cbuf;
+		msg.msg_controllen = sizeof(cbuf);
+		cm = CMSG_FIRSTHDR(&msg);
+		cm->cmsg_level = SOL_UDP;
+		cm->cmsg_type = UDP_SEGMENT;
+		cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+		*((uint16_t *) CMSG_DATA(cm)) = gso_seg;
+	}
+	/* Latency counts from when the batch really goes out; a session
+	   that finished or moved to another client since has a new txid */
+	gettimeofday(&now, NULL);
+	for (i = 0; i < gso_n; i++)
+		if (gso_sessions[i]->txid == gso_txids[i])
+			gso_sessions[i]->last_sent = now;
+	gso_server->last_packet_sent = now;
+	if (sendmsg(sock, &msg, 0) < 0){
+		if (gso_n > 1 && (errno == EINVAL || errno == EOPNOTSUPP || errno == EIO)){
+			fprintf(logfp,"UDP_SEGMENT unavailable, sending singly\n");
+			use_gso = 0;
+			for (i = 0; i < gso_n; i++)
+				sendto(sock, gso_buf + i * gso_seg, gso_seg, 0,
+					(struct sockaddr *) &gso_server->sa,
+					sizeof(struct sockaddr_in6));
+		}
+		else
+			fprintf(logfp,"sendmsg failed\n");
+	}
+	gettimeofday(&sent, NULL);
+	hist_add(&noise_tx, DELTATV64(sent, now));
+	gso_calls++;
+	gso_datagrams += gso_n;
+	gso_n = gso_len = 0;
+}
+
+/*
+    --busy-poll: spin on a zero-timeout poll() rather than sleep in it, so
+    a reply is picked up without a wakeup.  Long gaps between spins are
+    where we were descheduled.
+*/
+int rx_poll(struct pollfd *fds, int pollto)
+{
+	struct timeval	start, now, last;
+	int		ret;
+
+	if (busy_poll == 0)
+		return(poll(fds, 1, pollto));
+	gettimeofday(&start, NULL);
+	last = start;
+	for (;;){
+		if ((ret = poll(fds, 1, 0)) != 0)
+			return(ret);
+		gettimeofday(&now, NULL);
+		hist_add(&noise_gap, DELTATV64(now, last));
+		last = now;
+		if (pollto >= 0 && DELTATV64(now, start) >= pollto * 1000LL)
+			return(0);
+	}
+}
+
+void reader(int pollto)
+{
+	static uint8_t		buffer[65536];
+	ssize_t			packet_length;
+	struct timeval		timestamp;
+	struct pollfd		fds={sock,POLLIN,0};
+	struct msghdr		msg;
+	struct iovec		iov = { buffer, sizeof(buffer) };
+	struct cmsghdr		*cm;
+	char			cbuf[CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(uint32_t))];
+	ssize_t			off, seg;
+
+	if (raw_ifname != NULL){
+		/*
+		 * TPACKET_V3 wakes us a block at a time, not per reply, so
+		 * don't sit out a block timeout right after sending.
+		 */
+		if (raw_flush() > 0)
+			pollto = 0;
+		fds.fd = raw_fd();
+		while (rx_poll(&fds, pollto) > 0 && raw_recv(process_packet) > 0)
+			pollto = 0;
+		return;
+	}
+
+	if (gso_n){
+		if (gso_fresh && gso_n < GSO_MAX_SEGS){
+			gso_fresh = 0;
+			pollto = 0;
+		}
+		else
+			gso_flush();
+	}
+	while (rx_poll(&fds, pollto) >  0){
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = cbuf;
+		msg.msg_controllen = sizeof(cbuf);
+		packet_length = recvmsg(sock, &msg, 0);
+#ifdef linux
+		ioctl(sock, SIOCGSTAMP, &timestamp);
+#else
+		gettimeofday(&timestamp, NULL);
+#endif
+		if (packet_length < 0 ){
+			fprintf(logfp, "Packet receive error\n");
+			return;
+		}
+		pollto = 0;
+		//printf("Packet length %d\n", packet_length);
+		seg = packet_length;
+		for (cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)){
+			if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO)
+				seg = *((int *) CMSG_DATA(cm));
+#ifdef SO_RXQ_OVFL
+			else if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SO_RXQ_OVFL)
+				rxq_ovfl = *((uint32_t *) CMSG_DATA(cm));
+#endif
+		}
+		gro_reads += use_gro;
+		/* A GRO read holds several replies of seg bytes, the last maybe short */
+		for (off = 0; off < packet_length; off += seg){
+			process_packet(buffer + off, &timestamp,
+				packet_length - off < seg ? packet_length - off : seg);
+			gro_datagrams += use_gro;
+		}
+	}
+	if (fds.revents & (POLLERR|POLLNVAL)) {
+		fprintf(stderr,"reader: poll socket error\n");
+	}
+	return;
+}
+
+int addoption(int option_no, char *hexdata)
+{
+    int i;
+    int datalen = strlen(hexdata);
+    char *data;
+    struct option_st *opt;
+
+    if (datalen % 2 != 0) {
+	fprintf(stderr, "Odd number of hex chars\n");
+	return -1;
+    }
+
+    datalen /= 2;
+    data = malloc(datalen);
+
+    if (strspn(hexdata, "0123456789abcdefABCDEF") != datalen * 2
+	|| datalen > 255)
+    {
+	fprintf(stderr, "Illegal hex chars or too long (max 255)\n");
+	return -1;
+    }
+
+    nextraoptions++;
+
+    extraoptions = realloc(extraoptions,
+			   nextraoptions * sizeof(struct option_st *));
+
+    opt = malloc(sizeof(struct option_st));
+
+    extraoptions[nextraoptions - 1] = opt;
+
+    opt->option_no = option_no;
+    opt->data_len = datalen;
+    opt->data = data;
+
+    for (i = 0; hexdata[i]; i += 2) {
+	int x;
+
+	sscanf(hexdata + i, "%2x", &x);
+
+	*data++ = (char)(x & 0377);
+    }
+
+    return 0;
+}
+void getmac(uint8_t * s)
+{
+    int carry = 5;
+    int i1, i2;
+
+    if (use_sequential_mac) {
+           if (s)
+                  memcpy(s, firstmac, 6);
+           while (carry >= 0) {
+                  if (firstmac[carry] == 0xFF)
+                         firstmac[carry--] = 0;
+                  else {
+                         firstmac[carry]++;
+                         return;
+                  }
+           }
+           return;
+    }
+    if (s) {
+           i1 = rand();
+           i2 = rand();
+           memcpy(s, &i1, 4);
+           memcpy(s + 4, &i2, 2);
+    }
+}
+int get_tokens(char *cp, char **tokes, int maxtokes)
+{
+    int n = 0;
+    if (cp == NULL)
+           return (0);
+    /* Eat any leading whitespace */
+    while (*cp == ' ' && cp != '\0')
+           cp++;
+
+    if (*cp == '\0')
+           return (0);
+    tokes[0] = cp;
+    while (*cp != '\0' && *cp != '\n') {
+           if (*cp == ' ' || *cp == '\t') {
+                  *(cp++) = '\0';
+                  while (*cp != '\0' && (*cp == ' ' || *cp == '\t'))
+                         cp++;
+                  if (++n < maxtokes)
+                         tokes[n] = cp;
+                  else
+                         return (0);
+           }
+           else
+                  cp++;
+    }
+    *cp = '\0';
+    return (n + 1);
+}
+void print_lease( FILE *fp, dhcp_session_t *session, struct in6_addr *sa)
+{
+
+	int i;
+
+        static char addr[INET6_ADDRSTRLEN];
+        fprintf(fp,
+                "%02x:%02x:%02x:%02x:%02x:%02x %u ",
+                session->mac[0], session->mac[1],
+                session->mac[2], session->mac[3],
+                session->mac[4], session->mac[5], session->ia[0].iaid);
+
+	if (memcmp(&session->ia[0].ipaddr, &in6addr_any, sizeof(struct in6_addr))){
+        	fprintf(fp,"%s", inet_ntop(AF_INET6, &session->ia[0].ipaddr, addr, INET6_ADDRSTRLEN));
+		if (session->ia[0].prefix_len)
+        		fprintf(fp,"/%u ", session->ia[0].prefix_len);
+		else
+			fputc(' ', fp);
+	}
+	else
+		fputs("- ", fp);
+
+	if (session->serverid[0] != 0xff){
+		for (i=0; i < session->serverid_len; i++)
+			fprintf(fp, "%02x", session->serverid[i]);
+	}
+
+	if (session->hostname[0])
+		fprintf(fp, " %s ", session->hostname);
+	else 
+		fprintf(fp, " - ");
+
+	if (memcmp(sa, &in6addr_any, sizeof(struct in6_addr)))
+		fprintf(fp, " %s ", inet_ntop(AF_INET6, sa, addr, INET6_ADDRSTRLEN));
+	else
+		fprintf(fp, " - ");
+
+	//fprintf(stderr,"print_lease: Received IA: %u\n", session->recv_ia);
+	if (session->recv_ia > 1){
+		for (i=1; i < session->recv_ia; i++){
+			fprintf(fp, "IA: %u %s", session->ia[i].iaid,
+				inet_ntop(AF_INET6, &session->ia[i].ipaddr, addr, INET6_ADDRSTRLEN));
+			if (session->ia[i].prefix_len)
+        			fprintf(fp,"/%u ", session->ia[0].prefix_len);
+			else
+				fputc(' ', fp);
+		}
+	}
+	fputc('\n', fp);		
+                
+}
+/* I guess this can be an FQDN or unqualified hostname */
+int pack_client_fqdn(uint8_t *options, char *hostname)
+{
+	int offset=0;
+	*((uint16_t *)(options + offset)) = htons(D6O_CLIENT_FQDN);
+	offset += 4;
+	if (server_should_ddns)
+		options[offset] = 1; //S=1,O=0,N=0
+	else
+		options[offset] = 4; //S=1,O=0,N=0
+	offset++;
+	offset += encode_domain(hostname, options + offset);
+	*((uint16_t *)(options + 2)) = htons(offset - 4);
+	return(offset);
+}
+/* DUID-LLT from the client MAC */
+int pack_client_id(uint8_t *options, uint8_t *mac)
+{
+	*((uint16_t *) options) = htons(D6O_CLIENTID);
+	*((uint16_t *) (options + 2)) = htons(DUID_LLT_LEN);
+	*((uint16_t *) (options + 4)) = htons(1);
+	*((uint16_t *) (options + 6)) = htons(1);
+	memset(options + 8, 0x88, 4);
+	memcpy(options + 12, mac, 6);
+	return(4 + DUID_LLT_LEN);
+}
+/* SERVERID, once the session has one */
+int pack_server_id(uint8_t *options, dhcp_session_t *session)
+{
+	if (session->serverid[0] == 0xff)
+		return(0);
+	*((uint16_t *) options) = htons(D6O_SERVERID);
+	*((uint16_t *) (options + 2)) = htons(session->serverid_len);
+	memcpy(options + 4, session->serverid, session->serverid_len);
+	return(4 + session->serverid_len);
+}
+/* Hundredths of a second since the exchange began, 0 on the first send */
+int pack_elapsed_time(uint8_t *options, dhcp_session_t *session)
+{
+	*((uint16_t *) options) = htons(D6O_ELAPSED_TIME);
+	*((uint16_t *) (options + 2)) = htons(2);
+	*((uint16_t *) (options + 4)) = htons(session->elapsed);
+	return(6);
+}
+int encode_domain( char *domain, uint8_t *buf)
+{
+        uint8_t *plen;
+        int len=1;
 
-	while ((ch = getopt(argc, argv, "a:Ac:ed:D:f:h:H:i:I:l:mn:No:O:pPq:rR:s:S:t:u:vz")) != -1){
-		switch (ch) {
-           	case 'a':
-                	if (strchr(optarg, ':') == NULL) {
-                			val = atoll(optarg);
-                  			for (i = 0; i < 6; i++)
-                  				firstmac[5 - i] = (val & (0x00ffULL << i * 8)) >> i * 8;
-                  		}
-                		else {
-                			if (sscanf(optarg, "%2x:%2x:%2x:%2x:%2x:%2x",
-                			temp, temp + 1, temp + 2, temp + 3, temp + 4, temp + 5) < 6) {
-                 			fprintf(stderr, "\nBad MAC Address in -a option: %s\n", optarg);
-                 			usage();
-                 		}
-                  		for (i = 0; i < 6; i++)
-                  			firstmac[i] = (char) temp[i];
-                  	}
-                  	use_sequential_mac = 1;
-                  	break;
-		case 'A':
-			fprintf(stderr,"Will simulate relay agent\n");
-			use_relay = 1;
-			break;
-		case 'c':
-                        if ( inet_pton(AF_INET6, optarg, &srcaddr) == 0 ){
-                                fprintf(stderr,"Invalid source IPV6 address %s\n",
-                                        optarg);
-                                exit(1);
+        plen = buf;
+        buf++;
+        *plen = 0;
+        while (*domain != '\0'){
+                if (*domain == '.'){
+                        if (*(domain + 1) == '\0')
+                                break;
+                        else {
+                                plen = buf++;
+                                *plen = 0;
+                                domain++;
+                                len++;
+                                continue;
                         }
-                        break;
-                case 'd':
-			send_delay = atol(optarg);
-			break;
-                case 'D':
-			update_domain = strdup(optarg);
-			fprintf(stderr,"Using %s for DDNS updates\n", update_domain);
-			break;
-		case 'e':
-			send_decline = 1;
-			break;
-		case 'f':
-			input_file = strdup(optarg);
-			break;
-		case 'h':
-			if (*optarg == 'N' || *optarg == 'n')
-				server_should_ddns = 0;
-			send_hostname = 1;
-			break;
-		case 'H':
-			if (*optarg == 'N' || *optarg == 'n')
-				server_should_ddns = 0;
-			random_hostname = 1;
-			send_hostname = 1;
-			break;
-		case 'i':
-			if (add_servers(optarg) < 0)
-				exit(1);
-			break;
-		case 'I':
-		        nrequests = get_tokens(optarg, tokes, MAX_TOKENS);
-			info_requests = malloc(nrequests * sizeof(uint16_t));
-			assert(info_requests);
-			for (i=0; i < nrequests; i++)
-				info_requests[i] = htons(atoi(tokes[i]));
-			break;
-		case 'l':
-			logfile = strdup(optarg);
-			break;
-		case 'm':
-                	use_sequential_mac = 1;
-                	break;
-		case 'n':
-			number_requests = atol(optarg);
-			break;
-		case 'N':
-			send_until_answered = 1;
-			break;
-		case 'o':
-			output_file = strdup(optarg);
-			break;
-		case 'O':
-			{
-				int option;
-				char *s;
+                }
+                *(buf++) = *(domain++);
+                (*plen)++;
+                len++;
+        }
+        *buf=0;
+        return(len+1);
+}
+void usage()
+{
+	fprintf(stderr,
+"Usage: dras6 -i <server IP> [-f <input-lease-file>] [-o <output-lease-file>]\n"
+"	[-A] -O <dec option-no>:<hex data>] [-l <logfile>] [-t <timeout>] [-a <mac>]\n"
+"	[-n <number requests>] [-q <max outstanding> [-R <retransmits>]\n"
+"	[-d <delay>] [-c <relay agent IP>] [-e|mN|p|r|w] [-I <requested options>]\n"
+"	[-s <renew|inform|confirm|decline|rebind>] [-S <sol|req|ren>,opno1,opno2,...]\n\n");
 
-				option = strtol(optarg, &s, 0);
-				if (option == 0xff || s[0] != ':' || s[1] == '\0')
-					usage();
+	fprintf(stderr,
+"	-a Starting MAC address\n"
+"	-A Simulate relay agent\n"
+"	-d Delay before sending next packet\n"
+"	-D DNS zone for CLIENT_FQDN option\n"
+"	-e Send decline after ACK received\n"
+"	-f Input file with ClientID/IPv6 leases\n"
+"       Format:  <MAC> <IAID> <IPADDR|\"-\">[/<prefix>] <Server DUID> [<hostname|FQDN>]\n"
+"       e.g.: 00:00:00:00:00:01 1 2001:db8:a22:1f00::64 0001000114da166c00259003467d h788047619869273952\n"
+"	-h Add CLIENT_FQDN option\n"
+"	-H Add CLIENT_FQDN optionwith random hostnames\n"
+"	-i Server IP Address (multiple servers are separated by commas)\n"
+"	-I List of option numbers to request (separated by spaces, in quotes)\n"
+"	e.g.: -I \"11 34 22\"\n"
+"	-l Output logfile (default: stderr)\n"
+"	-m Start at MAC 0\n"
+"	-n Number of requests\n"
+"	-N Retransmit until answer received\n"
+"	-o Output lease file\n"
+"	-O Send option <option-no> (dec) with data <hex data> (w/o length)\n"
+"	-p Ping mode: end after ADVERTISE received\n"
+"	-P Prefix request (IAPREFIX)\n"
+"	-q Maximum outstanding requests\n"
+"	-r Send release after ACK received\n"
+"	-R Number of retransmits (default 0)\n"
+"	-s Start from RENEW|REQUEST|INFORM|CONFIRM with -f <file> option\n"
+"	-t Timeout on requests (ms)\n"
+"	-v Verbose output\n"
+"	-z Use rapid commit option\n"
+"	--rate <n> Start n sessions/sec; latency is also reported from each\n"
+"	   session's intended send time (coordinated omission corrected)\n"
+"	--lifecycle <secs> Keep -n clients (or the -f leases) bound for secs,\n"
+"	   renewing at T1, rebinding at T2 and re-soliciting on expiry\n"
+"	--compress <factor> Divide server T1/T2/lifetimes by factor\n"
+"	--renewals <n> End each lease after n renewals (default: never)\n"
+"	--lease-end <release|expire> How a lease ends after --renewals\n"
+"	--herd <ms> Bring all -f clients back within ms, as after an outage\n"
+"	--herd-msg <confirm|rebind|solicit> What herd clients send (default confirm)\n"
+"	--mix <flow[:weight|@rate],...> Run several -s flows at once, e.g.\n"
+"	   solicit:10,renew:70,inform:15,release:5 or renew@500,solicit:1\n"
+"	--scenario <file> Run the phases in file in one process, e.g.\n"
+"	   phase acquire flow=solicit count=10000 concurrency=200\n"
+"	   phase renew flow=renew rate=500 duration=60\n"
+"	   phase release flow=release\n"
+"	--duration <secs> Soak: keep starting sessions for secs, reusing -n\n"
+"	   clients (or the -f leases, read as a stream) round robin\n"
+"	--interval <secs> Print rates and latency every secs (default 60\n"
+"	   with --duration)\n"
+"	--adaptive <ms> Grow each server's window (up to -q) while replies\n"
+"	   take under ms, halve it on a timeout or slower reply\n"
+"	--rfc-retrans Retransmit with RFC 8415 backoff and limits per message\n"
+"	   type instead of -t/-R/-N (SOLICIT and INFORM never give up)\n"
+"	--retrans <msg:irt[/mrt[/mrc[/mrd]]],...> Override the RFC 8415\n"
+"	   parameters (ms, 0 = no limit), e.g. solicit:1000/120000/5\n"
+"	--tx-budget <class:n,...> Cap sends/sec per class: new (SOLICIT,\n"
+"	   INFORM, CONFIRM), followup (other messages), retransmit,\n"
+"	   release; held sends wait for budget\n"
+"	--tx-weight <class:w,...> Split --tx-rate <n> sends/sec by weight\n"
+"	--profile <file> Options to send per message type, e.g.\n"
+"	   msg solicit,request\n"
+"	   option clientid / option ia / option VENDOR_CLASS u32:311 str16:\"MSFT 5.0\"\n"
+"	   option 15 str16:\"site-a\" / option 37 u32:9 $mac $counter\n"
+"	--raw <ifname>[,<server MAC>] Send and receive Ethernet frames on ifname,\n"
+"	   each client from its own MAC and EUI-64 link-local address (or\n"
+"	   the relay address with -A).  The server MAC is needed unless -i\n"
+"	   is multicast, e.g. -i ff02::1:2 --raw eth1\n"
+"	--xdp <skb|copy|zc> Use AF_XDP on queue 0 of the --raw interface:\n"
+"	   generic XDP, driver XDP copying, or driver zero copy.  Neighbor\n"
+"	   Solicitations for live clients go to dras6, other ICMPv6 to the host\n"
+"	--gso Send runs of same-sized packets to a server as one UDP_SEGMENT send\n"
+"	--gro Receive coalesced replies with UDP_GRO and split them\n"
+"	--busy-poll <usecs> Spin for replies instead of sleeping, with the\n"
+"	   socket's SO_BUSY_POLL set to usecs; best with --cpu on an isolated\n"
+"	   core.  The report's generator noise lines give the floor under\n"
+"	   the latency figures\n"
+"	--cpu <n> Run on CPU n\n"
+"	--breakdown <dim,...> Reply latency and outcomes per combination of\n"
+"	   server, msg (message type), ia (IAs requested), iatype (NA/PD),\n"
+"	   relay, fqdn and flow (--mix), e.g. --breakdown server,ia,iatype\n"
+"	--json <file> Also write the final report as JSON ('-' for stdout)\n"
+"	--slo <check:limit,...> Fail the run past these limits: rate (min\n"
+"	   leases/sec), adv_p99 and reply_p99 (ms), timeouts and nak (%% of\n"
+"	   sent, %% of status codes), drops (lost locally) or a status code\n"
+"	   name (%%), e.g. --slo rate:5000,reply_p99:20,NoAddrsAvail:0.1\n"
+"	   Exit status bits: 1 failures, 2 rate, 4 latency, 8 timeouts,\n"
+"	   16 naks, 32 drops\n");
 
-				if (addoption(option, s + 1) < 0)
-					usage();
+	exit(1);
+}
+void decode_state(uint32_t state)
+{
+
+	if ( state == 0){
+		fprintf(logfp,"Unallocated\n");
+		return;
+	}
+	if (state & SESSION_ALLOCATED)
+		fprintf(logfp,"SESSION_ALLOCATED|");
+	if (state & SOLICIT_SENT)
+		fprintf(logfp,"SOLICIT_SENT|");
+	if (state & RAPID_SOLICIT_SENT)
+		fprintf(logfp,"RAPID_SOLICIT_SENT|");
+	if (state & RENEW_SENT)
+		fprintf(logfp,"RENEW_SENT|");
+	if (state & REQUEST_SENT)
+		fprintf(logfp,"REQUEST_SENT|");
+	if (state & RELEASE_SENT)
+		fprintf(logfp,"RELEASE_SENT|");
+	if (state & DECLINE_SENT)
+		fprintf(logfp,"DECLINE_SENT|");
+	if (state & INFORM_SENT)
+		fprintf(logfp,"INFORM_SENT|");
+	if (state & REBIND_SENT)
+		fprintf(logfp,"REBIND_SENT|");
+	if (state & CONFIRM_SENT)
+		fprintf(logfp,"CONFIRM_SENT|");
+	if (state & SOLICIT_ACK)
+		fprintf(logfp,"SOLICIT_ACK|");
+	if (state & SOLICIT_NAK)
+		fprintf(logfp,"SOLICIT_NAK|");
+	if (state & REQUEST_ACK)
+		fprintf(logfp,"REQUEST_ACK|");
+	if (state & REQUEST_NAK)
+		fprintf(logfp,"REQUEST_NAK|");
+	if (state & RENEW_ACK)
+		fprintf(logfp,"RENEW_ACK|");
+	if (state & RENEW_NAK)
+		fprintf(logfp,"RENEW_NAK|");
+	if (state & REBIND_ACK)
+		fprintf(logfp,"REBIND_ACK|");
+	if (state & REBIND_NAK)
+		fprintf(logfp,"REBIND_NAK|");
+	if (state & RELEASE_ACK)
+		fprintf(logfp,"RELEASE_ACK|");
+	if (state & RELEASE_NAK)
+		fprintf(logfp,"RELEASE_NAK|");
+	if (state & DECLINE_ACK)
+		fprintf(logfp,"DECLINE_ACK|");
+	if (state & DECLINE_NAK)
+		fprintf(logfp,"DECLINE_NAK|");
+	if (state & INFORM_ACK)
+		fprintf(logfp,"INFORM_ACK|");
+	if (state & INFORM_NAK)
+		fprintf(logfp,"INFORM_NAK|");
+	if (state & CONFIRM_ACK)
+		fprintf(logfp,"CONFIRM_ACK|");
+	if (state & CONFIRM_NAK)
+		fprintf(logfp,"CONFIRM_NAK|");
+	if (state & PACKET_ERROR)
+		fprintf(logfp,"PACKET_ERROR|");
+	fputs("\n", logfp);
+	return;
+}
+int parse_opt_seq(char *s)
+{
+	
+	char *cp;
+	uint16_t  *seqptr=NULL;
+	if ((cp=strtok(s,", ")) == NULL){
+		fprintf(stderr,"Syntax error opt seq: %s\n", s);
+		return(-1);
+	}
+	while (cp != NULL){
+		if (*cp >= '0' && *cp <= '9'){
+			if (seqptr == NULL){
+				fprintf(stderr,"Need to define packet type (sol|req|ren) in option sequence\n");
+				return(-1);
 			}
-			break;
-		case 'p':
-			dhcp_ping = 1;
-			break;
-		case 'P':
-			request_prefix = 1;
-			break;
-		case 'q':
-			max_sessions = atol(optarg);
-			break;
-		case 'r':
-			send_release = 1;
-			break;
-		case 'R':
-			retransmit = atol(optarg);
-			break;
-		case 's':
-			if (!strcasecmp(optarg,"solicit"))
-				start_from = DHCPV6_SOLICIT;
-			else if (!strcasecmp(optarg,"request"))
-				start_from = DHCPV6_REQUEST;
-			else if (!strcasecmp(optarg,"confirm"))
-				start_from = DHCPV6_CONFIRM;
-			else if (!strcasecmp(optarg,"renew"))
-				start_from = DHCPV6_RENEW;
-			else if (!strcasecmp(optarg,"rebind"))
-				start_from = DHCPV6_REBIND;
-			else if (!strcasecmp(optarg,"release"))
-				start_from = DHCPV6_RELEASE;
-			else if (!strcasecmp(optarg,"decline"))
-				start_from = DHCPV6_DECLINE;
-			else if (!strcasecmp(optarg,"inform"))
-				start_from = DHCPV6_INFORMATION_REQUEST;
+
+			*seqptr = atoi(cp);
+
+			if (*seqptr == D6O_CLIENT_FQDN){
+				server_should_ddns = 0;
+				random_hostname = 1;
+				send_hostname = 1;
+			}
+
+			seqptr++;
+			
+		}
+		else {
+			if (strncasecmp(cp,"sol",3) == 0)
+				seqptr=sol_optseq;
+			else if (strncasecmp(cp,"req",3) == 0)
+				seqptr=req_optseq;
+			else if (strncasecmp(cp,"ren",3) == 0)
+				seqptr=ren_optseq;
 			else {
-				fprintf(stderr,"Unknown start_from: %s\n", optarg);
-				usage();
+				fprintf(stderr,"Bad token in DHCP option sequence: %s\n", cp);
+				return(-1);
 			}
-			break;
-		case 'S':
-			if (parse_opt_seq(optarg) < 0)
-				usage();
-			opt_seq=1;
-			break;
-		case 't':
-			timeout = 1000*atol(optarg);
-			break;
-		case 'u':
-			num_per_mac = atol(optarg);
-			break;
-		case 'v':
-			verbose = 1;
-			break;
-/*
-		case 'w':
-			renew_lease =1;
-			start_from = DHCPV6_RENEW;
-			break;
-*/
-		case 'z':
-			rapid_commit=1;
-			break;
-		case '?':
-		default:
-                     usage();
+			while (*seqptr)
+				seqptr++;
 		}
+		cp=strtok(NULL,", ");
+		
 	}
-/*
-	if (send_info_request && (renew_lease || send_decline || send_release)) {
-		fprintf(stderr, "Information-Request doesn't grab IP address\n");
-		usage();
+	fprintf(stderr,"\nSolicit Options: ");
+	if (*sol_optseq){
+		for (seqptr=sol_optseq; *seqptr; seqptr++)
+			fprintf(stderr,"%u ", *seqptr);
 	}
-*/
-	/* require server IP address and lease file */
-	if (servers == NULL){
-		fprintf(stderr, "No servers defined. Using FF05::1:3\n");
-		add_servers("ff05::1:3");
-		//usage();
+	if (*req_optseq){
+		fprintf(stderr,"\nRequest Options: ");
+		for (seqptr=req_optseq; *seqptr; seqptr++)
+			fprintf(stderr,"%u ", *seqptr);
 	}
+	if (*ren_optseq){
+		fprintf(stderr,"\nRenew Options: ");
+		for (seqptr=ren_optseq; *seqptr; seqptr++)
+			fprintf(stderr,"%u ", *seqptr);
+		fprintf(stderr,"\n");
+	}		
+	return(0);
 }
-
-int add_servers(const char *s)
+/*
+    Option profiles: --profile files and -S sequences are compiled once
+    into a bytecode program per message type, see the OP_ codes.  Fixed
+    bytes, including whole options with no $ substitutions, collapse into
+    OP_BYTES runs, so the send path is mostly memcpy.
+*/
+void prog_emit(profile_t *p, uint8_t op, const void *arg, int n)
 {
-	const char *p1 = s;
-	dhcp_server_t *sp = NULL;
-
-	char buffer[INET6_ADDRSTRLEN];
-	int len;
-
-	assert(s != NULL);
-	while (*p1 != '\0'){
-		while (*p1 != ',' && *p1 != '\0')
-			p1++;
-		len = p1 - s;
-		if (len == 0 || len + 1 > sizeof(buffer))
-			return(-1);
-		strncpy(buffer, s, len);
-		s = p1+1;
-		buffer[len]='\0';
-
-		if ( *p1 != '\0')
-			p1++;
+	uint32_t	run;
 
-		sp = malloc(sizeof(dhcp_server_t));
-		assert(sp);
-		memset(sp,'\0', sizeof(dhcp_server_t));
-		sp->stats.advertise_latency_min=10000000;
-		sp->stats.reply_latency_min=10000000;
-		sp->sa.sin6_port = htons(DHCP6_SERVER_PORT);
-		sp->sa.sin6_family = AF_INET6;
-		if (inet_pton(AF_INET6, buffer, &sp->sa.sin6_addr) == 0){
-			fprintf(stderr,"Invalid address %s\n", buffer);
+	if (p->len + n + 4 > p->size){
+		p->size = 2 * (p->len + n + 4) + 64;
+		p->code = realloc(p->code, p->size);
+		assert(p->code != NULL);
+	}
+	if (op == OP_BYTES && p->len && p->last >= 0){
+		run = p->code[p->last + 1] << 8 | p->code[p->last + 2];
+		if (run + n <= 0xffff){
+			run += n;
+			p->code[p->last + 1] = run >> 8;
+			p->code[p->last + 2] = run;
+			memcpy(p->code + p->len, arg, n);
+			p->len += n;
+			return;
+		}
+	}
+	p->last = op == OP_BYTES ? (int) p->len : -1;
+	p->code[p->len++] = op;
+	if (op == OP_BYTES){
+		p->code[p->len++] = n >> 8;
+		p->code[p->len++] = n;
+	}
+	memcpy(p->code + p->len, arg, n);
+	p->len += n;
+}
+/* One literal profile value into out; its length, or -1 */
+int profile_value(char *tok, uint8_t *out)
+{
+	char		*cp, *end;
+	unsigned long	v;
+	int		n = 0, prefix = 0;
+
+	for (cp = tok; *cp; cp++)
+		if (*cp == '\001')
+			*cp = ' ';
+	if (!strncasecmp(tok, "u8:", 3) || !strncasecmp(tok, "u16:", 4) ||
+			!strncasecmp(tok, "u32:", 4)){
+		v = strtoul(strchr(tok, ':') + 1, &end, 0);
+		if (*end != '\0')
 			return(-1);
+		n = tok[1] == '8' ? 1 : tok[1] == '1' ? 2 : 4;
+		for (prefix = n; prefix > 0; prefix--, v >>= 8)
+			out[prefix - 1] = v;
+		return(n);
+	}
+	if (!strncasecmp(tok, "hex:", 4) || !strncasecmp(tok, "0x", 2)){
+		for (cp = tok + (tok[0] == '0' ? 2 : 4); *cp; cp += 2){
+			if (sscanf(cp, "%2lx", &v) != 1 || cp[1] == '\0')
+				return(-1);
+			out[n++] = v;
 		}
-		sp->next = servers;
-		servers = sp;
-		num_servers++;
+		return(n);
 	}
-	return(0);
+	if (!strncasecmp(tok, "str16:", 6)){
+		tok += 6;
+		prefix = 2;
+	}
+	if (*tok != '"' || (n = strlen(tok)) < 2 || tok[n - 1] != '"')
+		return(-1);
+	n -= 2;
+	memcpy(out + prefix, tok + 1, n);
+	if (prefix){
+		out[0] = n >> 8;
+		out[1] = n;
+	}
+	return(n + prefix);
 }
-
-void print_packet(uint32_t packet_len, struct dhcpv6_packet *p, const char *prefix)
+/* Option code from a number or an optionstrings name; 0 if unknown */
+int option_by_name(const char *name)
 {
+	unsigned int	i;
 
-	int i = 0, option_len = 0, suboption_len = 0;
-	uint16_t option_code = 0, suboption_code = 0;
-
-	fprintf(logfp, "%sPacket Type %d (%s), len = %d, ", prefix, p->msg_type, typestrings[p->msg_type-1], packet_len);
-	fprintf(logfp, "txn: [%d %d %d]\n", p->transaction_id[0], p->transaction_id[1], p->transaction_id[2]);
-
-	unsigned char *option = p->options;
-	while (option < p->options + packet_len - 4)
-	{
-		option_code = ntohs(*((uint16_t *) option));
-		assert(option_code <= sizeof(optionstrings));
-
-		option_len = ntohs(*((uint16_t *) (option + 2)));
-
-		fprintf(logfp, "   Option %d (%s), len = %d [", option_code, optionstrings[option_code-1], option_len);
-		for (i = 0; i < option_len; i++)
-			fprintf(logfp, " %d", option[i + 4]);
-
-		fprintf(logfp, " ]\n");
-
-		/* expand IA_NA/IA_TA/IA_PD options */
-		if (option_code == D6O_IA_NA || option_code == D6O_IA_TA || option_code == D6O_IA_PD) {
-			unsigned char *suboption = option + 16;
-			//unsigned char *suboption = option + 8;
-			while (suboption < option + option_len + 4) {
-				suboption_code = ntohs(*((uint16_t *) suboption));
-				suboption_len = ntohs(*((uint16_t *) (suboption + 2)));
-				if (!suboption_code) {
-					suboption += 4;
-					continue;
-				}
-				fprintf(logfp, "      Option %d (%s), len = %d [", 
-					suboption_code, optionstrings[suboption_code-1], suboption_len);
-				for (i = 0; i < suboption_len; i++)
-					fprintf(logfp, " %d", suboption[i + 4]);
-				fprintf(logfp, " ]\n");
-
-				suboption += suboption_len + 4;
+	if (*name >= '0' && *name <= '9')
+		return(atoi(name));
+	for (i = 0; i < sizeof(optionstrings) / sizeof(optionstrings[0]); i++)
+		if (!strcasecmp(name, optionstrings[i]))
+			return(i + 1);
+	return(0);
+}
+/* Compile "name [value ...]" onto program p */
+int profile_compile(profile_t *p, char **tokes, int ntokes)
+{
+	static const struct {
+		const char	*name;
+		uint8_t		op;
+	} builtins[] = {
+		{"clientid", OP_CLIENTID}, {"elapsed", OP_ELAPSED},
+		{"ia", OP_IA}, {"serverid", OP_SERVERID}, {"fqdn", OP_FQDN},
+		{"oro", OP_ORO}, {NULL, 0}
+	};
+	static const struct {
+		const char	*name;
+		uint8_t		op;
+	} subs[] = {
+		{"$mac", OP_MAC}, {"$counter", OP_COUNTER},
+		{"$random", OP_RANDOM}, {"$hostname", OP_HOSTNAME}, {NULL, 0}
+	};
+	uint8_t		buf[1024];
+	uint16_t	code;
+	char		*alias[2];
+	int		i, j, n, len = 4, dynamic = 0;
+
+	if (ntokes == 1){
+		for (i = 0; builtins[i].name != NULL; i++)
+			if (!strcasecmp(tokes[0], builtins[i].name)){
+				prog_emit(p, builtins[i].op, NULL, 0);
+				return(0);
 			}
+		/* the caller's tokens compile again for the next msg type */
+		if (!strcasecmp(tokes[0], "rapid")){
+			alias[0] = "RAPID_COMMIT";
+			tokes = alias;
+		}
+		else if (!strcasecmp(tokes[0], "status")){
+			alias[0] = "STATUS_CODE";
+			alias[1] = "u16:0";
+			tokes = alias;
+			ntokes = 2;
 		}
-
-		/* option size + option-len size */
-		option += option_len + 4;
 	}
-	fprintf(logfp, "\n");
+	if ((code = option_by_name(tokes[0])) == 0){
+		fprintf(stderr,"Unknown option %s\n", tokes[0]);
+		return(-1);
+	}
+	for (i = 1; i < ntokes; i++)
+		if (*tokes[i] == '$')
+			dynamic = 1;
+	*((uint16_t *) buf) = htons(code);
+	if (dynamic)
+		prog_emit(p, OP_OPEN, buf, 2);
+	for (i = 1; i < ntokes; i++){
+		if (*tokes[i] == '$'){
+			for (j = 0; subs[j].name != NULL; j++)
+				if (!strcasecmp(tokes[i], subs[j].name))
+					break;
+			if (subs[j].name == NULL){
+				fprintf(stderr,"Unknown substitution %s\n", tokes[i]);
+				return(-1);
+			}
+			prog_emit(p, subs[j].op, NULL, 0);
+			continue;
+		}
+		if (len + strlen(tokes[i]) + 2 > sizeof(buf) ||
+				(n = profile_value(tokes[i], buf + len)) < 0){
+			fprintf(stderr,"Bad value %s\n", tokes[i]);
+			return(-1);
+		}
+		if (dynamic)
+			prog_emit(p, OP_BYTES, buf + len, n);
+		else
+			len += n;
+	}
+	if (dynamic)
+		prog_emit(p, OP_CLOSE, NULL, 0);
+	else {
+		*((uint16_t *) (buf + 2)) = htons(len - 4);
+		prog_emit(p, OP_BYTES, buf, len);
+	}
+	return(0);
 }
-
-#define MAX_CLIENTID_LEN 100
-uint32_t read_lease_data(lease_data_t **leases)
+/*
+    --profile file:
+	msg <type>[,<type>...]|all
+	option <name|code> [value ...]
+    See profile.example.
+*/
+int profile_parse(const char *file)
 {
-	char		buf[1024];
-	int		ret, i;
-	int		ntokes;
-	char		*tokes[MAX_TOKENS];
-	char		*cp;
-	int		temp[6];
-	uint8_t		mac[6], prefix_len;
-	uint32_t	read_count = 0;
-	uint32_t	iaid=0;
-	struct in6_addr	ipaddr;
-	uint8_t		a,b;
-	int		lineno = 0;
-	lease_data_t	*lease = *leases;
-	FILE		*fpin;
+	FILE		*fp;
+	char		buf[1024], *tokes[MAX_TOKENS + 1], *cp;
+	int		ntokes, type, lineno = 0, quoted;
+	uint32_t	types = 0;
 
-        fpin = fopen(input_file, "r");
-	if (fpin == NULL){
-		fprintf(logfp,"Could not open input file: %s\n",input_file);
-		return(0);
+	if ((fp = fopen(file, "r")) == NULL){
+		fprintf(stderr,"Could not open profile: %s\n", file);
+		return(-1);
 	}
-	while ( fgets(buf, sizeof(buf), fpin) != NULL){
+	while (fgets(buf, sizeof(buf), fp) != NULL){
 		lineno++;
-		if ((ntokes = get_tokens(buf, tokes, MAX_TOKENS)) < 3){
-			fprintf(logfp, "Too few tokens: %d, line %d\n", ntokes,lineno);
-			continue;
+		/* Hide blanks inside quotes from get_tokens() */
+		for (cp = buf, quoted = 0; *cp; cp++){
+			if (*cp == '"')
+				quoted = !quoted;
+			else if (quoted && (*cp == ' ' || *cp == '\t'))
+				*cp = '\001';
+			else if (*cp == '#'){
+				*cp = '\0';
+				break;
+			}
 		}
-
-           	ret = sscanf(tokes[0], "%2x:%2x:%2x:%2x:%2x:%2x", temp,
-                                 temp + 1, temp + 2, temp + 3, temp + 4, temp + 5);
-           	if (ret < 6) {
-                  	fprintf(logfp, "Line %d, MAC format error: %s\n", lineno, tokes[0]);
-                  	continue;
-           	}
-           	for (i = 0; i < 6; i++)
-                  	mac[i] = (char) temp[i];
-
-	   	ret = sscanf(tokes[1], "%u", &iaid);
-           	if (ret < 1) {
-                  	fprintf(logfp, "Line %d, IAID format error: %s\n", lineno, tokes[1]);
-                  	continue;
-           	}
-
-		prefix_len=0;
-		if ((cp=strchr(tokes[2], '/')) != NULL){
-			prefix_len = atoi(cp+1);
-			*cp ='\0';
+		for (cp = buf + strlen(buf); cp > buf && isspace((unsigned char) cp[-1]); )
+			*--cp = '\0';
+		for (cp = buf; *cp == '\t'; cp++)
+			*cp = ' ';
+		if ((ntokes = get_tokens(buf, tokes, MAX_TOKENS)) == 0 || *tokes[0] == '\0')
+			continue;
+		if (!strcasecmp(tokes[0], "msg") && ntokes == 2){
+			types = 0;
+			for (cp = strtok(tokes[1], ","); cp != NULL; cp = strtok(NULL, ",")){
+				if (!strcasecmp(cp, "all"))
+					types |= 1 << DHCPV6_SOLICIT | 1 << DHCPV6_REQUEST |
+						1 << DHCPV6_CONFIRM | 1 << DHCPV6_RENEW |
+						1 << DHCPV6_REBIND | 1 << DHCPV6_RELEASE |
+						1 << DHCPV6_DECLINE |
+						1 << DHCPV6_INFORMATION_REQUEST;
+				else if ((type = msg_type_by_name(cp)) > 0)
+					types |= 1 << type;
+				else {
+					fprintf(stderr,"%s:%d: unknown message %s\n", file, lineno, cp);
+					goto bad;
+				}
+			}
 		}
-			
-           	if (inet_pton(AF_INET6, tokes[2], &ipaddr) <= 0) {
-                  	if (*tokes[2] == '-')
-                         	ipaddr = in6addr_any;
-                  	else {
-                         	fprintf(logfp, "Line %d, format error: %s\n", lineno, tokes[2]);
-                         	continue;
-                  	}
-           	}
-
-           	if (*leases == NULL) {
-                  	*leases = calloc(1, sizeof(lease_data_t));
-                  	lease = *leases;
-           	}
-           	else {
-                  	lease->next = calloc(1, sizeof(lease_data_t));
-                  	lease = lease->next;
-           	}
-           	assert(lease != NULL);
-
-           	lease->ia[0].ipaddr = ipaddr;
-           	lease->ia[0].prefix_len = prefix_len;
-           	lease->ia[0].iaid = iaid;
-		lease->num_ia = 1;
-           	memcpy(lease->mac, mac, 6);
-           	lease->next = NULL;
-	
-	   	if (ntokes > 3){
-			lease->serverid_len = strlen(tokes[3]);
-			if ( lease->serverid_len % 2){
-				fprintf(stderr, "\tInvalid Server DUID: %s\n",
-							tokes[3]);
-				exit(1);
+		else if (!strcasecmp(tokes[0], "option") && ntokes > 1){
+			if (types == 0){
+				fprintf(stderr,"%s:%d: option before msg\n", file, lineno);
+				goto bad;
 			}
-			lease->serverid_len /= 2;
-	          	for (i=0; i < lease->serverid_len; i++){
-			  	a = *(tokes[3] + 2*i);
-			  	b = *(tokes[3] + 2*i +1);
-			  	if ( a >= '0' && a <= '9')
-					a = a - '0';
-			  	else 
-					a = 10 + a - 'a';
-	
-			  	if ( b >= '0' && b <= '9')
-					b = b - '0';
-			  	else 
-					b = 10 + b - 'a';
-		          	lease->serverid[i] = a * 16 + b;
-		  	}
-    	   	}
-	   	else
-			lease->serverid[0] = 0xff;
-
-           	if (ntokes > 4 && *tokes[4] != '-')
-                  	lease->hostname = strdup(tokes[4]);
-           	else
-                  	lease->hostname = NULL;
-
-           	if (ntokes > 5 && *tokes[5] != '-')
-           		inet_pton(AF_INET6, tokes[5], &lease->sa);
-           	else
-                  	lease->sa = in6addr_any;
-
-	    	read_count++;
-		/* Possibly Multiple IAIDs in this entry */
-		if (ntokes < 6)
-			continue;
-		for (i=6; i < ntokes - 3; i += 3){
-			if (strncasecmp(tokes[i], "IA:", 3) == 0){
-				lease->ia[lease->num_ia].iaid = atol(tokes[i+1]);
-				lease->ia[lease->num_ia].prefix_len=0;
-				if ((cp=strchr(tokes[i+2], '/')) != NULL){
-					lease->ia[lease->num_ia].prefix_len = atoi(cp+1);
-					*cp ='\0';
+			for (type = DHCPV6_SOLICIT; type <= DHCPV6_INFORMATION_REQUEST; type++)
+				if ((types & 1 << type) &&
+						profile_compile(profiles + type, tokes + 1, ntokes - 1) < 0){
+					fprintf(stderr,"%s:%d: bad option\n", file, lineno);
+					goto bad;
 				}
-           			if (inet_pton(AF_INET6, tokes[i+2], &lease->ia[lease->num_ia].ipaddr) <= 0) 
-                         		fprintf(logfp, "Line %d, format error: %s\n", lineno, tokes[i+2]);
-				else 
-					lease->num_ia++;
-                  	}
-			else 
-                         	fprintf(logfp, "Line %d, format error: %s\n", lineno, tokes[i]);
-				
-           	}
-			
-
+		}
+		else {
+			fprintf(stderr,"%s:%d: expected msg or option\n", file, lineno);
+			goto bad;
+		}
 	}
-	return(read_count);
+	fclose(fp);
+	return(0);
+bad:
+	fclose(fp);
+	return(-1);
 }
-
-struct in6_addr get_local_addr(void)
+/* Compile the -S sequences: sol for SOLICIT, ren for RENEW, req for the rest */
+int profile_from_seq(void)
 {
-
-	int		lsock;
-	struct		sockaddr_in6 ca;
-	socklen_t	calen = sizeof(ca);
-	char		ip6str[272];
-
-
-	if ((lsock=socket(AF_INET6, SOCK_DGRAM, 0)) < 0 ){
-		perror("socket:");
-		exit(1);
-	}
-	if (servers == NULL){
-		fprintf(logfp,"get_local_addr: servers list is NULL\n");
-		exit(1);
-	}
-	if ( connect(lsock, (const  struct sockaddr *) &servers->sa,
-						sizeof(servers->sa)) < 0 ){
-		perror("get_local_addr: Connect");
-		return(in6addr_any);
-	}
-	getsockname(lsock, (struct sockaddr *) &ca, &calen);
-	close(lsock);
-	fprintf(stderr, "get_local_addr: Using source address: %s\n", inet_ntop(AF_INET6, &ca.sin6_addr,
-				ip6str, sizeof(ip6str)));
-	return(ca.sin6_addr);
+	static const uint8_t	oro[] = {0, D6O_ORO, 0, 8, 0, 24, 0, 23, 0, 17, 0, 39};
+	static const uint8_t	vendor[] = {0, D6O_VENDOR_CLASS, 0, 14, 0, 0, 1, 55,
+					0, 8, 'M', 'S', 'F', 'T', ' ', '5', '.', '0'};
+	static const uint8_t	status[] = {0, D6O_STATUS_CODE, 0, 2, 0, STATUS_Success};
+	static const uint8_t	rapid[] = {0, D6O_RAPID_COMMIT, 0, 0};
+	uint8_t			buf[1024];
+	uint16_t		*seq;
+	profile_t		*p;
+	int			type, i;
+
+	for (type = DHCPV6_SOLICIT; type <= DHCPV6_INFORMATION_REQUEST; type++){
+		p = profiles + type;
+		seq = type == DHCPV6_SOLICIT ? sol_optseq :
+			type == DHCPV6_RENEW ? ren_optseq : req_optseq;
+		for (; *seq; seq++){
+			/* -O data for the option wins */
+			for (i = 0; i < nextraoptions; i++)
+				if (extraoptions[i]->option_no == *seq)
+					break;
+			if (i < nextraoptions){
+				*((uint16_t *) buf) = htons(*seq);
+				*((uint16_t *) (buf + 2)) = htons(extraoptions[i]->data_len);
+				memcpy(buf + 4, extraoptions[i]->data, extraoptions[i]->data_len);
+				prog_emit(p, OP_BYTES, buf, 4 + extraoptions[i]->data_len);
+				continue;
+			}
+			switch (*seq){
+			   case D6O_CLIENTID:
+				prog_emit(p, OP_CLIENTID, NULL, 0);
+				break;
+			   case D6O_STATUS_CODE:
+				prog_emit(p, OP_BYTES, status, sizeof(status));
+				break;
+			   case D6O_RAPID_COMMIT:
+				prog_emit(p, OP_BYTES, rapid, sizeof(rapid));
+				break;
+			   case D6O_SERVERID:
+				prog_emit(p, OP_SERVERID, NULL, 0);
+				break;
+			   case D6O_CLIENT_FQDN:
+				prog_emit(p, OP_FQDN, NULL, 0);
+				break;
+			   case D6O_ELAPSED_TIME:
+				prog_emit(p, OP_ELAPSED, NULL, 0);
+				break;
+			   case D6O_IA_NA:
+				prog_emit(p, OP_IA, NULL, 0);
+				break;
+			   case D6O_ORO:
+				prog_emit(p, OP_BYTES, oro, sizeof(oro));
+				break;
+			   case D6O_VENDOR_CLASS:
+				prog_emit(p, OP_BYTES, vendor, sizeof(vendor));
+				break;
+			   default:
+				fprintf(stderr,"Can't add option number %u\n", *seq);
+				return(-1);
+			}
+		}
+	}
+	return(0);
 }
-
-
-dhcp_session_t *find_free_session( dhcp_server_t *s)
+/* Compile --profile or -S; message types left empty use the templates */
+void profile_build(void)
 {
-	int		i;
-	dhcp_session_t	*list = s->list;
-	if ( s->active == max_sessions)
-		return(NULL);
-	for (i=0; i < max_sessions; i++){
-		if  (list[i].state == UNALLOCATED){
-			list[i].state = SESSION_ALLOCATED;
-			s->active++;
-			return(list+i);
+	uint32_t	len;
+	int		type;
+
+	if (profile_file != NULL && profile_parse(profile_file) < 0)
+		exit(1);
+	if (profile_file == NULL && opt_seq && profile_from_seq() < 0)
+		exit(1);
+	for (type = DHCPV6_SOLICIT; type <= DHCPV6_INFORMATION_REQUEST; type++){
+		if (profiles[type].len == 0)
+			continue;
+		prog_emit(profiles + type, OP_END, NULL, 0);
+		/* room for the relay header and the message header */
+		if ((len = profile_maxlen(profiles + type)) > MAX_PACKET - 38 - 4){
+			fprintf(stderr,"%s profile can build %u bytes of options, at most %u fit\n",
+				typestrings[type - 1], len, MAX_PACKET - 38 - 4);
+			exit(1);
 		}
 	}
-	return(NULL);
 }
-
-void reader(void)
+/* Worst case bytes program p writes: the longest IA, DUID, FQDN and hostname */
+uint32_t profile_maxlen(profile_t *p)
 {
-	static uint8_t		buffer[1024];
-	ssize_t			packet_length;
-	int			pollto=20;
-	struct timeval		timestamp;
-	struct pollfd		fds={sock,POLLIN,0};
-
-
-	while (poll(&fds, 1, pollto) >  0){
-		packet_length = recv(sock, buffer, sizeof(buffer), 0);
-#ifdef linux
-		ioctl(sock, SIOCGSTAMP, &timestamp);
-#else
-		gettimeofday(&timestamp, NULL);
-#endif
-		if (packet_length < 0 ){
-			fprintf(logfp, "Packet receive error\n");
-			return;
+	uint8_t		*pc = p->code;
+	uint32_t	len = 0, n;
+
+	while (1){
+		switch (*pc++){
+		   case OP_END:
+			return(len);
+		   case OP_BYTES:
+			n = pc[0] << 8 | pc[1];
+			len += n;
+			pc += 2 + n;
+			break;
+		   case OP_OPEN:
+			len += 4;
+			pc += 2;
+			break;
+		   case OP_MAC:
+			len += 6;
+			break;
+		   case OP_COUNTER:
+		   case OP_RANDOM:
+			len += 4;
+			break;
+		   case OP_HOSTNAME:
+			len += sizeof(((dhcp_session_t *) 0)->hostname) - 1;
+			break;
+		   case OP_CLIENTID:
+			len += 4 + DUID_LLT_LEN;
+			break;
+		   case OP_ELAPSED:
+			len += 6;
+			break;
+		   case OP_IA:
+			/* IA_PD with one IAPREFIX is the larger */
+			len += MAX_IA * (16 + 4 + 25);
+			break;
+		   case OP_SERVERID:
+			len += 4 + MAX_DUID_LEN;
+			break;
+		   case OP_FQDN:
+			len += sizeof(((dhcp_session_t *) 0)->fqdn);
+			break;
+		   case OP_ORO:
+			len += 4 + nrequests * sizeof(uint16_t);
+			break;
 		}
-		pollto = 0;
-		//printf("Packet length %d\n", packet_length);
-		process_packet(buffer, &timestamp, packet_length);
 	}
-	if (fds.revents & (POLLERR|POLLNVAL)) {
-		fprintf(stderr,"reader: poll socket error\n");
+}
+/* Run program p for session into options; returns the bytes written */
+int profile_run(profile_t *p, uint8_t *options, dhcp_session_t *session)
+{
+	uint8_t		*pc = p->code, *opt = options;
+	uint32_t	v;
+	int		off = 0, n;
+
+	while (1){
+		switch (*pc++){
+		   case OP_END:
+			return(off);
+		   case OP_BYTES:
+			n = pc[0] << 8 | pc[1];
+			memcpy(options + off, pc + 2, n);
+			off += n;
+			pc += 2 + n;
+			break;
+		   case OP_OPEN:
+			opt = options + off;
+			memcpy(opt, pc, 2);
+			off += 4;
+			pc += 2;
+			break;
+		   case OP_CLOSE:
+			*((uint16_t *) (opt + 2)) = htons(options + off - opt - 4);
+			break;
+		   case OP_MAC:
+			memcpy(options + off, session->mac, 6);
+			off += 6;
+			break;
+		   case OP_COUNTER:
+			v = htonl(session->seq);
+			memcpy(options + off, &v, 4);
+			off += 4;
+			break;
+		   case OP_RANDOM:
+			v = rand();
+			memcpy(options + off, &v, 4);
+			off += 4;
+			break;
+		   case OP_HOSTNAME:
+			n = strlen(session->hostname);
+			memcpy(options + off, session->hostname, n);
+			off += n;
+			break;
+		   case OP_CLIENTID:
+			off += pack_client_id(options + off, session->mac);
+			break;
+		   case OP_ELAPSED:
+			off += pack_elapsed_time(options + off, session);
+			break;
+		   case OP_IA:
+			off += fill_iafu_mess(session, options + off);
+			break;
+		   case OP_SERVERID:
+			off += pack_server_id(options + off, session);
+			break;
+		   case OP_FQDN:
+			memcpy(options + off, session->fqdn, session->fqdn_len);
+			off += session->fqdn_len;
+			break;
+		   case OP_ORO:
+			if (nrequests == 0)
+				break;
+			*((uint16_t *) (options + off)) = htons(D6O_ORO);
+			*((uint16_t *) (options + off + 2)) = htons(nrequests * sizeof(uint16_t));
+			memcpy(options + off + 4, info_requests, nrequests * sizeof(uint16_t));
+			off += 4 + nrequests * sizeof(uint16_t);
+			break;
+		}
 	}
-	return;
 }
-
-int addoption(int option_no, char *hexdata)
+void stats_reset(dhcp_server_t *server)
 {
-    int i;
-    int datalen = strlen(hexdata);
-    char *data;
-    struct option_st *opt;
-
-    if (datalen % 2 != 0) {
-	fprintf(stderr, "Odd number of hex chars\n");
-	return -1;
-    }
-
-    datalen /= 2;
-    data = malloc(datalen);
-
-    if (strspn(hexdata, "0123456789abcdefABCDEF") != datalen * 2
-	|| datalen > 255)
-    {
-	fprintf(stderr, "Illegal hex chars or too long (max 255)\n");
-	return -1;
-    }
-
-    nextraoptions++;
-
-    extraoptions = realloc(extraoptions,
-			   nextraoptions * sizeof(struct option_st *));
-
-    opt = malloc(sizeof(struct option_st));
-
-    extraoptions[nextraoptions - 1] = opt;
-
-    opt->option_no = option_no;
-    opt->data_len = datalen;
-    opt->data = data;
-
-    for (i = 0; hexdata[i]; i += 2) {
-	int x;
-
-	sscanf(hexdata + i, "%2x", &x);
-
-	*data++ = (char)(x & 0377);
-    }
-
-    return 0;
+	memset(&server->stats, 0, sizeof(dhcp_stats_t));
+	server->stats.advertise_latency_min=10000000;
+	server->stats.reply_latency_min=10000000;
+	memset(&server->first_packet_sent, 0, sizeof(struct timeval));
+	memset(&server->last_packet_received, 0, sizeof(struct timeval));
 }
-void getmac(uint8_t * s)
+void stats_add(dhcp_stats_t *to, dhcp_stats_t *from)
 {
-    int carry = 5;
-    int i1, i2;
-
-    if (use_sequential_mac) {
-           if (s)
-                  memcpy(s, firstmac, 6);
-           while (carry >= 0) {
-                  if (firstmac[carry] == 0xFF)
-                         firstmac[carry--] = 0;
-                  else {
-                         firstmac[carry]++;
-                         return;
-                  }
-           }
-           return;
-    }
-    if (s) {
-           i1 = rand();
-           i2 = rand();
-           memcpy(s, &i1, 4);
-           memcpy(s + 4, &i2, 2);
-    }
+	uint64_t	*a, *b;
+
+	to->advertise_latency_avg += from->advertise_latency_avg;
+	to->reply_latency_avg += from->reply_latency_avg;
+	if (to->advertise_latency_min == 0 ||
+			from->advertise_latency_min < to->advertise_latency_min)
+		to->advertise_latency_min = from->advertise_latency_min;
+	if (to->reply_latency_min == 0 ||
+			from->reply_latency_min < to->reply_latency_min)
+		to->reply_latency_min = from->reply_latency_min;
+	if (from->advertise_latency_max > to->advertise_latency_max)
+		to->advertise_latency_max = from->advertise_latency_max;
+	if (from->reply_latency_max > to->reply_latency_max)
+		to->reply_latency_max = from->reply_latency_max;
+	hist_merge(&to->advertise_hist, &from->advertise_hist);
+	hist_merge(&to->advertise_hist_co, &from->advertise_hist_co);
+	hist_merge(&to->reply_hist, &from->reply_hist);
+	hist_merge(&to->reply_hist_co, &from->reply_hist_co);
+	hist_merge(&to->lease_hist, &from->lease_hist);
+	hist_merge(&to->lease_hist_co, &from->lease_hist_co);
+	hist_merge(&to->release_hist, &from->release_hist);
+
+	/* The message counters, solicits_sent through completed, are
+	   consecutive members of one type */
+	for (a = &to->solicits_sent, b = &from->solicits_sent; a <= &to->completed; a++, b++)
+		*a += *b;
+	for (a = to->status[0][0], b = from->status[0][0];
+			a < to->status[0][0] + sizeof(to->status) / sizeof(uint64_t); a++, b++)
+		*a += *b;
 }
-int get_tokens(char *cp, char **tokes, int maxtokes)
+void hist_merge(lat_hist_t *to, lat_hist_t *from)
 {
-    int n = 0;
-    if (cp == NULL)
-           return (0);
-    /* Eat any leading whitespace */
-    while (*cp == ' ' && cp != '\0')
-           cp++;
+	int	i;
 
-    if (*cp == '\0')
-           return (0);
-    tokes[0] = cp;
-    while (*cp != '\0' && *cp != '\n') {
-           if (*cp == ' ' || *cp == '\t') {
-                  *(cp++) = '\0';
-                  while (*cp != '\0' && (*cp == ' ' || *cp == '\t'))
-                         cp++;
-                  if (++n < maxtokes)
-                         tokes[n] = cp;
-                  else
-                         return (0);
-           }
-           else
-                  cp++;
-    }
-    *cp = '\0';
-    return (n + 1);
+	if (from->count == 0)
+		return;
+	if (to->count == 0 || from->min < to->min)
+		to->min = from->min;
+	if (from->max > to->max)
+		to->max = from->max;
+	to->count += from->count;
+	to->sum += from->sum;
+	for (i = 0; i < HIST_BUCKETS; i++)
+		to->bucket[i] += from->bucket[i];
 }
-void print_lease( FILE *fp, dhcp_session_t *session, struct in6_addr *sa)
+void hist_add(lat_hist_t *h, int64_t usec)
 {
+	uint64_t	v;
+	int		msb;
+	uint32_t	idx;
+
+	v = usec < 0 ? 0 : usec;
+	if (v >= (1ULL << HIST_MAX_BITS))
+		v = (1ULL << HIST_MAX_BITS) - 1;
+	if (v < 2 * HIST_SUB)
+		idx = v;
+	else {
+		msb = 63 - __builtin_clzll(v);
+		idx = (msb - HIST_SUB_BITS) * HIST_SUB + HIST_SUB +
+			((v >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1));
+	}
+	h->bucket[idx]++;
+	if (h->count == 0 || v < h->min)
+		h->min = v;
+	if (v > h->max)
+		h->max = v;
+	h->count++;
+	h->sum += v;
+}
+/* Smallest value, usecs, that lands in bucket idx */
+uint64_t hist_lo(uint32_t idx)
+{
+	int	msb;
 
-	int i;
-
-        static char addr[INET6_ADDRSTRLEN];
-        fprintf(fp,
-                "%02x:%02x:%02x:%02x:%02x:%02x %u ",
-                session->mac[0], session->mac[1],
-                session->mac[2], session->mac[3],
-                session->mac[4], session->mac[5], session->ia[0].iaid);
+	if (idx < 2 * HIST_SUB)
+		return(idx);
+	msb = (idx - HIST_SUB) / HIST_SUB + HIST_SUB_BITS;
+	return((HIST_SUB + idx % HIST_SUB) * (1ULL << (msb - HIST_SUB_BITS)));
+}
+/* Returns the midpoint of the bucket holding the p'th percentile */
+uint64_t hist_percentile(lat_hist_t *h, double p)
+{
+	uint64_t	want;
 
-	if (memcmp(&session->ia[0].ipaddr, &in6addr_any, sizeof(struct in6_addr))){
-        	fprintf(fp,"%s", inet_ntop(AF_INET6, &session->ia[0].ipaddr, addr, INET6_ADDRSTRLEN));
-		if (session->ia[0].prefix_len)
-        		fprintf(fp,"/%u ", session->ia[0].prefix_len);
-		else
-			fputc(' ', fp);
+	if (h->count == 0)
+		return(0);
+	want = (uint64_t)(p / 100.0 * h->count + 0.5);
+	if (want < 1)
+		want = 1;
+	return(hist_at(h, want));
+}
+/* Value of the want'th smallest sample (1-based), to bucket precision */
+uint64_t hist_at(lat_hist_t *h, uint64_t want)
+{
+	uint64_t	seen = 0, lo, width;
+	uint32_t	idx;
+	int		msb;
+
+	if (want >= h->count)
+		return(h->max);
+	for (idx = 0; idx < HIST_BUCKETS; idx++){
+		seen += h->bucket[idx];
+		if (seen >= want)
+			break;
 	}
-	else
-		fputs("- ", fp);
-
-	if (session->serverid[0] != 0xff){
-		for (i=0; i < session->serverid_len; i++)
-			fprintf(fp, "%02x", session->serverid[i]);
+	if (idx < 2 * HIST_SUB)
+		return(idx);
+	msb = (idx - HIST_SUB) / HIST_SUB + HIST_SUB_BITS;
+	width = 1ULL << (msb - HIST_SUB_BITS);
+	lo = hist_lo(idx);
+	if (lo + width / 2 > h->max)
+		return(h->max);
+	return(lo + width / 2);
+}
+/*
+    What the generator itself adds to each latency sample: building and
+    sending a packet after it is stamped, getting to a reply after the
+    kernel stamped it, and with --busy-poll the gaps between spins.
+*/
+void noise_print(FILE *fp)
+{
+	static const char	*label[] = { "send path", "receive wakeup", "spin gap" };
+	lat_hist_t		*h[] = { &noise_tx, &noise_rx, &noise_gap };
+	int			i;
+
+	fprintf(fp,"Generator noise (usecs)%s     p50      p99    p99.9      max\n",
+		busy_poll ? ", busy-poll:" : ":            ");
+	for (i = 0; i < 3; i++){
+		if (h[i]->count == 0)
+			continue;
+		fprintf(fp,"    %-30s %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64 "\n",
+			i == 0 && gso_calls ? "send path, per --gso batch" : label[i],
+			hist_percentile(h[i], 50.0), hist_percentile(h[i], 99.0),
+			hist_percentile(h[i], 99.9), h[i]->max);
 	}
+	fprintf(fp, "-----------------------------------------\n");
+}
+/* Percentile table, side by side with the corrected histogram if given */
+void hist_print(FILE *fp, const char *label, lat_hist_t *h, lat_hist_t *co)
+{
+	static const double	pct[] = { 50.0, 90.0, 99.0, 99.9 };
+	int			i;
 
-	if (session->hostname[0])
-		fprintf(fp, " %s ", session->hostname);
-	else 
-		fprintf(fp, " - ");
-
-	if (memcmp(sa, &in6addr_any, sizeof(struct in6_addr)))
-		fprintf(fp, " %s ", inet_ntop(AF_INET6, sa, addr, INET6_ADDRSTRLEN));
-	else
-		fprintf(fp, " - ");
+	if (h->count == 0)
+		return;
+	fprintf(fp,"%s Latency Percentiles (ms): %s\n", label,
+		co ? "  uncorrected    corrected" : "");
+	for (i = 0; i < sizeof(pct)/sizeof(pct[0]); i++){
+		fprintf(fp,"    p%-6g %20.3f", pct[i], 0.001 * hist_percentile(h, pct[i]));
+		if (co)
+			fprintf(fp," %12.3f", 0.001 * hist_percentile(co, pct[i]));
+		fputc('\n', fp);
+	}
+	fprintf(fp,"    %-7s %20.3f", "max", 0.001 * h->max);
+	if (co)
+		fprintf(fp," %12.3f", 0.001 * co->max);
+	fputc('\n', fp);
+}
+/*
+    Local losses: the socket's SO_RXQ_OVFL count (the ring's drops with
+    --raw) and the system-wide Udp6 buffer errors, from /proc/net/snmp6,
+    as running totals.
+*/
+void local_drops(drops_t *d)
+{
+	FILE		*fp;
+	char		name[64];
+	uint64_t	val;
 
-	//fprintf(stderr,"print_lease: Received IA: %u\n", session->recv_ia);
-	if (session->recv_ia > 1){
-		for (i=1; i < session->recv_ia; i++){
-			fprintf(fp, "IA: %u %s", session->ia[i].iaid,
-				inet_ntop(AF_INET6, &session->ia[i].ipaddr, addr, INET6_ADDRSTRLEN));
-			if (session->ia[i].prefix_len)
-        			fprintf(fp,"/%u ", session->ia[0].prefix_len);
-			else
-				fputc(' ', fp);
-		}
+	d->rxq = raw_ifname != NULL ? raw_drops() : rxq_ovfl;
+	d->rcvbuf = d->sndbuf = 0;
+	if ((fp = fopen("/proc/net/snmp6", "r")) == NULL)
+		return;
+	while (fscanf(fp, "%63s %" SCNu64, name, &val) == 2){
+		if (!strcmp(name, "Udp6RcvbufErrors"))
+			d->rcvbuf = val;
+		else if (!strcmp(name, "Udp6SndbufErrors"))
+			d->sndbuf = val;
 	}
-	fputc('\n', fp);		
-                
+	fclose(fp);
 }
-/* I guess this can be an FQDN or unqualified hostname */
-int pack_client_fqdn(uint8_t *options, char *hostname)
+/*
+    Packets lost on our side since the start.  A socket queue overflow
+    is also a RcvbufError, so count whichever is larger.
+*/
+uint64_t drops_lost(drops_t *d)
 {
-	int offset=0;
-	*((uint16_t *)(options + offset)) = htons(D6O_CLIENT_FQDN);
-	offset += 4;
-	if (server_should_ddns)
-		options[offset] = 1; //S=1,O=0,N=0
-	else
-		options[offset] = 4; //S=1,O=0,N=0
-	offset++;
-	offset += encode_domain(hostname, options + offset);
-	*((uint16_t *)(options + 2)) = htons(offset - 4);
-	return(offset);
+	uint64_t	rxq, rcvbuf;
+
+	rxq = d->rxq - drops_base.rxq;
+	rcvbuf = raw_ifname != NULL ? 0 : d->rcvbuf - drops_base.rcvbuf;
+	return((rxq > rcvbuf ? rxq : rcvbuf) + d->sndbuf - drops_base.sndbuf);
+}
+uint64_t stats_timeouts(dhcp_stats_t *st)
+{
+	return(st->solicit_ack_timeouts + st->request_ack_timeouts +
+		st->renew_ack_timeouts + st->rebind_ack_timeouts +
+		st->release_ack_timeouts + st->decline_ack_timeouts +
+		st->inform_ack_timeouts + st->confirm_ack_timeouts);
+}
+/*
+    Split the timeouts between the generator and the server: each local
+    drop can explain at most one timeout, the rest were lost beyond us.
+*/
+void drops_report(void)
+{
+	dhcp_server_t	*server;
+	drops_t		d;
+	uint64_t	timeouts = 0, lost;
+
+	for (server=servers; server != NULL; server=server->next)
+		timeouts += stats_timeouts(&server->stats);
+	local_drops(&d);
+	lost = drops_lost(&d);
+	if (timeouts == 0 && lost == 0)
+		return;
+	fprintf(logfp,"%s %6" PRIu64 "\n", raw_ifname != NULL ?
+		"Receive drops (ring):  " : "Receive drops (socket):", d.rxq - drops_base.rxq);
+	fprintf(logfp,"Udp6 RcvbufErrors:      %6" PRIu64 " (system-wide)\n",
+		d.rcvbuf - drops_base.rcvbuf);
+	fprintf(logfp,"Udp6 SndbufErrors:      %6" PRIu64 " (system-wide)\n",
+		d.sndbuf - drops_base.sndbuf);
+	if (lost > timeouts)
+		lost = timeouts;
+	fprintf(logfp,"Timeouts:               %6" PRIu64 " (generator %" PRIu64
+		", server or network %" PRIu64 ")\n", timeouts, lost, timeouts - lost);
+	fprintf(logfp, "-----------------------------------------\n");
+}
+/*
+    --interval: close the current window once it is stat_interval old,
+    print it and keep it in the windows[] ring.
+*/
+/* Run totals of the counters a window reports */
+void window_sum(window_t *total)
+{
+	dhcp_server_t	*server;
+	dhcp_stats_t	*st;
+	drops_t		drops;
+
+	memset(total, 0, sizeof(*total));
+	for (server=servers; server != NULL; server=server->next){
+		st = &server->stats;
+		total->sent += st->solicits_sent + st->requests_sent +
+			st->releases_sent + st->declines_sent +
+			st->informs_sent + st->confirms_sent +
+			st->renews_sent + st->rebinds_sent;
+		total->timeouts += stats_timeouts(st);
+		total->completed += st->completed;
+		total->failed += st->failed;
+		total->cwnd += server->cwnd;
+	}
+	local_drops(&drops);
+	total->drops = drops_lost(&drops);
 }
-int encode_domain( char *domain, uint8_t *buf)
+/*
+    Before the server counters are zeroed (a new --scenario phase), move
+    the window base back by what they held, so the open window keeps
+    what it has counted and does not underflow.  Wraps cancel out.
+*/
+void window_rebase(void)
 {
-        uint8_t *plen;
-        int len=1;
+	window_t	total;
 
-        plen = buf;
-        buf++;
-        *plen = 0;
-        while (*domain != '\0'){
-                if (*domain == '.'){
-                        if (*(domain + 1) == '\0')
-                                break;
-                        else {
-                                plen = buf++;
-                                *plen = 0;
-                                domain++;
-                                len++;
-                                continue;
-                        }
-                }
-                *(buf++) = *(domain++);
-                (*plen)++;
-                len++;
-        }
-        *buf=0;
-        return(len+1);
+	if (stat_interval == 0)
+		return;
+	window_sum(&total);
+	window_total.sent -= total.sent;
+	window_total.completed -= total.completed;
+	window_total.failed -= total.failed;
+	window_total.timeouts -= total.timeouts;
 }
-void usage()
+void interval_check(struct timeval *now)
 {
-	fprintf(stderr,
-"Usage: dras6 -i <server IP> [-f <input-lease-file>] [-o <output-lease-file>]\n"
-"	[-A] -O <dec option-no>:<hex data>] [-l <logfile>] [-t <timeout>] [-a <mac>]\n"
-"	[-n <number requests>] [-q <max outstanding> [-R <retransmits>]\n"
-"	[-d <delay>] [-c <relay agent IP>] [-e|mN|p|r|w] [-I <requested options>]\n"
-"	[-s <renew|inform|confirm|decline|rebind>] [-S <sol|req|ren>,opno1,opno2,...]\n\n");
+	window_t	total, *w;
+	uint64_t	usecs, sent;
+	int		c;
 
-	fprintf(stderr,
-"	-a Starting MAC address\n"
-"	-A Simulate relay agent\n"
-"	-d Delay before sending next packet\n"
-"	-D DNS zone for CLIENT_FQDN option\n"
-"	-e Send decline after ACK received\n"
-"	-f Input file with ClientID/IPv6 leases\n"
-"       Format:  <MAC> <IAID> <IPADDR|\"-\">[/<prefix>] <Server DUID> [<hostname|FQDN>]\n"
-"       e.g.: 00:00:00:00:00:01 1 2001:db8:a22:1f00::64 0001000114da166c00259003467d h788047619869273952\n"
-"	-h Add CLIENT_FQDN option\n"
-"	-H Add CLIENT_FQDN optionwith random hostnames\n"
-"	-i Server IP Address (multiple servers are separated by commas)\n"
-"	-I List of option numbers to request (separated by spaces, in quotes)\n"
-"	e.g.: -I \"11 34 22\"\n"
-"	-l Output logfile (default: stderr)\n"
-"	-m Start at MAC 0\n"
-"	-n Number of requests\n"
-"	-N Retransmit until answer received\n"
-"	-o Output lease file\n"
-"	-O Send option <option-no> (dec) with data <hex data> (w/o length)\n"
-"	-p Ping mode: end after ADVERTISE received\n"
-"	-P Prefix request (IAPREFIX)\n"
-"	-q Maximum outstanding requests\n"
-"	-r Send release after ACK received\n"
-"	-R Number of retransmits (default 0)\n"
-"	-s Start from RENEW|REQUEST|INFORM|CONFIRM with -f <file> option\n"
-"	-t Timeout on requests (ms)\n"
-"	-v Verbose output\n"
-"	-z Use rapid commit option\n");
+	if (stat_interval == 0)
+		return;
+	usecs = DELTATV64((*now), window_start);
+	if (usecs < stat_interval * 1000000ULL)
+		return;
 
-	exit(1);
+	window_sum(&total);
+	w = windows + nwindows++ % MAX_WINDOWS;
+	w->end = now->tv_sec - start_time;
+	w->usecs = usecs;
+	w->sent = total.sent - window_total.sent;
+	w->completed = total.completed - window_total.completed;
+	w->failed = total.failed - window_total.failed;
+	w->timeouts = total.timeouts - window_total.timeouts;
+	w->drops = total.drops - window_total.drops;
+	memcpy(w->status, window_status, sizeof(w->status));
+	w->advertise_p99 = hist_percentile(&window_advertise, 99);
+	w->reply_p50 = hist_percentile(&window_reply, 50);
+	w->reply_p99 = hist_percentile(&window_reply, 99);
+	w->cwnd = total.cwnd;
+	fprintf(logfp,"%7us sent %8" PRIu64 " done %8" PRIu64 " (%9.1f/s) "
+		"failed %6" PRIu64 " timeouts %6" PRIu64 " (local drops %4" PRIu64
+		") adv p99 %8.3f reply p50 %8.3f p99 %8.3f ms", w->end, w->sent,
+		w->completed, w->completed * 1e6 / usecs, w->failed, w->timeouts,
+		w->drops,
+		w->advertise_p99 / 1000.0, w->reply_p50 / 1000.0,
+		w->reply_p99 / 1000.0);
+	if (adaptive)
+		fprintf(logfp," window %6.1f", w->cwnd);
+	for (c = STATUS_UnspecFail; c < STATUS_KINDS; c++)
+		if (w->status[c])
+			fprintf(logfp," %s %" PRIu64, statusstrings[c], w->status[c]);
+	if (tx_sched){
+		for (c = 0, sent = 0; c < TX_CLASSES; c++)
+			sent += tx_class[c].sent - tx_class[c].window_base;
+		fprintf(logfp," tx");
+		for (c = 0; c < TX_CLASSES; c++){
+			fprintf(logfp,"%c%.0f%%", c ? '/' : ' ', sent ? 100.0 *
+				(tx_class[c].sent - tx_class[c].window_base) / sent : 0);
+			tx_class[c].window_base = tx_class[c].sent;
+		}
+	}
+	fprintf(logfp,"\n");
+
+	window_total = total;
+	window_start = *now;
+	memset(&window_advertise, 0, sizeof(lat_hist_t));
+	memset(&window_reply, 0, sizeof(lat_hist_t));
+	memset(window_status, 0, sizeof(window_status));
 }
-void decode_state(uint32_t state)
+void window_report(void)
 {
-
-	if ( state == 0){
-		fprintf(logfp,"Unallocated\n");
+	window_t	*w, *worst = NULL, *slowest = NULL;
+	uint64_t	i, first, failing = 0;
+	double		rate, min_rate = 0, max_rate = 0, cwnd;
+
+	first = nwindows > MAX_WINDOWS ? nwindows - MAX_WINDOWS : 0;
+	for (i = first; i < nwindows; i++){
+		w = windows + i % MAX_WINDOWS;
+		rate = w->completed * 1e6 / w->usecs;
+		if (slowest == NULL || rate < min_rate){
+			slowest = w;
+			min_rate = rate;
+		}
+		if (rate > max_rate)
+			max_rate = rate;
+		if (worst == NULL || w->reply_p99 > worst->reply_p99)
+			worst = w;
+		if (w->failed)
+			failing++;
+	}
+	fprintf(logfp,"Intervals (%us):        %6" PRIu64 " (last %" PRIu64 " kept)\n",
+		stat_interval, nwindows, nwindows - first);
+	fprintf(logfp,"Completed/sec min/max:  %9.1f / %.1f (min at %us)\n",
+		min_rate, max_rate, slowest->end);
+	fprintf(logfp,"Worst reply p99 (ms):   %9.3f (at %us)\n",
+		worst->reply_p99 / 1000.0, worst->end);
+	fprintf(logfp,"Intervals with failures:%6" PRIu64 "\n", failing);
+	if (adaptive){
+		/* The second half of the run, once the window has settled */
+		first += (nwindows - first) / 2;
+		for (i = first, rate = cwnd = 0; i < nwindows; i++){
+			w = windows + i % MAX_WINDOWS;
+			rate += w->completed * 1e6 / w->usecs;
+			cwnd += w->cwnd;
+		}
+		fprintf(logfp,"Converged window:       %9.1f at %.1f completed/sec\n",
+			cwnd / (nwindows - first), rate / (nwindows - first));
+	}
+	fprintf(logfp, "-----------------------------------------\n");
+}
+/*
+    --adaptive: AIMD on each server's window of outstanding sessions.  A
+    reply within the target grows a full window by one (by one per window
+    of replies once it has been cut); a timeout or a slow reply halves it.
+    Signals for packets sent before the last cut are ignored, as TCP does
+    during recovery.
+*/
+void aimd_sample(dhcp_server_t *server, dhcp_session_t *session, uint64_t usec)
+{
+	if (!adaptive)
+		return;
+	if (usec > adaptive * 1000ULL){
+		aimd_loss(server, session);
 		return;
 	}
-	if (state & SESSION_ALLOCATED)
-		fprintf(logfp,"SESSION_ALLOCATED|");
-	if (state & SOLICIT_SENT)
-		fprintf(logfp,"SOLICIT_SENT|");
-	if (state & RAPID_SOLICIT_SENT)
-		fprintf(logfp,"RAPID_SOLICIT_SENT|");
-	if (state & RENEW_SENT)
-		fprintf(logfp,"RENEW_SENT|");
-	if (state & REQUEST_SENT)
-		fprintf(logfp,"REQUEST_SENT|");
-	if (state & RELEASE_SENT)
-		fprintf(logfp,"RELEASE_SENT|");
-	if (state & DECLINE_SENT)
-		fprintf(logfp,"DECLINE_SENT|");
-	if (state & INFORM_SENT)
-		fprintf(logfp,"INFORM_SENT|");
-	if (state & REBIND_SENT)
-		fprintf(logfp,"REBIND_SENT|");
-	if (state & CONFIRM_SENT)
-		fprintf(logfp,"CONFIRM_SENT|");
-	if (state & SOLICIT_ACK)
-		fprintf(logfp,"SOLICIT_ACK|");
-	if (state & SOLICIT_NAK)
-		fprintf(logfp,"SOLICIT_NAK|");
-	if (state & REQUEST_ACK)
-		fprintf(logfp,"REQUEST_ACK|");
-	if (state & REQUEST_NAK)
-		fprintf(logfp,"REQUEST_NAK|");
-	if (state & RENEW_ACK)
-		fprintf(logfp,"RENEW_ACK|");
-	if (state & RENEW_NAK)
-		fprintf(logfp,"RENEW_NAK|");
-	if (state & REBIND_ACK)
-		fprintf(logfp,"REBIND_ACK|");
-	if (state & REBIND_NAK)
-		fprintf(logfp,"REBIND_NAK|");
-	if (state & RELEASE_ACK)
-		fprintf(logfp,"RELEASE_ACK|");
-	if (state & RELEASE_NAK)
-		fprintf(logfp,"RELEASE_NAK|");
-	if (state & DECLINE_ACK)
-		fprintf(logfp,"DECLINE_ACK|");
-	if (state & DECLINE_NAK)
-		fprintf(logfp,"DECLINE_NAK|");
-	if (state & INFORM_ACK)
-		fprintf(logfp,"INFORM_ACK|");
-	if (state & INFORM_NAK)
-		fprintf(logfp,"INFORM_NAK|");
-	if (state & CONFIRM_ACK)
-		fprintf(logfp,"CONFIRM_ACK|");
-	if (state & CONFIRM_NAK)
-		fprintf(logfp,"CONFIRM_NAK|");
-	if (state & PACKET_ERROR)
-		fprintf(logfp,"PACKET_ERROR|");
-	fputs("\n", logfp);
-	return;
+	if (server->active < (uint32_t) server->cwnd)
+		return;
+	if (server->aimd_cuts == 0)
+		server->cwnd += 1;
+	else
+		server->cwnd += 1 / server->cwnd;
+	if (server->cwnd > max_sessions)
+		server->cwnd = max_sessions;
 }
-int parse_opt_seq(char *s)
+void aimd_loss(dhcp_server_t *server, dhcp_session_t *session)
 {
-	
-	char *cp;
-	uint16_t  *seqptr=NULL;
-	if ((cp=strtok(s,", ")) == NULL){
-		printf("Syntax error opt seq: %s\n", s);
-		return(-1);
+	if (!adaptive || timercmp(&session->last_sent, &server->aimd_cut, <))
+		return;
+	gettimeofday(&server->aimd_cut, NULL);
+	server->aimd_cuts++;
+	server->cwnd /= 2;
+	if (server->cwnd < 1)
+		server->cwnd = 1;
+}
+/*
+    --rfc-retrans: RFC 8415 section 15.  The first RT is IRT with +/-10%
+    jitter (strictly above IRT for SOLICIT), each later one doubles with
+    jitter and is capped near MRT, and no RT runs past MRD.
+*/
+void rt_next(dhcp_session_t *session, uint8_t type, struct timeval *now)
+{
+	rt_policy_t	*p = rt_policy + type;
+	uint32_t	mrd = session->mrd ? session->mrd : p->mrd;
+	double		r = (rand() % 2001 - 1000) / 10000.0;
+	double		rt;
+	int64_t		left;
+
+	if (session->xchg_tx == 1){
+		if (type == DHCPV6_SOLICIT && r <= 0)
+			r = 0.0001 - r;
+		rt = p->irt * 1000.0 * (1 + r);
 	}
-	while (cp != NULL){
-		if (*cp >= '0' && *cp <= '9'){
-			if (seqptr == NULL){
-				printf("Need to define packet type (sol|req|ren) in option sequence\n");
-				return(-1);
-			}
-
-			*seqptr = atoi(cp);
+	else {
+		rt = session->rt * (2 + r);
+		if (p->mrt && rt > p->mrt * 1000.0)
+			rt = p->mrt * 1000.0 * (1 + r);
+	}
+	if (mrd){
+		left = mrd * 1000LL - DELTATV64((*now), session->xchg_start);
+		if (rt > left)
+			rt = left > 0 ? left : 0;
+	}
+	session->rt = rt;
+}
+/*
+    Has the last transmission of session gone unanswered too long?  A
+    retransmit the scheduler has no budget for waits.
+*/
+int retrans_due(dhcp_session_t *session, struct timeval *now)
+{
+	if (!rfc_retrans){
+		if (DELTATV((*now), session->last_sent) <= timeout)
+			return(0);
+	}
+	else if (DELTATV64((*now), session->last_sent) < (int64_t) session->rt)
+		return(0);
+	return(!retrans_left(session, now) || tx_ready(TX_RETRANS));
+}
+/* May session send again, or has its exchange run out of MRC/MRD? */
+int retrans_more(dhcp_session_t *session, struct timeval *now)
+{
+	if (retrans_left(session, now))
+		return(1);
+	xmit_stats[session->type_last_sent].gave_up++;
+	return(0);
+}
+int retrans_left(dhcp_session_t *session, struct timeval *now)
+{
+	rt_policy_t	*p = rt_policy + session->type_last_sent;
+	uint32_t	mrd = session->mrd ? session->mrd : p->mrd;
 
-			if (*seqptr == D6O_CLIENT_FQDN){
-				server_should_ddns = 0;
-				random_hostname = 1;
-				send_hostname = 1;
-			}
+	if (!rfc_retrans)
+		return(retransmit > session->timeouts || send_until_answered);
+	if (p->mrc && session->xchg_tx >= p->mrc)
+		return(0);
+	if (mrd && DELTATV64((*now), session->xchg_start) >= mrd * 1000LL)
+		return(0);
+	return(1);
+}
+/* --retrans msg:irt[/mrt[/mrc[/mrd]]],... */
+int retrans_parse(char *spec)
+{
+	char		*cp, *arg;
+	uint32_t	*field;
+	int		type;
 
-			seqptr++;
-			
+	for (cp = strtok(spec, ","); cp != NULL; cp = strtok(NULL, ",")){
+		if ((arg = strchr(cp, ':')) == NULL){
+			fprintf(stderr,"--retrans: bad policy %s\n", cp);
+			return(-1);
 		}
-		else {
-			if (strncasecmp(cp,"sol",3) == 0)
-				seqptr=sol_optseq;
-			else if (strncasecmp(cp,"req",3) == 0)
-				seqptr=req_optseq;
-			else if (strncasecmp(cp,"ren",3) == 0)
-				seqptr=ren_optseq;
-			else {
-				printf("Bad token in DHCP option sequence: %s\n", cp);
-				return(-1);
-			}
-			while (*seqptr)
-				seqptr++;
+		*arg++ = '\0';
+		if ((type = msg_type_by_name(cp)) < 0){
+			fprintf(stderr,"--retrans: unknown message %s\n", cp);
+			return(-1);
+		}
+		for (field = &rt_policy[type].irt; field <= &rt_policy[type].mrd; field++){
+			*field = strtoul(arg, &arg, 10);
+			if (*arg != '/')
+				break;
+			arg++;
+		}
+		if (*arg != '\0' || rt_policy[type].irt == 0){
+			fprintf(stderr,"--retrans: bad parameters for %s\n", cp);
+			return(-1);
 		}
-		cp=strtok(NULL,", ");
-		
-	}
-	printf("\nSolicit Options: ");
-	if (*sol_optseq){
-		for (seqptr=sol_optseq; *seqptr; seqptr++)
-			printf("%u ", *seqptr);
-	}
-	if (*req_optseq){
-		printf("\nRequest Options: ");
-		for (seqptr=req_optseq; *seqptr; seqptr++)
-			printf("%u ", *seqptr);
 	}
-	if (*ren_optseq){
-		printf("\nRenew Options: ");
-		for (seqptr=ren_optseq; *seqptr; seqptr++)
-			printf("%u ", *seqptr);
-		printf("\n");
-	}		
 	return(0);
 }
-int add_opt_seq(uint8_t  type, uint8_t *options, dhcp_session_t *session)
+/*
+    --tx-budget/--tx-weight: each class earns credit at its budget, at
+    most TX_TICK secs' worth, and a send of that class waits while the
+    credit is used up.  New sessions are held in find_free_session(),
+    follow-ups and retransmits in process_sessions().
+*/
+int tx_ready(int c)
 {
-	int	offset=0;
-	int	i, found;
-	uint16_t *seqptr;
+	struct timeval	now;
+	double		dt, cap;
+	int		i;
 
-	if (type == DHCPV6_SOLICIT)
-		seqptr = sol_optseq;
-	else if (type == DHCPV6_RENEW)
-		seqptr = ren_optseq;
-	else
-		seqptr = req_optseq;
-
-	for (; *seqptr; seqptr++){
-		printf("Adding option %u\n", *seqptr);
-		// See if user defined the option
-		if (nextraoptions) {
-			found=0;
-			for (i=0; i < nextraoptions; i++){
-				if (extraoptions[i]->option_no == *seqptr){
-					*((uint16_t *) (options + offset)) = htons(*seqptr);
-					offset += 2;
-					*((uint16_t *) (options + offset)) = htons(extraoptions[i]->data_len);
-					offset += 2;
-					memcpy(options + offset, extraoptions[i]->data, extraoptions[i]->data_len);
-					offset += extraoptions[i]->data_len;
-					found=1;
-					break;
-				}
-				
-			}
-			if (found)
+	if (!tx_sched || tx_class[c].budget <= 0)
+		return(1);
+	gettimeofday(&now, NULL);
+	dt = tx_refill.tv_sec ? DELTATV64(now, tx_refill) / 1e6 : TX_TICK;
+	if (dt >= 0.001){
+		tx_refill = now;
+		for (i = 0; i < TX_CLASSES; i++){
+			if (tx_class[i].budget <= 0)
 				continue;
+			cap = tx_class[i].budget * TX_TICK;
+			if (cap < 1)
+				cap = 1;
+			tx_class[i].credit += tx_class[i].budget * dt;
+			if (tx_class[i].credit > cap)
+				tx_class[i].credit = cap;
 		}
-		switch (*seqptr){
-		   case D6O_CLIENTID:
- 			/* CLIENT_ID option */
-        		*((uint16_t *) (options + offset)) = htons(D6O_CLIENTID);
-        		offset += 2;
-        		*((uint16_t *) (options + offset)) = htons(DUID_LLT_LEN);
-        		offset += 2;
-        		*((uint16_t *) (options + offset)) = htons(1);
-        		offset += 2;
-        		*((uint16_t *) (options + offset)) = htons(1);
-        		offset += 2;
-        		memset(options + offset, 0x88, 4);
-        		offset += 4;
-        		memcpy(options + offset, session->mac, 6);
-        		offset += 6;
-			break;
-		   case D6O_STATUS_CODE:
-        		*((uint16_t *) (options + offset)) = htons(D6O_STATUS_CODE);
-        		offset += 2;
-        		*((uint16_t *) (options + offset)) = htons(2);
-        		offset += 2;
-        		*((uint16_t *) (options + offset)) = htons(STATUS_Success);
-        		offset += 2;
-			break;
-		   case D6O_RAPID_COMMIT:
-			 *((uint16_t *) (options + offset)) = htons(D6O_RAPID_COMMIT);
-                	offset += 2;
-                	*((uint16_t *) (options + offset)) = 0;
-                	offset += 2;
-			break;
-		   case D6O_SERVERID:
-			if (session->serverid[0] == 0xff)
-				break;
-                	*((uint16_t *) (options + offset)) = htons(D6O_SERVERID);
-                	offset += 2;
-                	*((uint16_t *) (options + offset)) =
-                                        	htons(session->serverid_len);
-                	offset += 2;
-                	memcpy(options + offset, session->serverid,
-                        	session->serverid_len);
-                	offset += session->serverid_len;
-			break;
-		   case D6O_CLIENT_FQDN:
-			if (session->hostname[0] == '\0')
+	}
+	return(tx_class[c].credit >= 1);
+}
+/* class:n,... as sends/sec (budget) or shares of --tx-rate (weight) */
+int tx_parse(char *spec, int weight)
+{
+	char	*cp, *arg;
+	int	c;
+
+	for (cp = strtok(spec, ","); cp != NULL; cp = strtok(NULL, ",")){
+		if ((arg = strchr(cp, ':')) == NULL)
+			goto bad;
+		*arg++ = '\0';
+		for (c = 0; c < TX_CLASSES; c++)
+			if (strlen(cp) >= 3 && !strncasecmp(cp, tx_class[c].name, strlen(cp)))
 				break;
-			offset += pack_client_fqdn(options + offset, session->hostname);
-			break;
-		   case D6O_ELAPSED_TIME:
-                	*((uint16_t *) (options + offset)) = htons(D6O_ELAPSED_TIME);
-                	offset += 2;
-                	*((uint16_t *) (options + offset)) = htons(2);//Does this matter?
-                	offset += 2;
-                	*((uint16_t *) (options + offset)) = htons(42);//Does this matter?
-                	offset += 2;
-			break;
-		   case D6O_IA_NA: 
-			offset += fill_iafu_mess(session, options + offset);
-			break;	
-		   case D6O_ORO:
-			*((uint16_t *) (options + offset)) = htons(D6O_ORO);
-			offset += 2;
-			*((uint16_t *) (options + offset)) = htons(8);
-			offset += 2;
-			*((uint16_t *) (options + offset)) = htons(24);
-			offset += 2;
-			*((uint16_t *) (options + offset)) = htons(23);
-			offset += 2;
-			*((uint16_t *) (options + offset)) = htons(17);
-			offset += 2;
-			*((uint16_t *) (options + offset)) = htons(39);
-			offset += 2;
-			break;
-		   case D6O_VENDOR_CLASS:
-			*((uint16_t *) (options + offset)) = htons(D6O_VENDOR_CLASS);
-			offset += 2;
-			*((uint16_t *) (options + offset)) = htons(14);
-			offset += 2;
-			*((uint32_t *) (options + offset)) = htonl(311);
-			offset += 4;
-			*((uint16_t *) (options + offset)) = 0x0008;
-			offset +=2;
-			memcpy(options+offset, "MSFT 5.0", 8);
-			offset += 8;
-			break;
-		   default:
-			fprintf(stderr,"Can't add option number %u\n", *seqptr);
-			break;
+		if (c == TX_CLASSES)
+			goto bad;
+		if (weight)
+			tx_class[c].weight = atol(arg);
+		else
+			tx_class[c].budget = atof(arg);
+	}
+	tx_sched = 1;
+	return(0);
+bad:
+	fprintf(stderr,"--tx-%s: bad class %s\n", weight ? "weight" : "budget", cp);
+	return(-1);
+}
+/* Split --tx-rate by weight for the classes without a budget of their own */
+void tx_setup(void)
+{
+	uint32_t	total = 0;
+	int		c;
+
+	for (c = 0; c < TX_CLASSES; c++)
+		total += tx_class[c].weight;
+	if (total == 0)
+		return;
+	if (tx_rate <= 0){
+		fprintf(stderr, "--tx-weight needs --tx-rate\n");
+		usage();
+	}
+	for (c = 0; c < TX_CLASSES; c++)
+		if (tx_class[c].budget <= 0 && tx_class[c].weight)
+			tx_class[c].budget = tx_rate * tx_class[c].weight / total;
+}
+/*
+    Compile the fixed part of each message type once.  The head holds the
+    header, CLIENTID, Elapsed Time, STATUS_CODE and RAPID_COMMIT, with the
+    txid, MAC and elapsed time patched per packet; the tail holds ORO and
+    the -O options, the same for every type.  IA, SERVERID and CLIENT_FQDN
+    are per session and go in between.
+*/
+void tmpl_build(void)
+{
+	static uint8_t		nomac[6];
+	tmpl_t			*t;
+	uint8_t			*p;
+	int			type, i, len;
+
+	for (type = DHCPV6_SOLICIT; type <= DHCPV6_INFORMATION_REQUEST; type++){
+		t = templates + type;
+		p = t->head;
+		p[0] = type;
+		len = 4;
+
+		/* tmpl_fill() patches in each session's MAC */
+		t->mac_off = len + 12;
+		len += pack_client_id(p + len, nomac);
+
+		*((uint16_t *) (p + len)) = htons(D6O_ELAPSED_TIME);
+		*((uint16_t *) (p + len + 2)) = htons(2);
+		t->elapsed_off = len + 4;
+		len += 6;
+
+		/* request Status Code from server */
+		*((uint16_t *) (p + len)) = htons(D6O_STATUS_CODE);
+		*((uint16_t *) (p + len + 2)) = htons(2);
+		*((uint16_t *) (p + len + 4)) = htons(STATUS_Success);
+		len += 6;
+
+		if (type == DHCPV6_SOLICIT && rapid_commit){
+			*((uint16_t *) (p + len)) = htons(D6O_RAPID_COMMIT);
+			*((uint16_t *) (p + len + 2)) = 0;
+			len += 4;
 		}
+		t->head_len = len;
 	}
-	return(offset);
 
+	for (len = 0, i = 0; i < nextraoptions; i++)
+		len += 4 + extraoptions[i]->data_len;
+	if (nrequests)
+		len += 4 + nrequests * sizeof(uint16_t);
+	tmpl_tail = p = malloc(len + 1);
+	assert(p != NULL);
+
+	/*  Ask for all -I options */
+	if (nrequests){
+		*((uint16_t *) p) = htons(D6O_ORO);
+		*((uint16_t *) (p + 2)) = htons(nrequests * sizeof(uint16_t));
+		memcpy(p + 4, info_requests, nrequests * sizeof(uint16_t));
+		p += 4 + nrequests * sizeof(uint16_t);
+	}
+	/* append any user defined options */
+	for (i = 0; i < nextraoptions; i++){
+		*((uint16_t *) p) = htons(extraoptions[i]->option_no);
+		*((uint16_t *) (p + 2)) = htons(extraoptions[i]->data_len);
+		memcpy(p + 4, extraoptions[i]->data, extraoptions[i]->data_len);
+		p += 4 + extraoptions[i]->data_len;
+	}
+	tmpl_tail_len = len;
+}
+/* Build a message of type for session into buf; returns its length */
+int tmpl_fill(uint8_t type, uint8_t *buf, dhcp_session_t *session)
+{
+	tmpl_t	*t = templates + type;
+	int	len = t->head_len;
+
+	memcpy(buf, t->head, len);
+	buf[1] = session->txid >> 16;
+	buf[2] = session->txid >> 8;
+	buf[3] = session->txid;
+	memcpy(buf + t->mac_off, session->mac, 6);
+	*((uint16_t *) (buf + t->elapsed_off)) = htons(session->elapsed);
+
+	if (type != DHCPV6_INFORMATION_REQUEST)
+		len += fill_iafu_mess(session, buf + len);
+	len += pack_server_id(buf + len, session);
+	memcpy(buf + len, session->fqdn, session->fqdn_len);
+	len += session->fqdn_len;
+	memcpy(buf + len, tmpl_tail, tmpl_tail_len);
+	return(len + tmpl_tail_len);
 }
@@ -12,21 +12,30 @@
 #include <stdarg.h>
 #include <unistd.h>
 #include <string.h>
+#include <ctype.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <signal.h>
 #include <time.h>
 #include <assert.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #ifdef linux
  #include <sys/ioctl.h>
+ #include <linux/sockios.h>
+ #include <sched.h>
 #endif
 #include <poll.h>
+#include <getopt.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
+#include <errno.h>
 #include <arpa/inet.h>
 
 #include "dhcp.h"
+#include "rawnet.h"
 
 static const char hex[17] = "0123456789abcdef";
 
@@ -35,64 +44,108 @@ static const char hex[17] = "0123456789abcdef";
 #define MAX_DUID_LEN		130
 #define DUID_LLT_LEN	 	 14
 #define MAX_IA			 16
+#define MAX_PACKET		2048	/* send_packet6 buffer */
+
+/*
+ * Latency histograms are log-linear: exact below 2*HIST_SUB usecs, then
+ * HIST_SUB buckets per power of two (~6% resolution) up to 2^40 usecs.
+ */
+#define HIST_SUB_BITS		  4
+#define HIST_SUB		(1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS		 40
+#define HIST_BUCKETS		((HIST_MAX_BITS - HIST_SUB_BITS) * HIST_SUB + HIST_SUB)
+
+/* STATUS_CODE values counted by name; the rest share the last bucket */
+#define STATUS_KINDS		  8
+#define STATUS_TOP		  0
+#define STATUS_IA		  1
+
+typedef struct {
+	uint64_t	count;
+	uint64_t	sum;
+	uint64_t	min;
+	uint64_t	max;
+	uint64_t	bucket[HIST_BUCKETS];
+} lat_hist_t;
 
 typedef struct {
-	uint32_t	advertise_latency_avg;
-	uint32_t	advertise_latency_min;
-	uint32_t	advertise_latency_max;
-
-	uint32_t	reply_latency_avg;
-	uint32_t	reply_latency_min;
-	uint32_t	reply_latency_max;
-
-	uint32_t	solicits_sent;
-	uint32_t	requests_sent;
-	uint32_t	releases_sent;
-	uint32_t	declines_sent;
-	uint32_t	informs_sent;
-	uint32_t	confirms_sent;
-	uint32_t	renews_sent;
-	uint32_t	rebinds_sent;
-
-	uint32_t	solicit_acks_received;
-	uint32_t	solicit_naks_received;
-	uint32_t	request_acks_received;
-	uint32_t	request_naks_received;
-	uint32_t	decline_acks_received;
-	uint32_t	decline_naks_received;
-	uint32_t	release_acks_received;
-	uint32_t	release_naks_received;
-	uint32_t	inform_acks_received;
-	uint32_t	inform_naks_received;
-	uint32_t	confirm_acks_received;
-	uint32_t	confirm_naks_received;
-	uint32_t	renew_acks_received;
-	uint32_t	renew_naks_received;
-	uint32_t	rebind_acks_received;
-	uint32_t	rebind_naks_received;
-
-	uint32_t	solicit_ack_timeouts;
-	uint32_t	request_ack_timeouts;
-	uint32_t	renew_ack_timeouts;
-	uint32_t	rebind_ack_timeouts;
-	uint32_t	release_ack_timeouts;
-	uint32_t	decline_ack_timeouts;
-	uint32_t	inform_ack_timeouts;
-	uint32_t	confirm_ack_timeouts;
-
-	uint32_t	errors;
-	uint32_t	failed;
-	uint32_t	completed;
+	uint64_t	advertise_latency_avg;
+	uint64_t	advertise_latency_min;
+	uint64_t	advertise_latency_max;
+
+	uint64_t	reply_latency_avg;
+	uint64_t	reply_latency_min;
+	uint64_t	reply_latency_max;
+
+	/* Uncorrected: from the last transmission.  Corrected (_co): from
+	 * the intended send time of the exchange (see --rate). */
+	lat_hist_t	advertise_hist;
+	lat_hist_t	advertise_hist_co;
+	lat_hist_t	reply_hist;
+	lat_hist_t	reply_hist_co;
+
+	/* Whole acquisitions, first SOLICIT (or REQUEST) to the accepted
+	 * REPLY, and releases, first RELEASE to its REPLY */
+	lat_hist_t	lease_hist;
+	lat_hist_t	lease_hist_co;
+	lat_hist_t	release_hist;
+
+	/* Status codes by message answered, at top level and per IA; a
+	 * reply without one counts as Success */
+	uint64_t	status[DHCPV6_INFORMATION_REQUEST + 1][2][STATUS_KINDS];
+
+	uint64_t	solicits_sent;
+	uint64_t	requests_sent;
+	uint64_t	releases_sent;
+	uint64_t	declines_sent;
+	uint64_t	informs_sent;
+	uint64_t	confirms_sent;
+	uint64_t	renews_sent;
+	uint64_t	rebinds_sent;
+
+	uint64_t	solicit_acks_received;
+	uint64_t	solicit_naks_received;
+	uint64_t	request_acks_received;
+	uint64_t	request_naks_received;
+	uint64_t	decline_acks_received;
+	uint64_t	decline_naks_received;
+	uint64_t	release_acks_received;
+	uint64_t	release_naks_received;
+	uint64_t	inform_acks_received;
+	uint64_t	inform_naks_received;
+	uint64_t	confirm_acks_received;
+	uint64_t	confirm_naks_received;
+	uint64_t	renew_acks_received;
+	uint64_t	renew_naks_received;
+	uint64_t	rebind_acks_received;
+	uint64_t	rebind_naks_received;
+
+	uint64_t	solicit_ack_timeouts;
+	uint64_t	request_ack_timeouts;
+	uint64_t	renew_ack_timeouts;
+	uint64_t	rebind_ack_timeouts;
+	uint64_t	release_ack_timeouts;
+	uint64_t	decline_ack_timeouts;
+	uint64_t	inform_ack_timeouts;
+	uint64_t	confirm_ack_timeouts;
+
+	uint64_t	errors;
+	uint64_t	failed;
+	uint64_t	completed;
 } dhcp_stats_t;
 
 typedef struct IA_DATA_T {
 	uint32_t		iaid;
 	struct in6_addr		ipaddr;
 	uint8_t			prefix_len;
+	uint32_t		t1;		/* as given by the server */
+	uint32_t		t2;
+	uint32_t		preferred;
+	uint32_t		valid;
 } ia_data_t;
 
 typedef struct DHCP_SESSION_T {
-	uint8_t			*transaction_id;
+	uint32_t		txid;		/* outstanding exchange, 0 = none */
 	uint32_t		state;
 	uint8_t			options[DHCP6_OPTION_LEN];
 	uint8_t			options_length;
@@ -100,6 +153,9 @@ typedef struct DHCP_SESSION_T {
 	uint32_t		session_start;
 	uint32_t		lease_time;
 	struct timeval		last_sent;
+	struct timeval		prev_sent;	/* send before last_sent */
+	struct timeval		intended_start;	/* --rate slot, if any */
+	struct timeval		xchg_intended;	/* intended send of exchange */
 	struct timeval		last_received;
 	uint8_t			type_last_received;
 	uint8_t			type_last_sent;
@@ -110,6 +166,19 @@ typedef struct DHCP_SESSION_T {
 	ia_data_t		ia[MAX_IA];
 	uint8_t			num_ia;
 	uint8_t			recv_ia;
+	struct LEASE_DATA_T	*client;	/* --lifecycle client */
+	uint8_t			flow;		/* --mix flow + 1 */
+	struct timeval		xchg_start;	/* first send of exchange */
+	struct timeval		acquire_start;	/* first SOLICIT or REQUEST */
+	struct timeval		acquire_intended;
+	struct timeval		release_start;
+	uint32_t		xchg_tx;	/* sends in this exchange */
+	uint64_t		rt;		/* current RT, usec */
+	uint32_t		mrd;		/* ms, overrides rt_policy */
+	uint16_t		elapsed;	/* Elapsed Time, 1/100 s */
+	uint8_t			fqdn[80];	/* CLIENT_FQDN option, encoded */
+	uint8_t			fqdn_len;
+	uint32_t		seq;		/* $counter */
 } dhcp_session_t;
 
 typedef struct DHCP_SERVER_T {
@@ -120,9 +189,35 @@ typedef struct DHCP_SERVER_T {
 	struct timeval		first_packet_sent;
 	struct timeval		last_packet_sent;
 	struct timeval		last_packet_received;
+	double			cwnd;		/* --adaptive window */
+	struct timeval		aimd_cut;
+	uint64_t		aimd_cuts;
 	struct DHCP_SERVER_T	*next;
 } dhcp_server_t;
 
+/*
+ * Transaction IDs come from a 24-bit counter, so none comes round again
+ * for 2^24 exchanges.  Outstanding ones are in an open addressed table;
+ * the last TXID_RETIRED retired ones are kept, indexed by txid, so a
+ * reply to a finished exchange can be told from a stray one.
+ */
+#define TXID_MASK		0xffffff
+#define TXID_DEAD		(TXID_MASK + 1)
+#define TXID_RETIRED		65536
+typedef struct {
+	uint32_t		txid;		/* 0 = free */
+	dhcp_session_t		*session;
+	dhcp_server_t		*server;
+} txid_slot_t;
+
+typedef struct {
+	uint32_t		txid;
+	uint8_t			type;		/* message it was for */
+	uint8_t			answered;
+	struct timeval		when;
+	struct timeval		sent;		/* its last transmission */
+} txid_retired_t;
+
 
 typedef struct LEASE_DATA_T {
 	uint8_t			mac[6];
@@ -133,8 +228,190 @@ typedef struct LEASE_DATA_T {
 	struct LEASE_DATA_T	*next;
 	ia_data_t		ia[MAX_IA];
 	uint8_t			num_ia;
+
+	/* --lifecycle state */
+	dhcp_server_t		*server;
+	uint32_t		bound_ms;	/* when last (re)bound */
+	uint32_t		t1;		/* seconds, as given by server */
+	uint32_t		t2;
+	uint32_t		valid;
+	uint32_t		renewals;
+	uint8_t			phase;
+	uint8_t			busy;		/* --scenario: in an exchange */
 } lease_data_t;
 
+/*
+ * --lifecycle keeps one pending event per client in a binary min-heap,
+ * so a population of millions costs 8 bytes per client to schedule.
+ */
+typedef struct {
+	uint32_t		due;		/* ms since start of run */
+	uint32_t		client;
+} lc_event_t;
+
+// Lifecycle phases
+#define LC_ACQUIRE		1
+#define LC_RENEW		2
+#define LC_REBIND		3
+#define LC_RELEASE		4
+#define LC_EXPIRE		5
+#define LC_CONFIRM		6
+
+/*
+ * --mix: one entry per flow.  Leases from -f are split between the flows
+ * that need them, in proportion to their expected starts/sec.
+ */
+#define MAX_MIX			  8
+typedef struct {
+	int			type;		/* first message of the flow */
+	uint32_t		weight;
+	double			rate;		/* starts/sec, 0 = by weight */
+	int32_t			current;	/* smooth weighted round robin */
+	lease_data_t		*first;		/* population slice */
+	lease_data_t		*next;
+	uint32_t		nleases;
+	uint32_t		used;
+	uint64_t		started;
+	uint64_t		completed;
+	uint64_t		failed;
+	uint64_t		retransmits;
+	lat_hist_t		latency;
+} mix_flow_t;
+
+/*
+ * --scenario: phases run back to back in one process and share an
+ * in-memory lease population.
+ */
+#define MAX_PHASES		 32
+#define POP_NEW			  1	/* fresh clients */
+#define POP_ACQUIRED		  2	/* leases won by earlier phases */
+#define POP_FILE		  3	/* leases from -f */
+typedef struct {
+	char			name[32];
+	int			type;		/* first message of the flow */
+	uint32_t		count;		/* sessions, 0 = whole population */
+	uint32_t		duration;	/* secs, 0 = until count */
+	double			rate;
+	uint32_t		concurrency;
+	int			population;
+	uint32_t		wait;		/* idle secs before the phase */
+} phase_t;
+
+/*
+ * --interval: statistics are rolled into fixed windows; the last
+ * MAX_WINDOWS are kept for the final report.
+ */
+#define MAX_WINDOWS		720
+typedef struct {
+	uint32_t		end;		/* secs since start */
+	uint64_t		usecs;		/* window length */
+	uint64_t		sent;
+	uint64_t		completed;
+	uint64_t		failed;
+	uint64_t		timeouts;
+	uint64_t		drops;		/* lost on our side */
+	uint64_t		status[STATUS_KINDS];
+	uint64_t		advertise_p99;	/* usec */
+	uint64_t		reply_p50;
+	uint64_t		reply_p99;
+	double			cwnd;		/* sum over servers */
+} window_t;
+
+/* RFC 8415 section 15 retransmission parameters, ms (0 = no limit) */
+typedef struct {
+	uint32_t		irt;
+	uint32_t		mrt;
+	uint32_t		mrc;
+	uint32_t		mrd;
+} rt_policy_t;
+
+typedef struct {
+	uint64_t		exchanges;
+	uint64_t		transmissions;
+	uint64_t		retried;	/* exchanges sent more than once */
+	uint64_t		gave_up;
+} xmit_stats_t;
+
+/*
+ * Transmit scheduler classes.  A session's first message is new, a later
+ * exchange is a follow-up (or release), a repeat is a retransmit.
+ */
+#define TX_NEW			  0
+#define TX_FOLLOWUP		  1
+#define TX_RETRANS		  2
+#define TX_RELEASE		  3
+#define TX_CLASSES		  4
+#define TX_TICK			0.1	/* secs of budget that may burst */
+typedef struct {
+	const char		*name;
+	double			budget;		/* sends/sec, 0 = unlimited */
+	uint32_t		weight;
+	double			credit;
+	uint64_t		sent;
+	uint64_t		window_base;	/* sent at window start */
+} tx_class_t;
+
+/* Decoded reply, pointing into the receive buffer; see decode_reply() */
+#define MAX_RELAYS		 32	/* HOP_COUNT_LIMIT */
+typedef struct {
+	uint16_t		type;		/* D6O_IA_NA, _TA or _PD */
+	uint16_t		status;
+	uint32_t		iaid;
+	uint32_t		t1;
+	uint32_t		t2;
+	const uint8_t		*addr;		/* first IAADDR/IAPREFIX, or NULL */
+	uint8_t			prefix_len;
+	uint32_t		preferred;
+	uint32_t		valid;
+} reply_ia_t;
+typedef struct {
+	const uint8_t		*msg;		/* innermost DHCPv6 message */
+	uint32_t		len;
+	uint8_t			type;
+	uint8_t			relays;		/* RELAY-REPL layers */
+	uint16_t		status;		/* top level */
+	const uint8_t		*serverid;
+	const uint8_t		*clientid;
+	uint16_t		serverid_len;
+	uint16_t		clientid_len;
+	uint8_t			nia;
+	reply_ia_t		ia[MAX_IA];
+} reply_t;
+
+/* Option profile bytecode, see profile_build() */
+#define OP_END			  0
+#define OP_BYTES		  1	/* u16 length, bytes */
+#define OP_OPEN			  2	/* u16 code: start an option */
+#define OP_CLOSE		  3	/* set the open option's length */
+#define OP_MAC			  4
+#define OP_COUNTER		  5	/* u32 session number */
+#define OP_RANDOM		  6	/* u32 */
+#define OP_HOSTNAME		  7
+#define OP_CLIENTID		  8
+#define OP_ELAPSED		  9
+#define OP_IA			 10
+#define OP_SERVERID		 11
+#define OP_FQDN			 12
+#define OP_ORO			 13	/* -I list */
+typedef struct {
+	uint8_t			*code;
+	uint32_t		len;
+	uint32_t		size;
+	int			last;		/* last op if OP_BYTES, else -1 */
+} profile_t;
+
+/* Per message type packet prototype, see tmpl_build() */
+typedef struct {
+	uint8_t			head[64];
+	uint16_t		head_len;
+	uint16_t		mac_off;	/* CLIENTID link-layer address */
+	uint16_t		elapsed_off;
+} tmpl_t;
+
+/* RFC 8415 section 7.6 initial delays, ms */
+#define SOL_MAX_DELAY		1000
+#define CNF_MAX_DELAY		1000
+
 // Session States
 #define UNALLOCATED		0
 #define SESSION_ALLOCATED	1
@@ -166,12 +443,61 @@ typedef struct LEASE_DATA_T {
 #define PACKET_ERROR		(1<<26)
 
 #define DELTATV(a,b) (1000000*(a.tv_sec - b.tv_sec) + a.tv_usec - b.tv_usec)
+#define DELTATV64(a,b) (1000000LL*(a.tv_sec - b.tv_sec) + a.tv_usec - b.tv_usec)
+
+/* Long-only options */
+enum {
+	OPT_RATE = 256,
+	OPT_LIFECYCLE,
+	OPT_COMPRESS,
+	OPT_RENEWALS,
+	OPT_LEASE_END,
+	OPT_HERD,
+	OPT_HERD_MSG,
+	OPT_MIX,
+	OPT_SCENARIO,
+	OPT_DURATION,
+	OPT_INTERVAL,
+	OPT_ADAPTIVE,
+	OPT_RFC_RETRANS,
+	OPT_RETRANS,
+	OPT_TX_BUDGET,
+	OPT_TX_WEIGHT,
+	OPT_TX_RATE,
+	OPT_PROFILE,
+	OPT_RAW,
+	OPT_XDP,
+	OPT_GSO,
+	OPT_GRO,
+	OPT_BUSY_POLL,
+	OPT_CPU,
+	OPT_BREAKDOWN,
+	OPT_JSON,
+	OPT_SLO,
+};
 
 /* Globals */
 __const char *typestrings[] = {"SOLICIT", "ADVERTISE", "REQUEST",
 		"CONFIRM", "RENEW", "REBIND", "REPLY", "RELEASE", "DECLINE",
 		"RECONFIGURE", "INFORMATION_REQUEST", "RELAY_FORW", "RELAY_REPL",
 		"LEASEQUERY", "LEASEQUERY_REPLY"};
+/* dhcp_stats_t counters, solicits_sent through completed */
+__const char *statnames[] = {"solicits_sent", "requests_sent",
+		"releases_sent", "declines_sent", "informs_sent", "confirms_sent",
+		"renews_sent", "rebinds_sent", "solicit_acks_received",
+		"solicit_naks_received", "request_acks_received",
+		"request_naks_received", "decline_acks_received",
+		"decline_naks_received", "release_acks_received",
+		"release_naks_received", "inform_acks_received",
+		"inform_naks_received", "confirm_acks_received",
+		"confirm_naks_received", "renew_acks_received", "renew_naks_received",
+		"rebind_acks_received", "rebind_naks_received",
+		"solicit_ack_timeouts", "request_ack_timeouts", "renew_ack_timeouts",
+		"rebind_ack_timeouts", "release_ack_timeouts", "decline_ack_timeouts",
+		"inform_ack_timeouts", "confirm_ack_timeouts", "errors", "failed",
+		"completed"};
+__const char *statusstrings[] = {"Success", "UnspecFail", "NoAddrsAvail",
+		"NoBinding", "NotOnLink", "UseMulticast", "NoPrefixAvail", "other"};
 __const char *optionstrings[] = { "CLIENTID", "SERVERID", "IA_NA",
 		"IA_TA", "IAADDR", "ORO", "PREFERENCE", "ELAPSED_TIME",
 		"RELAY_MSG", "!UNASSIGNED!", "AUTH", "UNICAST", "STATUS_CODE",
@@ -207,6 +533,175 @@ static int		rapid_commit;
 static int		server_should_ddns = 1;
 static uint32_t		timeout = 5000000UL;
 static uint32_t		number_requests=1;
+static double		target_rate;
+static uint32_t		lifecycle;
+static double		time_compress = 1.0;
+static uint32_t		max_renewals;
+static int		release_at_end;
+static lease_data_t	*clients;
+static uint32_t		nclients;
+static lc_event_t	*lc_heap;
+static uint32_t		lc_heap_len;
+static struct timeval	lc_start_time;
+static uint32_t		herd_window;	/* ms, 0 = off */
+static int		herd_msg = DHCPV6_CONFIRM;
+static lat_hist_t	herd_recover;
+static uint64_t		herd_fallback;
+static uint64_t		herd_lost;
+static mix_flow_t	mix[MAX_MIX];
+static int		nmix;
+static phase_t		phases[MAX_PHASES];
+static int		nphases;
+static uint32_t		session_window;	/* 0 = max_sessions */
+static lease_data_t	**population;
+static uint32_t		npopulation;
+static uint32_t		soak_duration;	/* secs, 0 = off */
+static uint32_t		stat_interval;	/* secs, 0 = off */
+static uint32_t		adaptive;	/* latency target ms, 0 = off */
+static int		rfc_retrans;
+/* RFC 8415 section 7.6 defaults; RENEW/REBIND MRD is the time left to
+   T2/valid lifetime when it is known (--lifecycle) */
+static rt_policy_t	rt_policy[DHCPV6_INFORMATION_REQUEST + 1] = {
+	[DHCPV6_SOLICIT]		= {1000, 3600000,  0,     0},
+	[DHCPV6_REQUEST]		= {1000,   30000, 10,     0},
+	[DHCPV6_CONFIRM]		= {1000,    4000,  0, 10000},
+	[DHCPV6_RENEW]			= {10000, 600000,  0,     0},
+	[DHCPV6_REBIND]			= {10000, 600000,  0,     0},
+	[DHCPV6_RELEASE]		= {1000,       0,  4,     0},
+	[DHCPV6_DECLINE]		= {1000,       0,  4,     0},
+	[DHCPV6_INFORMATION_REQUEST]	= {1000, 3600000,  0,     0},
+};
+static xmit_stats_t	xmit_stats[DHCPV6_INFORMATION_REQUEST + 1];
+static tmpl_t		templates[DHCPV6_INFORMATION_REQUEST + 1];
+static uint8_t		*tmpl_tail;
+static uint16_t		tmpl_tail_len;
+static profile_t	profiles[DHCPV6_INFORMATION_REQUEST + 1];
+static char		*profile_file;
+static uint32_t		session_seq;
+static uint64_t		replies_malformed;
+static txid_slot_t	*txid_live;
+static uint32_t		txid_size, txid_used, txid_dead;
+static uint32_t		txid_next;
+static txid_retired_t	txid_retired[TXID_RETIRED];
+static uint64_t		replies_duplicate;	/* exchange already answered */
+static uint64_t		replies_late;		/* exchange given up on */
+static uint64_t		replies_unmatched;	/* to no txid of ours */
+static uint64_t		replies_retransmitted;	/* answered after a retransmit */
+static uint64_t		replies_crossed;	/* ...stamped before it went out */
+static lat_hist_t	late_by;		/* usecs after giving up */
+static lat_hist_t	late_latency;		/* usecs after the last send */
+static uint64_t		window_status[STATUS_KINDS];
+
+/*
+ * --breakdown: reply latency and session outcome per combination of the
+ * chosen dimensions.  The first MAX_DIM_KEYS combinations get a row each,
+ * later ones share a last "other" row, so the cost is fixed.
+ */
+#define DIM_SERVER		0x01
+#define DIM_MSG			0x02
+#define DIM_IA			0x04		/* IAs requested */
+#define DIM_IATYPE		0x08		/* IA_NA or IA_PD */
+#define DIM_RELAY		0x10
+#define DIM_FQDN		0x20
+#define DIM_FLOW		0x40		/* --mix flow */
+#define MAX_DIM_KEYS		 64
+typedef struct {
+	uint32_t		key;
+	uint64_t		replies;
+	uint64_t		naks;
+	uint64_t		completed;
+	uint64_t		failed;
+	lat_hist_t		latency;
+} dim_row_t;
+static uint32_t		dims;
+static dim_row_t	dim_rows[MAX_DIM_KEYS + 1];
+static uint32_t		ndim_rows;
+/*
+ * --slo: thresholds checked at the end of the run.  Each kind of breach
+ * sets its own bit in the exit status, above the 1 for failures.
+ */
+#define SLO_RATE		  0	/* leases/sec, minimum */
+#define SLO_ADV_P99		  1	/* ms */
+#define SLO_REPLY_P99		  2	/* ms */
+#define SLO_TIMEOUTS		  3	/* % of messages sent */
+#define SLO_NAK			  4	/* % of status codes not Success */
+#define SLO_DROPS		  5	/* packets lost on our side */
+#define SLO_STATUS		  6	/* + status code, % of status codes */
+#define SLO_CHECKS		(SLO_STATUS + STATUS_KINDS)
+typedef struct {
+	const char		*name;
+	int			bit;		/* exit status bit */
+	int			set;
+	double			limit;
+	double			actual;
+	int			breached;
+} slo_t;
+static slo_t		slo[SLO_CHECKS] = {
+	[SLO_RATE]		= {"rate",	0x02},
+	[SLO_ADV_P99]		= {"adv_p99",	0x04},
+	[SLO_REPLY_P99]		= {"reply_p99",	0x04},
+	[SLO_TIMEOUTS]		= {"timeouts",	0x08},
+	[SLO_NAK]		= {"nak",	0x10},
+	[SLO_DROPS]		= {"drops",	0x20},
+};
+static int		slo_set;
+static char		*json_file;		/* --json */
+static char		**cmd_argv;		/* as given, for --json */
+static int		cmd_argc;
+static char		*raw_ifname;		/* --raw */
+static uint8_t		raw_gwmac[6];
+static int		raw_have_gw;
+static uint8_t		raw_mac[6];
+static int		raw_mode;		/* --xdp */
+#define GSO_MAX_SEGS		 64
+static int		use_gso, use_gro;	/* --gso, --gro */
+static uint8_t		gso_buf[65000];
+static uint32_t		gso_len, gso_seg, gso_n;
+static int		gso_fresh;		/* added to since reader() */
+static dhcp_server_t	*gso_server;
+static dhcp_session_t	*gso_sessions[GSO_MAX_SEGS];
+static uint32_t		gso_txids[GSO_MAX_SEGS];	/* session txid when added */
+static uint64_t		gso_calls, gso_datagrams;
+static uint64_t		gro_reads, gro_datagrams;
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL	 69
+#endif
+static int		busy_poll;		/* --busy-poll usecs */
+static int		pin_cpu = -1;		/* --cpu */
+static lat_hist_t	noise_tx, noise_rx, noise_gap;
+
+/* Replies and requests lost inside the generator's host */
+typedef struct {
+	uint64_t		rxq;		/* socket queue or --raw ring */
+	uint64_t		rcvbuf;		/* Udp6RcvbufErrors, system-wide */
+	uint64_t		sndbuf;		/* Udp6SndbufErrors, system-wide */
+} drops_t;
+static uint32_t		rxq_ovfl;		/* SO_RXQ_OVFL, cumulative */
+static drops_t		drops_base;		/* at start */
+static tx_class_t	tx_class[TX_CLASSES] = {
+	{ .name = "new" }, { .name = "followup" },
+	{ .name = "retransmit" }, { .name = "release" }
+};
+static int		tx_sched;
+static double		tx_rate;	/* shared by --tx-weight */
+static struct timeval	tx_refill;
+static struct timeval	window_start;
+static lat_hist_t	window_advertise;
+static lat_hist_t	window_reply;
+static window_t		window_total;	/* counters at window_start */
+static window_t		windows[MAX_WINDOWS];
+static uint64_t		nwindows;
+static struct {
+	uint64_t	acquired;
+	uint64_t	acquire_failed;
+	uint64_t	renewed;
+	uint64_t	renew_failed;
+	uint64_t	rebound;
+	uint64_t	rebind_failed;
+	uint64_t	released;
+	uint64_t	expired;
+	uint64_t	bound;
+} lc_stats;
 static uint32_t		max_sessions = 25;
 static uint32_t		num_per_mac = 1;
 static dhcp_server_t	*servers;
@@ -234,7 +729,31 @@ static struct option_st {
 } **extraoptions = NULL;
 
 /* Function prototypes */
-static void			reader(void);
+static void			reader(int);
+static void			gso_add(dhcp_server_t *, dhcp_session_t *, uint8_t *, int);
+static void			gso_flush(void);
+static int			rx_poll(struct pollfd *, int);
+static void			noise_print(FILE *);
+static void			local_drops(drops_t *);
+static uint64_t			drops_lost(drops_t *);
+static uint64_t			stats_timeouts(dhcp_stats_t *);
+static void			drops_report(void);
+static txid_slot_t		*txid_find(uint32_t);
+static void			txid_alloc(dhcp_server_t *, dhcp_session_t *);
+static void			txid_retire(dhcp_session_t *, int, struct timeval *);
+static void			late_report(void);
+static void			status_count(dhcp_stats_t *, int, reply_t *);
+static void			status_report(dhcp_stats_t *);
+static dim_row_t		*dim_row(dhcp_server_t *, dhcp_session_t *);
+static void			dim_report(void);
+static void			dim_label(dim_row_t *, char *, size_t);
+static void			json_report(int);
+static int			slo_parse(char *);
+static int			slo_check(void);
+static void			json_str(FILE *, const char *);
+static void			json_hist(FILE *, const char *, lat_hist_t *);
+static uint64_t			hist_lo(uint32_t);
+static void			lease_sample(dhcp_stats_t *, dhcp_session_t *, struct timeval *);
 static void			sender(void);
 static void			fill_session(dhcp_session_t *, lease_data_t *);
 static int			process_packet(void *, struct timeval *, uint32_t);
@@ -245,7 +764,11 @@ static uint32_t			read_lease_data(lease_data_t **);
 static void			usage(void);
 static int			process_sessions(void);
 static void			print_packet(uint32_t, struct dhcpv6_packet *, const char *);
-static int			test_statistics(void);
+static const char		*option_name(uint16_t);
+static int			opt_next(const uint8_t *, uint32_t, uint32_t *, uint16_t *, uint16_t *, const uint8_t **);
+static int			ia_decode(reply_ia_t *, uint16_t, const uint8_t *, uint16_t);
+static int			decode_reply(const uint8_t *, uint32_t, reply_t *);
+static int			test_statistics(int);
 static struct in6_addr		get_local_addr(void);
 static int			addoption(int , char *);
 static dhcp_session_t		*find_free_session(dhcp_server_t *);
@@ -258,4 +781,63 @@ void				decode_state(uint32_t);
 int				encode_domain(char *, uint8_t *);
 int 				fill_iafu_mess( dhcp_session_t *, uint8_t *);
 int				parse_opt_seq( char *);
-int				add_opt_seq(uint8_t, uint8_t *, dhcp_session_t *);
+static int			rate_slot(uint64_t, struct timeval *, int *);
+static void			session_done(dhcp_server_t *, dhcp_session_t *, int);
+static void			lifecycle_sender(void);
+static void			lc_schedule(uint32_t, uint8_t, uint32_t);
+static void			lc_pop(void);
+static void			lc_start(dhcp_session_t *, lease_data_t *, dhcp_server_t *);
+static void			lc_session_done(dhcp_server_t *, dhcp_session_t *, int);
+static uint32_t			lc_now(void);
+static uint32_t			lc_after(uint32_t, uint32_t);
+static void			herd_sender(void);
+static void			herd_session_done(dhcp_server_t *, dhcp_session_t *, int);
+static uint32_t			herd_delay(int);
+static uint64_t			hist_at(lat_hist_t *, uint64_t);
+static void			mix_sender(void);
+static int			mix_parse(char *);
+static mix_flow_t		*mix_pick(int *, struct timeval *);
+static int			mix_spent(mix_flow_t *);
+static void			mix_start(dhcp_session_t *, mix_flow_t *, dhcp_server_t *);
+static int			msg_type_by_name(const char *);
+static void			scenario_sender(void);
+static int			scenario_parse(const char *);
+static void			scn_session_done(dhcp_server_t *, dhcp_session_t *, int);
+static void			save_lease(lease_data_t *, dhcp_session_t *, dhcp_server_t *);
+static uint32_t			soak_client(uint8_t *);
+static lease_data_t		*soak_next_lease(void);
+static int			parse_lease_line(char *, int, lease_data_t *);
+static void			window_sum(window_t *);
+static void			window_rebase(void);
+static void			interval_check(struct timeval *);
+static void			window_report(void);
+static void			aimd_sample(dhcp_server_t *, dhcp_session_t *, uint64_t);
+static void			aimd_loss(dhcp_server_t *, dhcp_session_t *);
+static void			rt_next(dhcp_session_t *, uint8_t, struct timeval *);
+static int			retrans_due(dhcp_session_t *, struct timeval *);
+static int			retrans_more(dhcp_session_t *, struct timeval *);
+static int			retrans_parse(char *);
+static int			pack_elapsed_time(uint8_t *, dhcp_session_t *);
+static int			retrans_left(dhcp_session_t *, struct timeval *);
+static int			tx_ready(int);
+static int			tx_parse(char *, int);
+static void			tx_setup(void);
+static void			tmpl_build(void);
+static int			tmpl_fill(uint8_t, uint8_t *, dhcp_session_t *);
+static int			pack_client_id(uint8_t *, uint8_t *);
+static int			pack_server_id(uint8_t *, dhcp_session_t *);
+static void			prog_emit(profile_t *, uint8_t, const void *, int);
+static int			profile_value(char *, uint8_t *);
+static int			option_by_name(const char *);
+static int			profile_compile(profile_t *, char **, int);
+static int			profile_parse(const char *);
+static int			profile_from_seq(void);
+static void			profile_build(void);
+static int			profile_run(profile_t *, uint8_t *, dhcp_session_t *);
+static uint32_t			profile_maxlen(profile_t *);
+static void			stats_add(dhcp_stats_t *, dhcp_stats_t *);
+static void			stats_reset(dhcp_server_t *);
+static void			hist_merge(lat_hist_t *, lat_hist_t *);
+static void			hist_add(lat_hist_t *, int64_t);
+static uint64_t			hist_percentile(lat_hist_t *, double);
+static void			hist_print(FILE *, const char *, lat_hist_t *, lat_hist_t *);
@@ -0,0 +1,892 @@
+/*
+    rawnet.c: raw L2 transport for dras6 --raw.
+
+    One AF_PACKET socket with a TPACKET_V3 receive ring and a transmit
+    ring mapped together, or with --xdp an AF_XDP socket on queue 0.
+    Frames are built straight into the TX ring (or UMEM) and handed to
+    the kernel in batches by raw_flush(); received frames are walked in
+    place by raw_recv().
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <arpa/inet.h>
+#include "rawnet.h"
+
+raw_stats_t		raw_stats;
+
+#ifdef linux
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <netinet/icmp6.h>
+#include <sys/syscall.h>
+#include <linux/if_xdp.h>
+#include <linux/if_link.h>
+#include <linux/bpf.h>
+
+#define RAW_FRAME	2048
+#define RAW_BLOCK	(1 << 18)
+#define RAW_RX_BLOCKS	64
+#define RAW_TX_BLOCKS	16
+#define RAW_TX_FRAMES	(RAW_TX_BLOCKS * (RAW_BLOCK / RAW_FRAME))
+#define ETH_LEN		14
+#define IP6_LEN		40
+#define UDP_LEN		8
+#define XDP_RING	4096
+#define XDP_FRAMES	(2 * XDP_RING)	/* half RX, half TX */
+#define XDP_ND_MAX	(1 << 20)	/* live clients the NS filter knows */
+
+typedef struct {
+	uint32_t		*prod;
+	uint32_t		*cons;
+	uint32_t		*flags;
+	void			*desc;
+	uint32_t		cached;		/* our producer or consumer */
+} xring_t;
+
+static int		raw_sock = -1;
+static uint8_t		*rx_ring, *tx_ring;
+static uint32_t		rx_cur, tx_cur, tx_pending;
+static uint8_t		ifmac[6];
+static uint8_t		gwmac[6];
+static int		have_gwmac;
+static uint16_t		rx_port;
+static struct tpacket3_hdr	*tx_hdr;	/* slot from tx_frame() */
+static int		xsk = -1;
+static uint8_t		*umem;
+static xring_t		xfill, xcomp, xrx, xtx;
+static uint64_t		xfree[XDP_RING];	/* free TX frames */
+static uint32_t		nxfree;
+static uint64_t		xtx_addr;		/* frame from tx_frame() */
+static int		nd_map = -1;		/* live clients, for xdp_prog() */
+
+static uint32_t csum_add(uint32_t sum, const void *data, uint32_t len)
+{
+	const uint8_t	*p = data;
+
+	for (; len > 1; len -= 2, p += 2)
+		sum += p[0] << 8 | p[1];
+	if (len)
+		sum += p[0] << 8;
+	return(sum);
+}
+
+static uint16_t csum_fold(uint32_t sum)
+{
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return(~sum);
+}
+
+static int tpacket_open(int ifindex)
+{
+	struct tpacket_req3	req;
+	struct sockaddr_ll	sll;
+	int			val;
+	size_t			rx_size, tx_size;
+
+	val = TPACKET_V3;
+	if (setsockopt(raw_sock, SOL_PACKET, PACKET_VERSION, &val, sizeof(val)) < 0){
+		perror("raw: TPACKET_V3");
+		return(-1);
+	}
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = RAW_BLOCK;
+	req.tp_frame_size = RAW_FRAME;
+	req.tp_block_nr = RAW_RX_BLOCKS;
+	req.tp_frame_nr = RAW_RX_BLOCKS * (RAW_BLOCK / RAW_FRAME);
+	req.tp_retire_blk_tov = 1;
+	if (setsockopt(raw_sock, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0){
+		perror("raw: PACKET_RX_RING");
+		return(-1);
+	}
+	rx_size = (size_t) RAW_RX_BLOCKS * RAW_BLOCK;
+	req.tp_block_nr = RAW_TX_BLOCKS;
+	req.tp_frame_nr = RAW_TX_FRAMES;
+	req.tp_retire_blk_tov = 0;
+	if (setsockopt(raw_sock, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0){
+		perror("raw: PACKET_TX_RING");
+		return(-1);
+	}
+	tx_size = (size_t) RAW_TX_BLOCKS * RAW_BLOCK;
+	rx_ring = mmap(NULL, rx_size + tx_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_LOCKED | MAP_POPULATE, raw_sock, 0);
+	if (rx_ring == MAP_FAILED)
+		rx_ring = mmap(NULL, rx_size + tx_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED, raw_sock, 0);
+	if (rx_ring == MAP_FAILED){
+		perror("raw: mmap");
+		return(-1);
+	}
+	tx_ring = rx_ring + rx_size;
+
+	/* Best effort: skip the qdisc, and don't see our own frames */
+	val = 1;
+	setsockopt(raw_sock, SOL_PACKET, PACKET_QDISC_BYPASS, &val, sizeof(val));
+#ifdef PACKET_IGNORE_OUTGOING
+	setsockopt(raw_sock, SOL_PACKET, PACKET_IGNORE_OUTGOING, &val, sizeof(val));
+#endif
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(ETH_P_IPV6);
+	sll.sll_ifindex = ifindex;
+	if (bind(raw_sock, (struct sockaddr *) &sll, sizeof(sll)) < 0){
+		perror("raw: bind");
+		return(-1);
+	}
+	return(0);
+}
+
+static int xring_map(xring_t *r, struct xdp_ring_offset *off, uint64_t pgoff,
+		size_t dsize)
+{
+	uint8_t		*p;
+
+	p = mmap(NULL, off->desc + XDP_RING * dsize, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, xsk, pgoff);
+	if (p == MAP_FAILED){
+		perror("xdp: mmap ring");
+		return(-1);
+	}
+	r->prod = (uint32_t *) (p + off->producer);
+	r->cons = (uint32_t *) (p + off->consumer);
+	r->flags = (uint32_t *) (p + off->flags);
+	r->desc = p + off->desc;
+	return(0);
+}
+
+static int sys_bpf(int cmd, union bpf_attr *attr)
+{
+	return(syscall(__NR_bpf, cmd, attr, sizeof(*attr)));
+}
+
+#define INSN(c, d, s, o, i)	((struct bpf_insn) {(c), (d), (s), (o), (i)})
+
+/*
+    XDP program: UDP to port, and Neighbor Solicitations whose target is
+    a live client's EUI-64 address (its interface ID is in ndmap), go to
+    the socket bound to the receiving queue.  Everything else, including
+    ND for the host's own addresses, goes to the stack:
+
+	if (data + 58 > data_end || eth.type != IPv6) pass
+	if (ip6.nxt == ICMPV6){
+		if (data + 78 > data_end || icmp.type != NS) pass
+		if (!bpf_map_lookup_elem(ndmap, ns.target + 8)) pass
+	}
+	else if (ip6.nxt != UDP || udp.dport != port) pass
+	return bpf_redirect_map(xskmap, rx_queue_index, XDP_PASS)
+*/
+static int xdp_prog(int map, int ndmap, uint16_t port)
+{
+	struct bpf_insn	prog[] = {
+		INSN(BPF_LDX | BPF_MEM | BPF_W, 2, 1, 0, 0),
+		INSN(BPF_LDX | BPF_MEM | BPF_W, 3, 1, 4, 0),
+		INSN(BPF_ALU64 | BPF_MOV | BPF_X, 6, 1, 0, 0),
+		INSN(BPF_ALU64 | BPF_MOV | BPF_X, 4, 2, 0, 0),
+		INSN(BPF_ALU64 | BPF_ADD | BPF_K, 4, 0, 0, ETH_LEN + IP6_LEN + 4),
+		INSN(BPF_JMP | BPF_JGT | BPF_X, 4, 3, 24, 0),
+		INSN(BPF_LDX | BPF_MEM | BPF_H, 4, 2, 12, 0),
+		INSN(BPF_JMP | BPF_JNE | BPF_K, 4, 0, 22, htons(ETH_P_IPV6)),
+		INSN(BPF_LDX | BPF_MEM | BPF_B, 4, 2, ETH_LEN + 6, 0),
+		INSN(BPF_JMP | BPF_JEQ | BPF_K, 4, 0, 9, IPPROTO_ICMPV6),
+		INSN(BPF_JMP | BPF_JNE | BPF_K, 4, 0, 19, IPPROTO_UDP),
+		INSN(BPF_LDX | BPF_MEM | BPF_H, 4, 2, ETH_LEN + IP6_LEN + 2, 0),
+		INSN(BPF_JMP | BPF_JNE | BPF_K, 4, 0, 17, htons(port)),
+		/* redirect: */
+		INSN(BPF_LDX | BPF_MEM | BPF_W, 2, 6, 16, 0),
+		INSN(BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, map),
+		INSN(0, 0, 0, 0, 0),
+		INSN(BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS),
+		INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map),
+		INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+		/* ICMPv6: */
+		INSN(BPF_ALU64 | BPF_MOV | BPF_X, 4, 2, 0, 0),
+		INSN(BPF_ALU64 | BPF_ADD | BPF_K, 4, 0, 0, ETH_LEN + IP6_LEN + 24),
+		INSN(BPF_JMP | BPF_JGT | BPF_X, 4, 3, 8, 0),
+		INSN(BPF_LDX | BPF_MEM | BPF_B, 4, 2, ETH_LEN + IP6_LEN, 0),
+		INSN(BPF_JMP | BPF_JNE | BPF_K, 4, 0, 6, ND_NEIGHBOR_SOLICIT),
+		INSN(BPF_ALU64 | BPF_ADD | BPF_K, 2, 0, 0, ETH_LEN + IP6_LEN + 16),
+		INSN(BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, ndmap),
+		INSN(0, 0, 0, 0, 0),
+		INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem),
+		INSN(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 1, 0),
+		INSN(BPF_JMP | BPF_JA, 0, 0, -17, 0),
+		/* pass: */
+		INSN(BPF_ALU64 | BPF_MOV | BPF_K, 0, 0, 0, XDP_PASS),
+		INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+	};
+	union bpf_attr	attr;
+	static char	log[4096];
+	int		fd;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.prog_type = BPF_PROG_TYPE_XDP;
+	attr.insns = (uintptr_t) prog;
+	attr.insn_cnt = sizeof(prog) / sizeof(prog[0]);
+	attr.license = (uintptr_t) "GPL";
+	attr.log_buf = (uintptr_t) log;
+	attr.log_size = sizeof(log);
+	attr.log_level = 1;
+	if ((fd = sys_bpf(BPF_PROG_LOAD, &attr)) < 0)
+		fprintf(stderr,"xdp: program load: %s\n%s", strerror(errno), log);
+	return(fd);
+}
+
+/* AF_XDP socket on queue 0 of ifindex, with the redirect program attached */
+static int xdp_open(int ifindex, int mode, uint16_t port)
+{
+	struct xdp_umem_reg	mr;
+	struct xdp_mmap_offsets	off;
+	struct sockaddr_xdp	sxdp;
+	union bpf_attr		attr;
+	socklen_t		len = sizeof(off);
+	uint32_t		i, key = 0, n = XDP_RING;
+	int			map, prog, link;
+
+	if ((xsk = socket(AF_XDP, SOCK_RAW, 0)) < 0){
+		perror("xdp: socket");
+		return(-1);
+	}
+	umem = mmap(NULL, (size_t) XDP_FRAMES * RAW_FRAME, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (umem == MAP_FAILED){
+		perror("xdp: umem");
+		return(-1);
+	}
+	memset(&mr, 0, sizeof(mr));
+	mr.addr = (uintptr_t) umem;
+	mr.len = (uint64_t) XDP_FRAMES * RAW_FRAME;
+	mr.chunk_size = RAW_FRAME;
+	if (setsockopt(xsk, SOL_XDP, XDP_UMEM_REG, &mr, sizeof(mr)) < 0 ||
+			setsockopt(xsk, SOL_XDP, XDP_UMEM_FILL_RING, &n, sizeof(n)) < 0 ||
+			setsockopt(xsk, SOL_XDP, XDP_UMEM_COMPLETION_RING, &n, sizeof(n)) < 0 ||
+			setsockopt(xsk, SOL_XDP, XDP_RX_RING, &n, sizeof(n)) < 0 ||
+			setsockopt(xsk, SOL_XDP, XDP_TX_RING, &n, sizeof(n)) < 0 ||
+			getsockopt(xsk, SOL_XDP, XDP_MMAP_OFFSETS, &off, &len) < 0){
+		perror("xdp: rings");
+		return(-1);
+	}
+	if (xring_map(&xrx, &off.rx, XDP_PGOFF_RX_RING, sizeof(struct xdp_desc)) < 0 ||
+			xring_map(&xtx, &off.tx, XDP_PGOFF_TX_RING, sizeof(struct xdp_desc)) < 0 ||
+			xring_map(&xfill, &off.fr, XDP_UMEM_PGOFF_FILL_RING, sizeof(uint64_t)) < 0 ||
+			xring_map(&xcomp, &off.cr, XDP_UMEM_PGOFF_COMPLETION_RING, sizeof(uint64_t)) < 0)
+		return(-1);
+
+	/* The first XDP_RING frames receive, the rest transmit */
+	for (i = 0; i < XDP_RING; i++){
+		((uint64_t *) xfill.desc)[i] = (uint64_t) i * RAW_FRAME;
+		xfree[i] = (uint64_t) (XDP_RING + i) * RAW_FRAME;
+	}
+	nxfree = XDP_RING;
+	xfill.cached = XDP_RING;
+	__atomic_store_n(xfill.prod, xfill.cached, __ATOMIC_RELEASE);
+
+	memset(&sxdp, 0, sizeof(sxdp));
+	sxdp.sxdp_family = AF_XDP;
+	sxdp.sxdp_ifindex = ifindex;
+	sxdp.sxdp_queue_id = 0;
+	sxdp.sxdp_flags = XDP_USE_NEED_WAKEUP |
+		(mode == RAW_XDP_ZC ? XDP_ZEROCOPY : XDP_COPY);
+	if (bind(xsk, (struct sockaddr *) &sxdp, sizeof(sxdp)) < 0){
+		perror("xdp: bind");
+		return(-1);
+	}
+
+	memset(&attr, 0, sizeof(attr));
+	attr.map_type = BPF_MAP_TYPE_XSKMAP;
+	attr.key_size = sizeof(uint32_t);
+	attr.value_size = sizeof(uint32_t);
+	attr.max_entries = 1;
+	if ((map = sys_bpf(BPF_MAP_CREATE, &attr)) < 0){
+		perror("xdp: XSKMAP");
+		return(-1);
+	}
+	memset(&attr, 0, sizeof(attr));
+	attr.map_fd = map;
+	attr.key = (uintptr_t) &key;
+	attr.value = (uintptr_t) &xsk;
+	if (sys_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0){
+		perror("xdp: XSKMAP update");
+		return(-1);
+	}
+	/* Interface IDs of live clients, for the program's NS filter */
+	memset(&attr, 0, sizeof(attr));
+	attr.map_type = BPF_MAP_TYPE_HASH;
+	attr.key_size = 8;
+	attr.value_size = 1;
+	attr.max_entries = XDP_ND_MAX;
+	attr.map_flags = BPF_F_NO_PREALLOC;
+	if ((nd_map = sys_bpf(BPF_MAP_CREATE, &attr)) < 0){
+		perror("xdp: ND map");
+		return(-1);
+	}
+	if ((prog = xdp_prog(map, nd_map, port)) < 0)
+		return(-1);
+	/* The link detaches the program when we exit */
+	memset(&attr, 0, sizeof(attr));
+	attr.link_create.prog_fd = prog;
+	attr.link_create.target_ifindex = ifindex;
+	attr.link_create.attach_type = BPF_XDP;
+	attr.link_create.flags = mode == RAW_XDP_SKB ? XDP_FLAGS_SKB_MODE : XDP_FLAGS_DRV_MODE;
+	if ((link = sys_bpf(BPF_LINK_CREATE, &attr)) < 0){
+		perror("xdp: attach");
+		return(-1);
+	}
+	return(0);
+}
+
+/*
+    Open ifname; dmac is the next hop for unicast destinations, or NULL.
+    mode is RAW_TPACKET or one of the RAW_XDP_ modes.
+*/
+int raw_open(const char *ifname, const uint8_t *dmac, uint16_t port, int mode)
+{
+	struct packet_mreq	mr;
+	struct ifreq		ifr;
+
+	/* With AF_XDP this socket only holds the interface promiscuous */
+	if ((raw_sock = socket(AF_PACKET, SOCK_RAW, mode ? 0 : htons(ETH_P_IPV6))) < 0){
+		perror("raw: socket");
+		return(-1);
+	}
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+	if (ioctl(raw_sock, SIOCGIFHWADDR, &ifr) < 0){
+		perror(ifname);
+		return(-1);
+	}
+	memcpy(ifmac, ifr.ifr_hwaddr.sa_data, 6);
+	if (ioctl(raw_sock, SIOCGIFINDEX, &ifr) < 0){
+		perror(ifname);
+		return(-1);
+	}
+	if ((mode ? xdp_open(ifr.ifr_ifindex, mode, port) : tpacket_open(ifr.ifr_ifindex)) < 0)
+		return(-1);
+
+	/* Replies are addressed to the clients' MACs, not ours */
+	memset(&mr, 0, sizeof(mr));
+	mr.mr_ifindex = ifr.ifr_ifindex;
+	mr.mr_type = PACKET_MR_PROMISC;
+	if (setsockopt(raw_sock, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mr, sizeof(mr)) < 0)
+		perror("raw: promiscuous mode");
+
+	if (dmac != NULL){
+		memcpy(gwmac, dmac, 6);
+		have_gwmac = 1;
+	}
+	rx_port = port;
+	return(0);
+}
+
+int raw_fd(void)
+{
+	return(xsk >= 0 ? xsk : raw_sock);
+}
+
+void raw_ifmac(uint8_t *mac)
+{
+	memcpy(mac, ifmac, 6);
+}
+
+/* fe80::/64 with the modified EUI-64 of mac */
+void raw_linklocal(const uint8_t *mac, struct in6_addr *ll)
+{
+	memset(ll, 0, sizeof(*ll));
+	ll->s6_addr[0] = 0xfe;
+	ll->s6_addr[1] = 0x80;
+	ll->s6_addr[8] = mac[0] ^ 0x02;
+	ll->s6_addr[9] = mac[1];
+	ll->s6_addr[10] = mac[2];
+	ll->s6_addr[11] = 0xff;
+	ll->s6_addr[12] = 0xfe;
+	ll->s6_addr[13] = mac[3];
+	ll->s6_addr[14] = mac[4];
+	ll->s6_addr[15] = mac[5];
+}
+
+/* Completed AF_XDP transmits back onto the free list */
+static void xdp_reap(void)
+{
+	uint32_t	prod = __atomic_load_n(xcomp.prod, __ATOMIC_ACQUIRE);
+
+	for (; xcomp.cached != prod; xcomp.cached++)
+		xfree[nxfree++] = ((uint64_t *) xcomp.desc)[xcomp.cached & (XDP_RING - 1)];
+	__atomic_store_n(xcomp.cons, xcomp.cached, __ATOMIC_RELEASE);
+}
+
+/* Next free TX frame, kicking the kernel if the ring is full */
+static uint8_t *tx_frame(void)
+{
+	int		spins = 0;
+
+	while (1){
+		if (xsk >= 0){
+			if (nxfree == 0)
+				xdp_reap();
+			if (nxfree){
+				xtx_addr = xfree[--nxfree];
+				return(umem + xtx_addr);
+			}
+		}
+		else {
+			tx_hdr = (struct tpacket3_hdr *) (tx_ring + (size_t) tx_cur * RAW_FRAME);
+			if (tx_hdr->tp_status == TP_STATUS_AVAILABLE)
+				return((uint8_t *) tx_hdr + TPACKET3_HDRLEN - sizeof(struct sockaddr_ll));
+		}
+		if (spins++ == 0)
+			raw_stats.tx_stalls++;
+		raw_flush();
+		if (spins > 1000){
+			usleep(100);
+			if (spins > 11000)
+				return(NULL);
+		}
+		__sync_synchronize();
+	}
+}
+
+/* Ethernet and IPv6 headers at f; returns the IPv6 payload */
+static uint8_t *frame_head(uint8_t *f, const uint8_t *dmac, const uint8_t *smac,
+		const uint8_t *src, const uint8_t *dst, uint8_t nh, uint8_t hl,
+		uint16_t plen)
+{
+	memcpy(f, dmac, 6);
+	memcpy(f + 6, smac, 6);
+	f[12] = ETH_P_IPV6 >> 8;
+	f[13] = ETH_P_IPV6 & 0xff;
+	f += ETH_LEN;
+	*((uint32_t *) f) = htonl(0x60000000);
+	*((uint16_t *) (f + 4)) = htons(plen);
+	f[6] = nh;
+	f[7] = hl;
+	memcpy(f + 8, src, 16);
+	memcpy(f + 24, dst, 16);
+	return(f + IP6_LEN);
+}
+
+/* Checksum of IPv6 payload p (plen bytes, checksum field zero) */
+static uint16_t frame_csum(const uint8_t *p, uint8_t nh, uint16_t plen)
+{
+	uint32_t	sum;
+
+	sum = csum_add(0, p - IP6_LEN + 8, 32);
+	sum += plen + nh;
+	return(csum_fold(csum_add(sum, p, plen)));
+}
+
+/* Queue the frame from tx_frame(), len bytes */
+static void frame_queue(uint32_t len)
+{
+	struct xdp_desc	*d;
+
+	if (xsk >= 0){
+		d = (struct xdp_desc *) xtx.desc + (xtx.cached++ & (XDP_RING - 1));
+		d->addr = xtx_addr;
+		d->len = len;
+		d->options = 0;
+		__atomic_store_n(xtx.prod, xtx.cached, __ATOMIC_RELEASE);
+	}
+	else {
+		tx_hdr->tp_len = len;
+		tx_hdr->tp_next_offset = 0;
+		__sync_synchronize();
+		tx_hdr->tp_status = TP_STATUS_SEND_REQUEST;
+		tx_cur = (tx_cur + 1) % RAW_TX_FRAMES;
+	}
+	tx_pending++;
+	raw_stats.tx_frames++;
+}
+
+/* Ethernet/IPv6/UDP frame around payload from src (MAC smac) to dst */
+int raw_send(const uint8_t *smac, const struct in6_addr *src, uint16_t sport,
+		const struct in6_addr *dst, uint16_t dport, const void *payload,
+		uint16_t len)
+{
+	uint8_t			*f, dmac[6];
+	uint16_t		sum, ulen = UDP_LEN + len;
+
+	if (ETH_LEN + IP6_LEN + ulen > RAW_FRAME - TPACKET3_HDRLEN)
+		return(-1);
+	if (IN6_IS_ADDR_MULTICAST(dst)){
+		dmac[0] = dmac[1] = 0x33;
+		memcpy(dmac + 2, dst->s6_addr + 12, 4);
+	}
+	else if (have_gwmac)
+		memcpy(dmac, gwmac, 6);
+	else
+		return(-1);
+	if ((f = tx_frame()) == NULL)
+		return(-1);
+	f = frame_head(f, dmac, smac, src->s6_addr, dst->s6_addr, IPPROTO_UDP,
+		IN6_IS_ADDR_MULTICAST(dst) ? 1 : 64, ulen);
+	*((uint16_t *) f) = htons(sport);
+	*((uint16_t *) (f + 2)) = htons(dport);
+	*((uint16_t *) (f + 4)) = htons(ulen);
+	*((uint16_t *) (f + 6)) = 0;
+	memcpy(f + UDP_LEN, payload, len);
+	sum = frame_csum(f, IPPROTO_UDP, ulen);
+	*((uint16_t *) (f + 6)) = htons(sum ? sum : 0xffff);
+	frame_queue(ETH_LEN + IP6_LEN + ulen);
+	return(0);
+}
+
+/*
+    Live clients for the ND responder, keyed by MAC: an open addressed
+    table of 48-bit MACs with bit 48 set, so 0 is free.  EUI-64 targets
+    map back to the MAC, so nothing else needs storing per client.
+*/
+#define ND_DEAD		(1ULL << 63)
+static uint64_t		*nd_index;
+static uint32_t		nd_size, nd_used, nd_dead;
+
+static uint64_t mac_key(const uint8_t *mac)
+{
+	return(1ULL << 48 | (uint64_t) mac[0] << 40 | (uint64_t) mac[1] << 32 |
+		(uint64_t) mac[2] << 24 | mac[3] << 16 | mac[4] << 8 | mac[5]);
+}
+
+static uint32_t nd_slot(uint64_t key)
+{
+	return((key * 0x9e3779b97f4a7c15ULL) >> 32 & (nd_size - 1));
+}
+
+static void nd_grow(void)
+{
+	uint64_t	*old = nd_index;
+	uint32_t	i, j, n = nd_size;
+
+	nd_size = nd_size ? nd_size : 1024;
+	while (nd_used * 4 >= nd_size)
+		nd_size *= 2;
+	nd_index = calloc(nd_size, sizeof(uint64_t));
+	if (nd_index == NULL){
+		perror("raw: ND index");
+		exit(1);
+	}
+	for (i = 0; i < n; i++){
+		if (old[i] == 0 || old[i] == ND_DEAD)
+			continue;
+		for (j = nd_slot(old[i]); nd_index[j]; j = (j + 1) & (nd_size - 1))
+			;
+		nd_index[j] = old[i];
+	}
+	nd_dead = 0;
+	free(old);
+}
+
+static int nd_live(uint64_t key)
+{
+	uint32_t	i;
+
+	if (nd_size == 0)
+		return(0);
+	for (i = nd_slot(key); nd_index[i]; i = (i + 1) & (nd_size - 1))
+		if (nd_index[i] == key)
+			return(1);
+	return(0);
+}
+
+/* Add or remove mac's EUI-64 interface ID in the XDP program's map */
+static void nd_map_update(const uint8_t *mac, int add)
+{
+	union bpf_attr	attr;
+	uint8_t		iid[8], one = 1;
+
+	if (nd_map < 0)
+		return;
+	iid[0] = mac[0] ^ 0x02;
+	iid[1] = mac[1];
+	iid[2] = mac[2];
+	iid[3] = 0xff;
+	iid[4] = 0xfe;
+	memcpy(iid + 5, mac + 3, 3);
+	memset(&attr, 0, sizeof(attr));
+	attr.map_fd = nd_map;
+	attr.key = (uintptr_t) iid;
+	attr.value = (uintptr_t) &one;
+	sys_bpf(add ? BPF_MAP_UPDATE_ELEM : BPF_MAP_DELETE_ELEM, &attr);
+}
+
+void raw_client_add(const uint8_t *mac)
+{
+	uint64_t	key = mac_key(mac);
+	uint32_t	i, dead = UINT32_MAX;
+
+	if ((nd_used + nd_dead + 1) * 2 > nd_size)
+		nd_grow();
+	for (i = nd_slot(key); nd_index[i]; i = (i + 1) & (nd_size - 1)){
+		if (nd_index[i] == key)
+			return;
+		if (nd_index[i] == ND_DEAD && dead == UINT32_MAX)
+			dead = i;
+	}
+	if (dead != UINT32_MAX){
+		i = dead;
+		nd_dead--;
+	}
+	nd_index[i] = key;
+	nd_map_update(mac, 1);
+	if (++nd_used > raw_stats.nd_clients)
+		raw_stats.nd_clients = nd_used;
+}
+
+void raw_client_del(const uint8_t *mac)
+{
+	uint64_t	key = mac_key(mac);
+	uint32_t	i;
+
+	if (nd_size == 0)
+		return;
+	for (i = nd_slot(key); nd_index[i]; i = (i + 1) & (nd_size - 1))
+		if (nd_index[i] == key){
+			nd_index[i] = ND_DEAD;
+			nd_map_update(mac, 0);
+			nd_used--;
+			nd_dead++;
+			return;
+		}
+}
+
+/*
+    Neighbor Solicitation at ip (ICMPv6 of plen bytes) from smac: if the
+    target is a live client's EUI-64 address, answer for it.
+*/
+static void raw_nd(const uint8_t *smac, const uint8_t *ip, uint16_t plen)
+{
+	static const uint8_t	all_nodes[16] = {0xff, 0x02, [15] = 1};
+	static const uint8_t	all_nodes_mac[6] = {0x33, 0x33, 0, 0, 0, 1};
+	const uint8_t		*icmp = ip + IP6_LEN, *target = icmp + 8;
+	const uint8_t		*dst, *dmac;
+	uint8_t			*f, mac[6];
+	uint16_t		sum;
+	int			dad;
+
+	if (icmp[0] != ND_NEIGHBOR_SOLICIT){
+		if (icmp[0] >= ND_ROUTER_SOLICIT && icmp[0] <= ND_REDIRECT)
+			raw_stats.nd_other++;
+		return;
+	}
+	if (plen < 24 || ip[7] != 255 || icmp[1] != 0)
+		return;
+	raw_stats.ns_received++;
+	if (ip[24] == 0xff)
+		raw_stats.ns_multicast++;
+	if (target[11] != 0xff || target[12] != 0xfe){
+		raw_stats.ns_unknown++;
+		return;
+	}
+	mac[0] = target[8] ^ 0x02;
+	mac[1] = target[9];
+	mac[2] = target[10];
+	memcpy(mac + 3, target + 13, 3);
+	if (!nd_live(mac_key(mac))){
+		raw_stats.ns_unknown++;
+		return;
+	}
+	/* From :: is DAD: answer to all-nodes, unsolicited */
+	dad = IN6_IS_ADDR_UNSPECIFIED((const struct in6_addr *) (ip + 8));
+	dst = dad ? all_nodes : ip + 8;
+	dmac = dad ? all_nodes_mac : smac;
+	if ((f = tx_frame()) == NULL)
+		return;
+	f = frame_head(f, dmac, mac, target, dst, IPPROTO_ICMPV6, 255, 32);
+	f[0] = ND_NEIGHBOR_ADVERT;
+	f[1] = 0;
+	*((uint16_t *) (f + 2)) = 0;
+	*((uint32_t *) (f + 4)) = dad ? ND_NA_FLAG_OVERRIDE : ND_NA_FLAG_SOLICITED | ND_NA_FLAG_OVERRIDE;
+	memcpy(f + 8, target, 16);
+	f[24] = ND_OPT_TARGET_LINKADDR;
+	f[25] = 1;
+	memcpy(f + 26, mac, 6);
+	sum = frame_csum(f, IPPROTO_ICMPV6, 32);
+	*((uint16_t *) (f + 2)) = htons(sum);
+	frame_queue(ETH_LEN + IP6_LEN + 32);
+	raw_stats.na_sent++;
+}
+
+/* Hand all queued frames to the kernel in one call; returns how many */
+int raw_flush(void)
+{
+	uint32_t	n = tx_pending;
+	int		tries = 0;
+
+	if (tx_pending == 0)
+		return(0);
+	/* Copy mode AF_XDP sends a bounded batch per call */
+	if (xsk >= 0){
+		while (__atomic_load_n(xtx.cons, __ATOMIC_ACQUIRE) != xtx.cached &&
+				tries++ < 64)
+			if (sendto(xsk, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0 &&
+					errno != EAGAIN && errno != EBUSY && errno != ENOBUFS){
+				perror("xdp: send");
+				break;
+			}
+		tx_pending = xtx.cached - __atomic_load_n(xtx.cons, __ATOMIC_ACQUIRE);
+		xdp_reap();
+		return(n);
+	}
+	/* Frames the kernel couldn't take yet stay pending */
+	if (send(raw_sock, NULL, 0, MSG_DONTWAIT) < 0){
+		if (errno != EAGAIN && errno != ENOBUFS)
+			perror("raw: send");
+		return(n);
+	}
+	tx_pending = 0;
+	return(n);
+}
+
+/* UDP to our port in an IPv6 frame: deliver the payload.  ND goes to raw_nd() */
+static void raw_frame(uint8_t *f, uint32_t len, struct timeval *ts,
+		raw_deliver_t deliver)
+{
+	uint16_t	plen, ulen;
+
+	if (len < ETH_LEN + IP6_LEN ||
+			f[12] != ETH_P_IPV6 >> 8 || f[13] != (ETH_P_IPV6 & 0xff))
+		return;
+	f += ETH_LEN;
+	len -= ETH_LEN;
+	if ((f[0] >> 4) != 6)
+		return;
+	plen = ntohs(*((uint16_t *) (f + 4)));
+	if (IP6_LEN + plen > len)
+		return;
+	if (f[6] == IPPROTO_ICMPV6 && plen >= 4){
+		raw_nd(f - ETH_LEN + 6, f, plen);
+		return;
+	}
+	if (f[6] != IPPROTO_UDP || plen < UDP_LEN)
+		return;
+	f += IP6_LEN;
+	ulen = ntohs(*((uint16_t *) (f + 4)));
+	if (ntohs(*((uint16_t *) (f + 2))) != rx_port || ulen < UDP_LEN || ulen > plen)
+		return;
+	raw_stats.rx_frames++;
+	deliver(f + UDP_LEN, ts, ulen - UDP_LEN);
+}
+
+/* AF_XDP receive ring: frames back to the fill ring once handled */
+static int xdp_recv(raw_deliver_t deliver)
+{
+	struct xdp_desc	*d;
+	struct timeval	ts;
+	uint32_t	prod, n;
+
+	prod = __atomic_load_n(xrx.prod, __ATOMIC_ACQUIRE);
+	if ((n = prod - xrx.cached) == 0)
+		return(0);
+	/* No kernel receive timestamps here: one clock read per batch */
+	gettimeofday(&ts, NULL);
+	for (; xrx.cached != prod; xrx.cached++){
+		d = (struct xdp_desc *) xrx.desc + (xrx.cached & (XDP_RING - 1));
+		raw_frame(umem + d->addr, d->len, &ts, deliver);
+		((uint64_t *) xfill.desc)[xfill.cached++ & (XDP_RING - 1)] =
+			d->addr & ~(uint64_t) (RAW_FRAME - 1);
+	}
+	__atomic_store_n(xrx.cons, xrx.cached, __ATOMIC_RELEASE);
+	__atomic_store_n(xfill.prod, xfill.cached, __ATOMIC_RELEASE);
+	if (*xfill.flags & XDP_RING_NEED_WAKEUP)
+		recvfrom(xsk, NULL, 0, MSG_DONTWAIT, NULL, NULL);
+	return(n);
+}
+
+/* Walk every frame the kernel has handed over; returns frames seen */
+int raw_recv(raw_deliver_t deliver)
+{
+	struct tpacket_block_desc	*bd;
+	struct tpacket3_hdr		*h;
+	struct sockaddr_ll		*sll;
+	struct timeval			ts;
+	uint32_t			i, n = 0;
+
+	if (xsk >= 0){
+		n = xdp_recv(deliver);
+		raw_flush();
+		return(n);
+	}
+	while (1){
+		bd = (struct tpacket_block_desc *) (rx_ring + (size_t) rx_cur * RAW_BLOCK);
+		if (!(bd->hdr.bh1.block_status & TP_STATUS_USER))
+			break;
+		__sync_synchronize();
+		h = (struct tpacket3_hdr *) ((uint8_t *) bd + bd->hdr.bh1.offset_to_first_pkt);
+		for (i = 0; i < bd->hdr.bh1.num_pkts; i++){
+			sll = (struct sockaddr_ll *) ((uint8_t *) h +
+				TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+			if (sll->sll_pkttype != PACKET_OUTGOING){
+				ts.tv_sec = h->tp_sec;
+				ts.tv_usec = h->tp_nsec / 1000;
+				raw_frame((uint8_t *) h + h->tp_mac, h->tp_snaplen, &ts, deliver);
+			}
+			h = (struct tpacket3_hdr *) ((uint8_t *) h + h->tp_next_offset);
+		}
+		n += bd->hdr.bh1.num_pkts;
+		__sync_synchronize();
+		bd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+		rx_cur = (rx_cur + 1) % RAW_RX_BLOCKS;
+	}
+	/* Neighbor Advertisements go out now, not with the next sends */
+	raw_flush();
+	return(n);
+}
+
+/* Frames the kernel dropped before we read them, so far */
+uint64_t raw_drops(void)
+{
+	struct tpacket_stats_v3	st;
+	struct xdp_statistics	xst;
+	socklen_t		len = sizeof(st), xlen = sizeof(xst);
+
+	/* XDP_STATISTICS are running totals, PACKET_STATISTICS reset on read */
+	if (xsk >= 0){
+		if (getsockopt(xsk, SOL_XDP, XDP_STATISTICS, &xst, &xlen) == 0)
+			raw_stats.rx_drops = xst.rx_dropped + xst.rx_ring_full;
+	}
+	else if (getsockopt(raw_sock, SOL_PACKET, PACKET_STATISTICS, &st, &len) == 0)
+		raw_stats.rx_drops += st.tp_drops;
+	return(raw_stats.rx_drops);
+}
+
+void raw_report(FILE *fp)
+{
+	raw_drops();
+	fprintf(fp,"Raw frames sent:        %6" PRIu64 " (TX ring full %" PRIu64 ")\n",
+		raw_stats.tx_frames, raw_stats.tx_stalls);
+	fprintf(fp,"Raw frames received:    %6" PRIu64 " (kernel drops %" PRIu64 ")\n",
+		raw_stats.rx_frames, raw_stats.rx_drops);
+	fprintf(fp,"ND solicitations:       %6" PRIu64 " (multicast %" PRIu64
+		", not ours %" PRIu64 ")\n", raw_stats.ns_received,
+		raw_stats.ns_multicast, raw_stats.ns_unknown);
+	fprintf(fp,"ND advertisements sent: %6" PRIu64 " (%" PRIu64 " clients at peak)\n",
+		raw_stats.na_sent, raw_stats.nd_clients);
+	if (raw_stats.nd_other)
+		fprintf(fp,"Other ND received:      %6" PRIu64 "\n", raw_stats.nd_other);
+}
+
+#else
+
+int raw_open(const char *ifname, const uint8_t *dmac, uint16_t port, int mode)
+{
+	fprintf(stderr,"--raw needs Linux AF_PACKET\n");
+	return(-1);
+}
+int raw_fd(void) { return(-1); }
+void raw_ifmac(uint8_t *mac) { memset(mac, 0, 6); }
+void raw_linklocal(const uint8_t *mac, struct in6_addr *ll) { memset(ll, 0, sizeof(*ll)); }
+int raw_send(const uint8_t *smac, const struct in6_addr *src, uint16_t sport,
+		const struct in6_addr *dst, uint16_t dport, const void *payload,
+		uint16_t len) { return(-1); }
+int raw_flush(void) { return(0); }
+void raw_client_add(const uint8_t *mac) { }
+void raw_client_del(const uint8_t *mac) { }
+int raw_recv(raw_deliver_t deliver) { return(0); }
+uint64_t raw_drops(void) { return(0); }
+void raw_report(FILE *fp) { }
+
+#endif
@@ -0,0 +1,51 @@
+/*
+    Raw L2 transport for dras6 --raw: Ethernet/IPv6/UDP frames through
+    mmap'd TPACKET_V3 rings, so each simulated client can use its own
+    MAC and EUI-64 link-local address.  Neighbor Solicitations for live
+    clients are answered here.  --xdp swaps the rings for an AF_XDP
+    socket.
+*/
+#ifndef RAWNET_H
+#define RAWNET_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+
+#define RAW_TPACKET		0
+#define RAW_XDP_SKB		1	/* generic XDP, copy */
+#define RAW_XDP_COPY		2	/* driver XDP, copy */
+#define RAW_XDP_ZC		3	/* driver XDP, zero copy */
+
+typedef int (*raw_deliver_t)(void *, struct timeval *, uint32_t);
+
+typedef struct {
+	uint64_t		tx_frames;
+	uint64_t		tx_stalls;	/* TX ring full */
+	uint64_t		rx_frames;	/* UDP to our port */
+	uint64_t		rx_drops;	/* dropped by the kernel */
+	uint64_t		ns_received;	/* Neighbor Solicitations */
+	uint64_t		ns_multicast;	/* address resolution */
+	uint64_t		ns_unknown;	/* target not a live client */
+	uint64_t		na_sent;
+	uint64_t		nd_other;	/* RS, RA, NA, redirect */
+	uint64_t		nd_clients;	/* peak live clients */
+} raw_stats_t;
+
+extern raw_stats_t		raw_stats;
+
+int		raw_open(const char *, const uint8_t *, uint16_t, int);
+int		raw_fd(void);
+void		raw_ifmac(uint8_t *);
+void		raw_linklocal(const uint8_t *, struct in6_addr *);
+int		raw_send(const uint8_t *, const struct in6_addr *, uint16_t,
+			const struct in6_addr *, uint16_t, const void *, uint16_t);
+int		raw_flush(void);
+void		raw_client_add(const uint8_t *);
+void		raw_client_del(const uint8_t *);
+int		raw_recv(raw_deliver_t);
+uint64_t	raw_drops(void);
+void		raw_report(FILE *);
+
+#endif